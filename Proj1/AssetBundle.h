@@ -0,0 +1,375 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include <stdio.h>
+#include "OBJloaderFast.h"
+
+// Packed asset bundle: one file of GPU-ready blobs (vertex and index buffers,
+// texture mip chains) and fixed-size records describing them, memory mapped at
+// startup so uploads read straight from the mapping with nothing to parse.
+//
+// Layout: a BundleHeader, the chunk data (each chunk 16-byte aligned) and the
+// chunk table at tableOffset. A chunk is stored raw, or LZ compressed when
+// that saves enough; compressed chunks are unpacked once on first access.
+// What the chunks hold is up to the writer, records refer to chunks by index.
+
+const char BUNDLE_MAGIC[8] = {'A', '3', '7', '1', 'B', 'N', 'D', 'L'};
+const uint32_t BUNDLE_VERSION = 2;
+const size_t BUNDLE_ALIGNMENT = 16;
+const int BUNDLE_MAX_LEVELS = 16; // mip levels of a texture, enough for 32768 texels
+
+enum BundleCompression {
+	BUNDLE_COMPRESSION_NONE,
+	BUNDLE_COMPRESSION_LZ
+};
+
+struct BundleHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordLayout;   // set by the writer from its record sizes, rejects bundles written by another build
+	uint32_t chunkCount;
+	int32_t rootChunk;       // chunk the reader starts from, the writer decides what it holds
+	uint64_t tableOffset;
+};
+
+struct BundleChunk {
+	uint32_t compression;    // BundleCompression
+	uint32_t reserved;
+	uint64_t offset;         // from the start of the file
+	uint64_t size;           // bytes stored in the file
+	uint64_t rawSize;        // bytes once unpacked
+};
+
+// LZ77 with a 64 KB window, in the token layout of LZ4 blocks: a token byte
+// holds the literal count (high nibble) and the match length - 4 (low nibble),
+// 15 meaning more length bytes follow, 255 each until a smaller one. Each
+// literal run is followed by the match's 16-bit offset, except the last one.
+const size_t BUNDLE_MIN_MATCH = 4;
+const int BUNDLE_HASH_BITS = 14;
+
+void writeBundleLength(std::vector<uint8_t> & out, size_t length) {
+	while (length >= 255) {
+		out.push_back(255);
+		length -= 255;
+	}
+	out.push_back((uint8_t)length);
+}
+
+// One sequence: literals, then a match of matchLength bytes offset bytes back (none when matchLength is 0)
+void writeBundleSequence(std::vector<uint8_t> & out, const uint8_t * literals, size_t literalCount, size_t matchLength, size_t offset) {
+	size_t extra = matchLength > 0 ? matchLength - BUNDLE_MIN_MATCH : 0;
+	out.push_back((uint8_t)(((literalCount < 15 ? literalCount : 15) << 4) | (extra < 15 ? extra : 15)));
+	if (literalCount >= 15)
+		writeBundleLength(out, literalCount - 15);
+	out.insert(out.end(), literals, literals + literalCount);
+	if (matchLength == 0)
+		return;
+	out.push_back((uint8_t)(offset & 0xff));
+	out.push_back((uint8_t)(offset >> 8));
+	if (extra >= 15)
+		writeBundleLength(out, extra - 15);
+}
+
+void compressBundleChunk(const uint8_t * src, size_t size, std::vector<uint8_t> & out) {
+	out.clear();
+	out.reserve(size / 2);
+	const uint32_t none = 0xffffffffu;
+	std::vector<uint32_t> table((size_t)1 << BUNDLE_HASH_BITS, none); // last position of each 4-byte hash
+	size_t anchor = 0, pos = 0;
+	while (pos + BUNDLE_MIN_MATCH <= size) {
+		uint32_t sequence;
+		memcpy(&sequence, src + pos, sizeof(sequence));
+		uint32_t hash = (sequence * 2654435761u) >> (32 - BUNDLE_HASH_BITS);
+		uint32_t candidate = table[hash];
+		table[hash] = (uint32_t)pos;
+		if (candidate == none || pos - candidate > 65535 || memcmp(src + candidate, src + pos, BUNDLE_MIN_MATCH) != 0) {
+			pos++;
+			continue;
+		}
+		size_t length = BUNDLE_MIN_MATCH;
+		while (pos + length < size && src[candidate + length] == src[pos + length])
+			length++;
+		writeBundleSequence(out, src + anchor, pos - anchor, length, pos - candidate);
+		pos += length;
+		anchor = pos;
+	}
+	writeBundleSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+// Unpacks exactly rawSize bytes into dst, false when src is corrupt
+bool decompressBundleChunk(const uint8_t * src, size_t size, uint8_t * dst, size_t rawSize) {
+	size_t in = 0, out = 0;
+	while (in < size) {
+		uint8_t token = src[in++];
+		size_t literals = token >> 4;
+		if (literals == 15) {
+			uint8_t more;
+			do {
+				if (in >= size)
+					return false;
+				more = src[in++];
+				literals += more;
+			} while (more == 255);
+		}
+		if (literals > size - in || literals > rawSize - out)
+			return false;
+		memcpy(dst + out, src + in, literals);
+		in += literals;
+		out += literals;
+		if (in == size)
+			break; // the last sequence has no match
+		if (size - in < 2)
+			return false;
+		size_t offset = src[in] | ((size_t)src[in + 1] << 8);
+		in += 2;
+		size_t length = token & 15;
+		if (length == 15) {
+			uint8_t more;
+			do {
+				if (in >= size)
+					return false;
+				more = src[in++];
+				length += more;
+			} while (more == 255);
+		}
+		length += BUNDLE_MIN_MATCH;
+		if (offset == 0 || offset > out || length > rawSize - out)
+			return false;
+		for (size_t i = 0; i < length; i++) // byte by byte, a match may overlap its own output
+			dst[out + i] = dst[out + i - offset];
+		out += length;
+	}
+	return out == rawSize;
+}
+
+// Appends the mip chain of 8-bit pixels to chain, level 0 first, each level a
+// 2x2 box filter of the previous one (the last row / column repeats on odd sizes).
+// levelOffsets receives where each level starts in chain. Returns the level count.
+int buildMipChain(const uint8_t * pixels, int width, int height, int channels, std::vector<uint8_t> & chain, uint64_t levelOffsets[BUNDLE_MAX_LEVELS]) {
+	chain.clear();
+	chain.insert(chain.end(), pixels, pixels + (size_t)width * height * channels);
+	levelOffsets[0] = 0;
+	int levelCount = 1;
+	while ((width > 1 || height > 1) && levelCount < BUNDLE_MAX_LEVELS) {
+		int nextWidth = width > 1 ? width / 2 : 1;
+		int nextHeight = height > 1 ? height / 2 : 1;
+		size_t source = (size_t)levelOffsets[levelCount - 1];
+		levelOffsets[levelCount] = chain.size();
+		chain.resize(chain.size() + (size_t)nextWidth * nextHeight * channels);
+		const uint8_t * src = &chain[source];
+		uint8_t * dst = &chain[(size_t)levelOffsets[levelCount]];
+		for (int y = 0; y < nextHeight; y++) {
+			int y0 = y * 2, y1 = y * 2 + 1 < height ? y * 2 + 1 : height - 1;
+			for (int x = 0; x < nextWidth; x++) {
+				int x0 = x * 2, x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+				for (int c = 0; c < channels; c++) {
+					int sum = src[((size_t)y0 * width + x0) * channels + c] + src[((size_t)y0 * width + x1) * channels + c]
+						+ src[((size_t)y1 * width + x0) * channels + c] + src[((size_t)y1 * width + x1) * channels + c];
+					dst[((size_t)y * nextWidth + x) * channels + c] = (uint8_t)((sum + 2) / 4);
+				}
+			}
+		}
+		width = nextWidth;
+		height = nextHeight;
+		levelCount++;
+	}
+	return levelCount;
+}
+
+struct BundleWriter {
+	FILE * file = NULL;
+	BundleHeader header;
+	std::vector<BundleChunk> chunks;
+	std::string strings;     // string table, written as the last chunk
+	bool compress = false;   // try LZ on every chunk
+	uint64_t rawBytes = 0;
+	uint64_t storedBytes = 0;
+};
+
+bool openBundleWriter(BundleWriter & writer, const char * path, uint32_t recordLayout, bool compress) {
+	writer.file = fopen(path, "wb");
+	if (!writer.file) {
+		printf("Could not create the bundle %s\n", path);
+		return false;
+	}
+	memset(&writer.header, 0, sizeof(writer.header));
+	memcpy(writer.header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+	writer.header.version = BUNDLE_VERSION;
+	writer.header.recordLayout = recordLayout;
+	writer.header.rootChunk = -1;
+	writer.compress = compress;
+	writer.chunks.clear();
+	writer.strings.assign(1, '\0'); // offset 0 is the empty string
+	return fwrite(&writer.header, sizeof(writer.header), 1, writer.file) == 1;
+}
+
+void padBundle(BundleWriter & writer) {
+	static const char zeros[BUNDLE_ALIGNMENT] = {0};
+	long at = ftell(writer.file);
+	if (at % BUNDLE_ALIGNMENT)
+		fwrite(zeros, 1, BUNDLE_ALIGNMENT - at % BUNDLE_ALIGNMENT, writer.file);
+}
+
+// Writes size bytes as a new chunk and returns its index, -1 for an empty chunk
+// The chunk is LZ compressed when the writer compresses and it saves an eighth or more
+int addBundleChunk(BundleWriter & writer, const void * data, size_t size) {
+	if (size == 0)
+		return -1;
+	padBundle(writer);
+	BundleChunk chunk;
+	memset(&chunk, 0, sizeof(chunk));
+	chunk.offset = (uint64_t)ftell(writer.file);
+	chunk.rawSize = size;
+	chunk.size = size;
+	std::vector<uint8_t> packed;
+	if (writer.compress && size < 0xffffffffu) {
+		compressBundleChunk((const uint8_t *)data, size, packed);
+		if (packed.size() <= size - size / 8) {
+			chunk.compression = BUNDLE_COMPRESSION_LZ;
+			chunk.size = packed.size();
+			data = packed.data();
+		}
+	}
+	fwrite(data, 1, (size_t)chunk.size, writer.file);
+	writer.rawBytes += chunk.rawSize;
+	writer.storedBytes += chunk.size;
+	writer.chunks.push_back(chunk);
+	return (int)writer.chunks.size() - 1;
+}
+
+template <typename T>
+int addBundleArray(BundleWriter & writer, const std::vector<T> & records) {
+	return records.empty() ? -1 : addBundleChunk(writer, records.data(), records.size() * sizeof(T));
+}
+
+// Offset of s in the string table, the same string is stored once
+uint32_t addBundleString(BundleWriter & writer, const std::string & s) {
+	if (s.empty())
+		return 0;
+	std::string entry = s + '\0';
+	size_t found = writer.strings.find(entry);
+	while (found != std::string::npos && found > 0 && writer.strings[found - 1] != '\0')
+		found = writer.strings.find(entry, found + 1); // only whole strings, not the tail of a longer one
+	if (found != std::string::npos)
+		return (uint32_t)found;
+	writer.strings += entry;
+	return (uint32_t)(writer.strings.size() - entry.size());
+}
+
+// Writes the string table (always the last chunk, so the reader finds it
+// without a record) and the chunk table, and finishes the header
+bool closeBundleWriter(BundleWriter & writer, int rootChunk) {
+	addBundleChunk(writer, writer.strings.data(), writer.strings.size());
+	padBundle(writer);
+	writer.header.tableOffset = (uint64_t)ftell(writer.file);
+	writer.header.chunkCount = (uint32_t)writer.chunks.size();
+	writer.header.rootChunk = rootChunk;
+	bool written = fwrite(writer.chunks.data(), sizeof(BundleChunk), writer.chunks.size(), writer.file) == writer.chunks.size();
+	fseek(writer.file, 0, SEEK_SET);
+	written = fwrite(&writer.header, sizeof(writer.header), 1, writer.file) == 1 && written;
+	written = fclose(writer.file) == 0 && written;
+	writer.file = NULL;
+	return written;
+}
+
+// A mapped bundle. Raw chunks are read in place, compressed ones are unpacked
+// into unpacked[chunk] the first time they are asked for.
+struct AssetBundle {
+	MappedFile file;
+	const BundleHeader * header = NULL;
+	const BundleChunk * chunks = NULL;
+	std::vector<std::vector<uint8_t> > unpacked;
+	const char * strings = NULL;
+	size_t stringsSize = 0;
+	uint64_t unpackedBytes = 0;
+};
+
+const void * bundleChunkData(AssetBundle & bundle, int chunk, size_t & size);
+
+bool openAssetBundle(const char * path, uint32_t recordLayout, AssetBundle & bundle) {
+	if (!openMappedFile(path, bundle.file)) {
+		printf("Impossible to open the bundle %s\n", path);
+		return false;
+	}
+	bundle.header = (const BundleHeader *)bundle.file.data;
+	const BundleHeader & header = *bundle.header;
+	if (bundle.file.size < sizeof(BundleHeader) || memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+		printf("%s is not an asset bundle\n", path);
+		return false;
+	}
+	if (header.version != BUNDLE_VERSION || header.recordLayout != recordLayout) {
+		printf("%s was written by another version (%u, layout %08x), rebuild it\n", path, header.version, header.recordLayout);
+		return false;
+	}
+	if (header.tableOffset > bundle.file.size || header.chunkCount == 0
+		|| header.chunkCount > (bundle.file.size - header.tableOffset) / sizeof(BundleChunk)) {
+		printf("%s: truncated chunk table\n", path);
+		return false;
+	}
+	bundle.chunks = (const BundleChunk *)(bundle.file.data + header.tableOffset);
+	for (uint32_t i = 0; i < header.chunkCount; i++) {
+		const BundleChunk & chunk = bundle.chunks[i];
+		if (chunk.offset > bundle.file.size || chunk.size > bundle.file.size - chunk.offset
+			|| (chunk.compression == BUNDLE_COMPRESSION_NONE && chunk.size != chunk.rawSize)) {
+			printf("%s: chunk %u is out of the file\n", path, i);
+			return false;
+		}
+	}
+	bundle.unpacked.assign(header.chunkCount, std::vector<uint8_t>());
+	const void * strings = bundleChunkData(bundle, (int)header.chunkCount - 1, bundle.stringsSize);
+	if (!strings || bundle.stringsSize == 0 || ((const char *)strings)[bundle.stringsSize - 1] != '\0') {
+		printf("%s: bad string table\n", path);
+		return false;
+	}
+	bundle.strings = (const char *)strings;
+	return true;
+}
+
+// Bytes of chunk, NULL (and size 0) for chunk -1 or a chunk that fails to unpack
+const void * bundleChunkData(AssetBundle & bundle, int chunk, size_t & size) {
+	size = 0;
+	if (chunk < 0 || chunk >= (int)bundle.header->chunkCount)
+		return NULL;
+	const BundleChunk & entry = bundle.chunks[chunk];
+	const uint8_t * stored = (const uint8_t *)bundle.file.data + entry.offset;
+	if (entry.compression == BUNDLE_COMPRESSION_NONE) {
+		size = (size_t)entry.size;
+		return stored;
+	}
+	std::vector<uint8_t> & unpacked = bundle.unpacked[chunk];
+	if (unpacked.empty()) {
+		unpacked.resize((size_t)entry.rawSize);
+		if (entry.compression != BUNDLE_COMPRESSION_LZ || !decompressBundleChunk(stored, (size_t)entry.size, unpacked.data(), unpacked.size())) {
+			printf("Bundle chunk %d is corrupt\n", chunk);
+			std::vector<uint8_t>().swap(unpacked);
+			return NULL;
+		}
+		bundle.unpackedBytes += entry.rawSize;
+	}
+	size = unpacked.size();
+	return unpacked.data();
+}
+
+// Chunk as an array of records, count 0 when it is missing or not a whole number of them
+template <typename T>
+const T * bundleArray(AssetBundle & bundle, int chunk, size_t & count) {
+	size_t size;
+	const void * data = bundleChunkData(bundle, chunk, size);
+	count = size % sizeof(T) == 0 ? size / sizeof(T) : 0;
+	return count ? (const T *)data : NULL;
+}
+
+const char * bundleString(const AssetBundle & bundle, uint32_t offset) {
+	return offset < bundle.stringsSize ? bundle.strings + offset : "";
+}
+
+void closeAssetBundle(AssetBundle & bundle) {
+	closeMappedFile(bundle.file);
+	bundle.header = NULL;
+	bundle.chunks = NULL;
+	bundle.strings = NULL;
+	std::vector<std::vector<uint8_t> >().swap(bundle.unpacked);
+}
@@ -20,6 +20,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+#include "TextureRegistry.h" //Shared texture handles, deduplicated by path and content
+
 using namespace glm;
 using namespace std;
 
@@ -52,7 +54,7 @@ private:
     vec3 mVelocity;
 };
 
-GLuint loadTexture(const char *filename);
+GLuint uploadTexture(const unsigned char *data, int width, int height, int nrChannels);
 
 const char *getVertexShaderSource();
 
@@ -64,18 +66,9 @@ const char *getTexturedFragmentShaderSource();
 
 int compileAndLinkShaders(const char *vertexShaderSource, const char *fragmentShaderSource);
 
-GLuint loadTexture(const char *filename)
+// Creates a texture from decoded 8-bit pixels, the upload of acquireTexture
+GLuint uploadTexture(const unsigned char *data, int width, int height, int nrChannels)
 {
-    // load texture dimension data
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrChannels, 0);
-    if (!data)
-    {
-        std::cerr << "ERROR::texture could not load texture file\n"
-                  << filename << std::endl;
-        return 0;
-    }
-
     // step 2 create and bind texture
     GLuint textureID = 0;
     glGenTextures(1, &textureID);
@@ -103,8 +96,6 @@ GLuint loadTexture(const char *filename)
     }
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 
-    // step 5 free resources
-    stbi_image_free(data);
     glBindTexture(GL_TEXTURE_2D, 0);
     return textureID;
 }
@@ -699,12 +690,14 @@ int main(int argc, char *argv[])
     }
 
     // Load Textures
-    GLuint brickTextureID = loadTexture("Textures/brick.jpg");
-    GLuint cementTextureID = loadTexture("Textures/cement.jpg");
-    GLuint stoneTextureID = loadTexture("Textures/stone.jpg");
-    GLuint graniteTextureID = loadTexture("Textures/granite.jpg");
-    GLuint sandTextureID = loadTexture("Textures/soilsand.jpg");
-    GLuint woodTextureID = loadTexture("Textures/wood.jpg");
+    TextureRegistry textureRegistry;
+    GLuint brickTextureID = acquireTexture(textureRegistry, "Textures/brick.jpg", uploadTexture);
+    GLuint cementTextureID = acquireTexture(textureRegistry, "Textures/cement.jpg", uploadTexture);
+    GLuint stoneTextureID = acquireTexture(textureRegistry, "Textures/stone.jpg", uploadTexture);
+    GLuint graniteTextureID = acquireTexture(textureRegistry, "Textures/granite.jpg", uploadTexture);
+    GLuint sandTextureID = acquireTexture(textureRegistry, "Textures/soilsand.jpg", uploadTexture);
+    GLuint woodTextureID = acquireTexture(textureRegistry, "Textures/wood.jpg", uploadTexture);
+    printTextureRegistryStats(textureRegistry);
 
     // Black background
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -3,6 +3,15 @@
 #include <algorithm>
 #include <vector>
 #include <list>
+#include <map>
+#include <chrono>
+#ifdef _WIN32
+#include <io.h>     // _findfirst, to list the assets to cook
+#include <direct.h> // _mkdir
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 // #define GLEW_STATIC 1 // This allows linking with Static Library on Windows, without DLL
 #include <GL/glew.h> // Include GLEW - OpenGL Extension Wrangler
@@ -19,6 +28,20 @@
 
 #include "OBJloader.h"   //For loading .obj files
 #include "OBJloaderV2.h" //For loading .obj files using a polygon list format
+#include "OBJloaderFast.h" //Memory-mapped versions of both loaders for large files
+#include "OBJloaderStream.h" //Bounded-memory streaming of very large .obj files
+#include "MeshOptimize.h" //Vertex cache / overdraw / vertex fetch reordering of indexed meshes
+#include "VertexQuantize.h" //Compact quantized vertex format
+#include "Meshlet.h" //Per-cluster frustum and back-face culling of indexed meshes
+#include "MeshLOD.h" //Simplified levels of detail and their selection by screen size
+#include "OBJmaterial.h" //.mtl materials and grouping of faces by material
+#include "AsyncLoader.h" //Worker threads for loading models in the background
+#include "ImportProfile.h" //Named Assimp post-processing profiles and their import cost
+#include "Skeleton.h" //Bone weights and keyframe animation for GPU skinning
+#include "AssetBundle.h" //Memory-mapped bundles of GPU-ready buffers and textures
+#include "TextureCompress.h" //BC1/BC3/BC7 block compression of texture levels
+#include "TextureAtlas.h" //Layout of material textures in the layers of a texture array
+#include "TextureRegistry.h" //Shared texture handles, deduplicated by path and content
 
 // Assimp headers
 #include <assimp/Importer.hpp>
@@ -54,7 +77,15 @@ private:
     vec3 mVelocity;
 };
 
-GLuint loadTexture(const char *filename);
+// How the textures of a TextureCache are stored and sampled
+struct TextureOptions
+{
+    bool mipmaps = true;      // Full mip chain with trilinear filtering, else level 0 only with GL_LINEAR
+    float anisotropy = 16.0f; // Anisotropic filtering samples, clamped to what the driver allows; 1 turns it off
+    bool immutableStorage = true; // glTexStorage2D when available; off lets the residency manager resize textures later
+};
+
+GLuint loadTexture(const char *filename, const TextureOptions &options = TextureOptions());
 
 const char *getVertexShaderSource();
 
@@ -66,18 +97,88 @@ const char *getTexturedFragmentShaderSource();
 
 // int compileAndLinkShaders(const char *vertexShaderSource, const char *fragmentShaderSource);
 
-GLuint loadTexture(const char *filename)
+// Pixel format of 8-bit pixels with 1, 3 or 4 channels
+GLenum textureFormat(int nrChannels)
 {
-    // load texture dimension data
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrChannels, 0);
-    if (!data)
+    GLenum format = 0;
+    if (nrChannels == 1)
     {
-        std::cerr << "ERROR::texture could not load texture file\n"
-                  << filename << std::endl;
-        return 0;
+        format = GL_RED;
+    }
+    else if (nrChannels == 3)
+    {
+        format = GL_RGB;
+    }
+    else if (nrChannels == 4)
+    {
+        format = GL_RGBA;
+    }
+    return format;
+}
+
+// Sized internal format of 8-bit pixels with 1, 3 or 4 channels, as immutable storage needs
+GLenum textureInternalFormat(int nrChannels)
+{
+    return nrChannels == 1 ? GL_R8 : nrChannels == 3 ? GL_RGB8 : GL_RGBA8;
+}
+
+// Levels of a full mip chain down to 1x1
+int mipLevelCount(int width, int height)
+{
+    int levels = 1;
+    while ((width > 1 || height > 1) && levels < BUNDLE_MAX_LEVELS)
+    {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        levels++;
+    }
+    return levels;
+}
+
+// Allocates levelCount levels of the bound texture, immutable (glTexStorage2D) when the driver has it
+// Returns true for immutable storage; otherwise the caller's glTexImage2D calls allocate each level
+bool allocateTextureStorage(int levelCount, int width, int height, int nrChannels)
+{
+    if (!GLEW_ARB_texture_storage && !GLEW_VERSION_4_2)
+    {
+        return false;
+    }
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, textureInternalFormat(nrChannels), width, height);
+    return true;
+}
+
+// Most anisotropic samples the driver allows, 1 without the extension
+float maxTextureAnisotropy()
+{
+    static float maxAnisotropy = 0.0f;
+    if (maxAnisotropy == 0.0f)
+    {
+        maxAnisotropy = 1.0f;
+        if (GLEW_EXT_texture_filter_anisotropic || GLEW_ARB_texture_filter_anisotropic)
+        {
+            glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        }
+    }
+    return maxAnisotropy;
+}
+
+// Filtering of the texture bound to target: trilinear and anisotropic when it has mips and options ask for them
+void applyTextureSampling(const TextureOptions &options, int levelCount, GLenum target = GL_TEXTURE_2D)
+{
+    bool mipmapped = options.mipmaps && levelCount > 1;
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (GLEW_EXT_texture_filter_anisotropic || GLEW_ARB_texture_filter_anisotropic)
+    {
+        float anisotropy = mipmapped ? std::max(1.0f, std::min(options.anisotropy, maxTextureAnisotropy())) : 1.0f;
+        glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
     }
+}
 
+// Creates a texture from decoded 8-bit pixels with 1, 3 or 4 channels
+// With options.mipmaps the full mip chain is built on the GPU from level 0
+GLuint uploadTexture(const unsigned char *data, int width, int height, int nrChannels, const TextureOptions &options = TextureOptions())
+{
     // step 2 create and bind texture
     GLuint textureID = 0;
     glGenTextures(1, &textureID);
@@ -86,479 +187,3644 @@ GLuint loadTexture(const char *filename)
     glBindTexture(GL_TEXTURE_2D, textureID);
 
     // step 3 set filter parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    int levelCount = options.mipmaps ? mipLevelCount(width, height) : 1;
+    applyTextureSampling(options, levelCount);
 
     // step 4 upload texture to the pu
-    GLenum format = 0;
-    if (nrChannels == 1)
+    GLenum format = textureFormat(nrChannels);
+    if (options.immutableStorage && allocateTextureStorage(levelCount, width, height, nrChannels))
     {
-        format = GL_RED;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
     }
-    else if (nrChannels == 3)
+    else
     {
-        format = GL_RGB;
+        glTexImage2D(GL_TEXTURE_2D, 0, textureInternalFormat(nrChannels), width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
     }
-    else if (nrChannels == 4)
+    if (levelCount > 1)
     {
-        format = GL_RGBA;
+        glGenerateMipmap(GL_TEXTURE_2D);
     }
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 
-    // step 5 free resources
-    stbi_image_free(data);
     glBindTexture(GL_TEXTURE_2D, 0);
     return textureID;
 }
-const char *getVertexShaderSource()
+
+// Creates a texture from a whole mip chain already in memory, level k starting at levelOffsets[k] of levels
+GLuint uploadTextureLevels(const unsigned char *levels, const uint64_t *levelOffsets, int levelCount, int width, int height, int nrChannels, const TextureOptions &options = TextureOptions())
 {
-    return "#version 330 core\n"
-           "layout (location = 0) in vec3 aPos;\n"
-           "layout (location = 1) in vec3 aNormal;\n"
-           "layout (location = 2) in vec2 aUV;\n"
+    GLuint textureID = 0;
+    glGenTextures(1, &textureID);
+    assert(textureID != 0);
 
-           "\n"
-           "out vec3 vertexNormal;\n"
-           "out vec2 vertexUV;\n"
-           "out vec3 worldPos;\n" // Added for spotlight calculations
-           "\n"
-           "uniform mat4 worldMatrix;\n"
-           "uniform mat4 viewMatrix;\n"
-           "uniform mat4 projectionMatrix;\n"
-           "\n"
-           "void main()\n"
-           "{\n"
-           "   vertexUV = aUV;\n"
-           "   vertexNormal = mat3(transpose(inverse(worldMatrix))) * aNormal;\n"
-           "   worldPos = vec3(worldMatrix * vec4(aPos, 1.0));\n" // Added world position
-           "   mat4 modelViewProjection = projectionMatrix * viewMatrix * worldMatrix;\n"
-           "   gl_Position = modelViewProjection * vec4(aPos, 1.0);\n"
-           "}";
-}
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    applyTextureSampling(options, levelCount);
 
-const char *getFragmentShaderSource()
-{
-    return "#version 330 core\n"
-           "in vec3 vertexColor;\n"
-           "in vec2 vertexUV;\n"
-           "in vec3 vertexNormal;\n"
-           "in vec3 worldPos;\n"
-           "uniform sampler2D textureSampler;\n"
-           "uniform bool useTexture;\n"
-           "uniform vec3 objectColor;\n"
-           "uniform vec3 spotlightPos[3];\n" // Multiple spotlight uniforms - using explicit array size
-           "uniform vec3 spotlightDir[3];\n"
-           "uniform float spotlightCutoff[3];\n"
-           "uniform float spotlightOuterCutoff[3];\n"
-           "uniform vec3 spotlightColor[3];\n"
-           "uniform float spotlightIntensity[3];\n"
-           "\n"
-           "out vec4 FragColor;\n"
-           "float calculateSpotlight(vec3 lightPos, vec3 lightDir, float cutoff, float outerCutoff, vec3 fragPos)\n"
-           "{\n"
-           "    vec3 lightToFrag = normalize(fragPos - lightPos);\n"
-           "    float theta = dot(lightToFrag, normalize(lightDir));\n"
-           "    float epsilon = cutoff - outerCutoff;\n"
-           "    float intensity = clamp((theta - outerCutoff) / epsilon, 0.0, 1.0);\n"
-           "    return intensity;\n"
-           "}\n"
-           "void main()\n"
-           "{\n"
-           "   vec3 totalLightContribution = vec3(0.0);\n" // Calculate combined lighting from all 3 spotlights
-           "   \n"
-           "   for(int i = 0; i < 3; i++) {\n" // Process each spotlight individually (unrolled loop for better compatibility)
-           "       float spotIntensity = calculateSpotlight(spotlightPos[i], spotlightDir[i], spotlightCutoff[i], spotlightOuterCutoff[i], worldPos);\n"
-           "       \n"
-           "       vec3 normal = normalize(vertexNormal);\n"
-           "       vec3 lightDirection = normalize(spotlightPos[i] - worldPos);\n"
-           "       float diffuse = max(dot(normal, lightDirection), 0.0);\n"
-           "       \n"
-           "       float lightFactor = spotIntensity * diffuse * spotlightIntensity[i];\n"
-           "       totalLightContribution += spotlightColor[i] * lightFactor;\n"
-           "   }\n"
-           "   \n"
-           "   vec3 ambient = vec3(0.4);\n" // Higher ambient lighting so models are always visible
-           "   \n"
-           "   if (useTexture) {\n"
-           "       vec4 textureColor = texture(textureSampler, vertexUV);\n"
-           "       FragColor = textureColor * vec4(ambient + totalLightContribution, 1.0);\n"
-           "   } else {\n"
-           "       float beam = sin(vertexUV.x * 10.0);\n" // Enhanced beam effect with better base color
-           "       beam = beam * 0.5 + 0.5;\n"
-           "       \n"
-           "       vec3 baseColor = max(objectColor, vec3(0.6)) * 2.3;\n"                     // Boost the objectColor to make it more visible and add beam multiplier
-           "       vec3 beamColor = baseColor * (beam * 0.7 + 0.8);\n"                        // Ensure minimum brightness
-           "       vec3 finalColor = beamColor * (ambient + totalLightContribution * 1.2);\n" // Beam effect with higher base
-           "       \n"
-           "       FragColor = vec4(finalColor, 1.0);\n"
-           "   }\n"
-           "}";
-}
+    // the small levels of an RGB texture have rows that are not a multiple of 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLenum format = textureFormat(nrChannels);
+    bool immutable = options.immutableStorage && allocateTextureStorage(levelCount, width, height, nrChannels);
+    if (!immutable)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    }
+    for (int level = 0; level < levelCount; level++)
+    {
+        if (immutable)
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE, levels + levelOffsets[level]);
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, textureInternalFormat(nrChannels), width, height, 0, format, GL_UNSIGNED_BYTE, levels + levelOffsets[level]);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-const char *getTexturedVertexShaderSource()
-{
-    return getVertexShaderSource(); // TODO: Replace this with the actual textured vertex shader
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return textureID;
 }
 
-const char *getTexturedFragmentShaderSource()
+// GL internal format of a block format, 0 when the driver cannot sample it
+GLenum compressedTextureFormat(TextureBlockFormat blockFormat)
 {
-    return getFragmentShaderSource(); // TODO: Replace this with the actual textured fragment shader
+    if (blockFormat == TEXTURE_BLOCK_BC1 && GLEW_EXT_texture_compression_s3tc)
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    if (blockFormat == TEXTURE_BLOCK_BC3 && GLEW_EXT_texture_compression_s3tc)
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    if (blockFormat == TEXTURE_BLOCK_BC7 && (GLEW_ARB_texture_compression_bptc || GLEW_VERSION_4_2))
+        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    return 0;
 }
 
-GLuint compileAndLinkShaders(const char *vertexShaderSource, const char *fragmentShaderSource)
+// Creates a texture from a block-compressed mip chain, level k starting at levelOffsets[k] of levels
+// The blocks go to the GPU as they are when the driver has the format; otherwise every level is decoded,
+// BC1 to 16-bit 5:6:5 and BC3/BC7 to RGBA8. vramBytes gets the size of the texture on the GPU.
+GLuint uploadCompressedTextureLevels(const unsigned char *levels, const uint64_t *levelOffsets, int levelCount, int width, int height,
+                                     TextureBlockFormat blockFormat, const TextureOptions &options, size_t &vramBytes)
 {
-    // 1. Create the shaders
-    GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // std::cout << "DEBUG: Compiling vertex shader..." << std::endl;
-    glShaderSource(vertexShaderID, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShaderID);
+    GLuint textureID = 0;
+    glGenTextures(1, &textureID);
+    assert(textureID != 0);
 
-    // Check vertex shader for compilation errors
-    GLint success = 0;
-    glGetShaderiv(vertexShaderID, GL_COMPILE_STATUS, &success);
-    if (success == GL_FALSE)
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    applyTextureSampling(options, levelCount);
+
+    GLenum compressedFormat = compressedTextureFormat(blockFormat);
+    GLenum internalFormat = compressedFormat ? compressedFormat : blockFormat == TEXTURE_BLOCK_BC1 ? GL_RGB565 : GL_RGBA8;
+    bool immutable = options.immutableStorage && (GLEW_ARB_texture_storage || GLEW_VERSION_4_2);
+    if (immutable)
+        glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat, width, height);
+    else
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    vramBytes = 0;
+    vector<uint8_t> rgba;
+    vector<uint16_t> packed;
+    for (int level = 0; level < levelCount; level++)
     {
-        GLint infoLogLength = 0;
-        glGetShaderiv(vertexShaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
-        std::vector<char> vertexShaderErrorMessage(infoLogLength);
-        glGetShaderInfoLog(vertexShaderID, infoLogLength, NULL, &vertexShaderErrorMessage[0]);
-        // std::cerr << "Vertex shader compilation failed:\n" << &vertexShaderErrorMessage[0] << std::endl;
-        glDeleteShader(vertexShaderID);
-        glDeleteShader(fragmentShaderID);
-        return 0;
+        const unsigned char *blocks = levels + levelOffsets[level];
+        if (compressedFormat)
+        {
+            GLsizei size = (GLsizei)textureLevelBytes(blockFormat, width, height, 4);
+            if (immutable)
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, compressedFormat, size, blocks);
+            else
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedFormat, width, height, 0, size, blocks);
+            vramBytes += size;
+        }
+        else
+        {
+            decompressTextureLevel(blocks, width, height, blockFormat, rgba);
+            GLenum format = blockFormat == TEXTURE_BLOCK_BC1 ? GL_RGB : GL_RGBA;
+            GLenum type = blockFormat == TEXTURE_BLOCK_BC1 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE;
+            const void *data = rgba.data();
+            if (blockFormat == TEXTURE_BLOCK_BC1)
+            {
+                convertToRGB565(rgba, packed);
+                data = packed.data();
+            }
+            if (immutable)
+                glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, type, data);
+            else
+                glTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0, format, type, data);
+            vramBytes += (size_t)width * height * (blockFormat == TEXTURE_BLOCK_BC1 ? 2 : 4);
+        }
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
     }
-    // std::cout << "DEBUG: Vertex shader compiled successfully." << std::endl;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-    // std::cout << "DEBUG: Compiling fragment shader..." << std::endl;
-    glShaderSource(fragmentShaderID, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShaderID);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return textureID;
+}
 
-    // Check fragment shader for compilation errors
-    success = 0;
-    glGetShaderiv(fragmentShaderID, GL_COMPILE_STATUS, &success);
-    if (success == GL_FALSE)
+GLuint loadTexture(const char *filename, const TextureOptions &options)
+{
+    // load texture dimension data
+    int width, height, nrChannels;
+    unsigned char *data = stbi_load(filename, &width, &height, &nrChannels, 0);
+    if (!data)
     {
-        GLint infoLogLength = 0;
-        glGetShaderiv(fragmentShaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
-        std::vector<char> fragmentShaderErrorMessage(infoLogLength);
-        glGetShaderInfoLog(fragmentShaderID, infoLogLength, NULL, &fragmentShaderErrorMessage[0]);
-        // std::cerr << "Fragment shader compilation failed:\n" << &fragmentShaderErrorMessage[0] << std::endl;
-        glDeleteShader(vertexShaderID);
-        glDeleteShader(fragmentShaderID);
+        std::cerr << "ERROR::texture could not load texture file\n"
+                  << filename << std::endl;
         return 0;
     }
-    // std::cout << "DEBUG: Fragment shader compiled successfully." << std::endl;
 
-    // 2. Link the program
-    // std::cout << "DEBUG: Linking program..." << std::endl;
-    GLuint programID = glCreateProgram();
-    glAttachShader(programID, vertexShaderID);
-    glAttachShader(programID, fragmentShaderID);
-    glLinkProgram(programID);
+    GLuint textureID = uploadTexture(data, width, height, nrChannels, options);
 
-    // Check for linking errors
-    success = 0;
-    glGetProgramiv(programID, GL_LINK_STATUS, &success);
-    if (success == GL_FALSE)
+    // step 5 free resources
+    stbi_image_free(data);
+    return textureID;
+}
+
+// Loads a texture from an image file held in memory, such as one embedded in a model
+GLuint loadTextureFromMemory(const unsigned char *bytes, size_t size, const string &name, const TextureOptions &options = TextureOptions())
+{
+    int width, height, nrChannels;
+    unsigned char *data = stbi_load_from_memory(bytes, (int)size, &width, &height, &nrChannels, 0);
+    if (!data)
     {
-        GLint infoLogLength = 0;
-        glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
-        std::vector<char> programErrorMessage(infoLogLength);
-        glGetProgramInfoLog(programID, infoLogLength, NULL, &programErrorMessage[0]);
-        // std::cerr << "Shader program linking failed:\n" << &programErrorMessage[0] << std::endl;
-        glDeleteProgram(programID);
+        std::cerr << "ERROR::texture could not decode embedded texture\n"
+                  << name << std::endl;
         return 0;
     }
-
-    // 3. Clean up and return
-    glDetachShader(programID, vertexShaderID);
-    glDetachShader(programID, fragmentShaderID);
-    glDeleteShader(vertexShaderID);
-    glDeleteShader(fragmentShaderID);
-
-    return programID;
+    GLuint textureID = uploadTexture(data, width, height, nrChannels, options);
+    stbi_image_free(data);
+    return textureID;
 }
 
-void setProjectionMatrix(int shaderProgram, mat4 projectionMatrix)
+// An image decoded on a worker, pixels belong to stb_image (NULL when the file could not be decoded)
+struct DecodedTexture
 {
-    glUseProgram(shaderProgram);
-    GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-    glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
-}
+    unsigned char *pixels = NULL;
+    int width = 0;
+    int height = 0;
+    int nrChannels = 0;
+    double seconds = 0.0;     // spent reading and decoding the file
+    bool missing = false;     // the file could not be read
+    uint64_t contentHash = 0; // of the file's bytes, for the texture registry
+};
 
-void setViewMatrix(int shaderProgram, mat4 viewMatrix)
+// Reads and decodes an image file, safe to run on any thread
+DecodedTexture decodeTextureFile(const string &path)
 {
-    glUseProgram(shaderProgram);
-    GLuint viewMatrixLocation = glGetUniformLocation(shaderProgram, "viewMatrix");
-    glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
+    DecodedTexture decoded;
+    auto start = std::chrono::steady_clock::now();
+    vector<unsigned char> bytes;
+    decoded.missing = !readTextureFile(path, bytes);
+    if (!decoded.missing)
+    {
+        decoded.contentHash = hashTextureBytes(bytes.data(), bytes.size());
+        decoded.pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &decoded.width, &decoded.height, &decoded.nrChannels, 0);
+    }
+    decoded.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return decoded;
 }
 
-void setWorldMatrix(int shaderProgram, mat4 worldMatrix)
+// Staging buffers of the texture streamer, each reused once the GPU has read it
+const int TEXTURE_STREAM_BUFFERS = 3;
+const size_t TEXTURE_STREAM_BUFFER_BYTES = 4 * 1024 * 1024;
+
+// A texture whose pixels are still being copied to the GPU, rows at a time
+struct StreamingTexture
+{
+    string path;
+    GLuint texture;
+    DecodedTexture decoded;
+    int levelCount;
+    int rowsUploaded;
+    double requested; // glfwGetTime when streamTexture was called
+    int frames;       // frames that uploaded some of its rows
+};
+
+struct TextureStreamStats
+{
+    size_t textures = 0;
+    size_t bytes = 0;
+    size_t maxFrameBytes = 0;
+    size_t busyFrames = 0; // frames that left rows for later because the next staging buffer was still in use
+};
+
+// Uploads textures during a session without stalling the GL thread: files are decoded on a worker, and their
+// pixels go through a ring of pixel buffer objects, each glTexSubImage2D reading from one while the next is
+// filled. A fence per buffer tells when the GPU is done with it, and at most frameBudget bytes are staged per frame.
+struct TextureStreamer
+{
+    GLuint buffers[TEXTURE_STREAM_BUFFERS];
+    GLsync fences[TEXTURE_STREAM_BUFFERS];
+    int nextBuffer = 0;
+    size_t frameBudget = 0;
+    TextureOptions options;
+    AsyncLoadQueue<DecodedTexture> decoder;
+    vector<StreamingTexture> requests; // by decode id
+    std::deque<StreamingTexture> uploads;
+    TextureStreamStats stats;
+};
+
+void startTextureStreamer(TextureStreamer &streamer, size_t frameBudget, const TextureOptions &options)
+{
+    streamer.frameBudget = frameBudget;
+    streamer.options = options;
+    glGenBuffers(TEXTURE_STREAM_BUFFERS, streamer.buffers);
+    for (int i = 0; i < TEXTURE_STREAM_BUFFERS; i++)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, streamer.buffers[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_STREAM_BUFFER_BYTES, NULL, GL_STREAM_DRAW);
+        streamer.fences[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    startAsyncLoader(streamer.decoder, 1);
+}
+
+// Returns a texture for the image file at path right away; it is empty (samples black) until updateTextureStreamer
+// has decoded and uploaded it over the next frames
+GLuint streamTexture(TextureStreamer &streamer, const string &path)
+{
+    StreamingTexture request;
+    request.path = path;
+    glGenTextures(1, &request.texture);
+    request.levelCount = 0;
+    request.rowsUploaded = 0;
+    request.requested = glfwGetTime();
+    request.frames = 0;
+    streamer.requests.push_back(request);
+    submitAsyncLoad<DecodedTexture>(streamer.decoder, (int)streamer.requests.size() - 1, [path]()
+                                    { return decodeTextureFile(path); });
+    return request.texture;
+}
+
+// Allocates the storage of a decoded texture; sampling is limited to level 0 until its mips are generated
+void beginStreamingTexture(StreamingTexture &upload, const TextureOptions &options)
+{
+    const DecodedTexture &decoded = upload.decoded;
+    upload.levelCount = options.mipmaps ? mipLevelCount(decoded.width, decoded.height) : 1;
+    glBindTexture(GL_TEXTURE_2D, upload.texture);
+    applyTextureSampling(options, upload.levelCount);
+    if (!options.immutableStorage || !allocateTextureStorage(upload.levelCount, decoded.width, decoded.height, decoded.nrChannels))
+    {
+        for (int level = 0, w = decoded.width, h = decoded.height; level < upload.levelCount; level++, w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+        {
+            glTexImage2D(GL_TEXTURE_2D, level, textureInternalFormat(decoded.nrChannels), w, h, 0, textureFormat(decoded.nrChannels), GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+// Once per frame: starts the textures decoded since the last frame and stages up to frameBudget bytes of rows.
+// A staging buffer the GPU has not finished reading ends the frame's uploads instead of waiting for it.
+void updateTextureStreamer(TextureStreamer &streamer)
+{
+    int id;
+    DecodedTexture decoded;
+    while (popFinishedLoad(streamer.decoder, id, decoded))
+    {
+        StreamingTexture upload = streamer.requests[id];
+        upload.decoded = decoded;
+        if (!decoded.pixels)
+        {
+            std::cerr << "ERROR::texture could not load texture file\n"
+                      << upload.path << std::endl;
+            continue;
+        }
+        beginStreamingTexture(upload, streamer.options);
+        streamer.uploads.push_back(upload);
+    }
+
+    size_t frameBytes = 0;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    while (!streamer.uploads.empty() && frameBytes < streamer.frameBudget)
+    {
+        GLsync &fence = streamer.fences[streamer.nextBuffer];
+        if (fence)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                streamer.stats.busyFrames++;
+                break;
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+
+        // as many rows as the budget and the buffer take, and one row at least so every texture progresses
+        StreamingTexture &upload = streamer.uploads.front();
+        size_t rowBytes = (size_t)upload.decoded.width * upload.decoded.nrChannels;
+        size_t bytes = std::min(streamer.frameBudget - frameBytes, TEXTURE_STREAM_BUFFER_BYTES);
+        int rows = std::min(upload.decoded.height - upload.rowsUploaded, std::max(1, (int)(bytes / rowBytes)));
+        if ((size_t)rows * rowBytes > TEXTURE_STREAM_BUFFER_BYTES)
+        {
+            break; // a single row bigger than a staging buffer, only possible for absurdly wide images
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, streamer.buffers[streamer.nextBuffer]);
+        void *staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, rows * rowBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!staging)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            break;
+        }
+        memcpy(staging, upload.decoded.pixels + upload.rowsUploaded * rowBytes, rows * rowBytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindTexture(GL_TEXTURE_2D, upload.texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload.rowsUploaded, upload.decoded.width, rows, textureFormat(upload.decoded.nrChannels), GL_UNSIGNED_BYTE, (void *)0);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        streamer.nextBuffer = (streamer.nextBuffer + 1) % TEXTURE_STREAM_BUFFERS;
+
+        if (upload.frames == 0 || frameBytes == 0)
+        {
+            upload.frames++;
+        }
+        upload.rowsUploaded += rows;
+        frameBytes += rows * rowBytes;
+        if (upload.rowsUploaded == upload.decoded.height)
+        {
+            if (upload.levelCount > 1)
+            {
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, upload.levelCount - 1);
+            stbi_image_free(upload.decoded.pixels);
+            std::cout << upload.path << ": streamed in " << upload.frames << " frames, " << (glfwGetTime() - upload.requested) * 1000.0
+                      << " ms after it was requested (decoded in " << upload.decoded.seconds * 1000.0 << " ms)" << std::endl;
+            streamer.stats.textures++;
+            streamer.uploads.pop_front();
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    streamer.stats.bytes += frameBytes;
+    streamer.stats.maxFrameBytes = std::max(streamer.stats.maxFrameBytes, frameBytes);
+}
+
+// Drops what is still decoding or uploading and frees the staging buffers
+void stopTextureStreamer(TextureStreamer &streamer)
+{
+    stopAsyncLoader(streamer.decoder);
+    int id;
+    DecodedTexture decoded;
+    while (popFinishedLoad(streamer.decoder, id, decoded))
+    {
+        stbi_image_free(decoded.pixels);
+    }
+    for (size_t i = 0; i < streamer.uploads.size(); i++)
+    {
+        stbi_image_free(streamer.uploads[i].decoded.pixels);
+    }
+    streamer.uploads.clear();
+    for (int i = 0; i < TEXTURE_STREAM_BUFFERS; i++)
+    {
+        if (streamer.fences[i])
+            glDeleteSync(streamer.fences[i]);
+        streamer.fences[i] = 0;
+    }
+    glDeleteBuffers(TEXTURE_STREAM_BUFFERS, streamer.buffers);
+    if (streamer.stats.textures > 0)
+    {
+        std::cout << "Texture streaming: " << streamer.stats.textures << " textures, " << streamer.stats.bytes / (1024.0 * 1024.0) << " MB, at most "
+                  << streamer.stats.maxFrameBytes / 1024.0 << " KB in a frame (budget " << streamer.frameBudget / 1024.0 << " KB), "
+                  << streamer.stats.busyFrames << " frames waited on a staging buffer" << std::endl;
+    }
+}
+
+// Textures shared by every model and material, each file is loaded once
+struct TextureCache
+{
+    map<string, GLuint> textures; // key -> texture, 0 when the texture could not be loaded
+    TextureOptions options;       // For every texture the cache creates
+    TextureStreamer *streamer = NULL; // When set, texture files are streamed in over the next frames instead of loaded at once
+    TextureRegistry registry;         // Files by content, and the fallback of those missing
+};
+
+// The upload of the cache's registry
+struct CacheTextureUpload
+{
+    const TextureCache *cache;
+    GLuint operator()(const unsigned char *pixels, int width, int height, int nrChannels) const
+    {
+        return uploadTexture(pixels, width, height, nrChannels, cache->options);
+    }
+};
+
+// A texture stored inside a model file, copied out of the importer so it outlives it
+struct EmbeddedTexture
+{
+    string key;                  // "embedded:" and the hash of the bytes, so the same image in several files is shared
+    vector<unsigned char> bytes; // A compressed image file (png, jpg...), or RGBA pixels when width is set
+    int width = 0;
+    int height = 0;
+};
+
+// Returns the texture of key, a file path or an embedded texture's key, decoding and uploading it on first use
+GLuint loadCachedTexture(TextureCache &cache, const string &key, const EmbeddedTexture *embedded = NULL)
+{
+    map<string, GLuint>::iterator found = cache.textures.find(key);
+    if (found != cache.textures.end())
+    {
+        cache.registry.stats.requests++;
+        cache.registry.stats.pathHits++;
+        return found->second;
+    }
+    CacheTextureUpload upload = {&cache};
+    GLuint textureID;
+    vector<unsigned char> bytes;
+    if (embedded && embedded->width > 0)
+    {
+        textureID = uploadTexture(embedded->bytes.data(), embedded->width, embedded->height, 4, cache.options);
+    }
+    else if (embedded)
+    {
+        textureID = loadTextureFromMemory(embedded->bytes.data(), embedded->bytes.size(), key, cache.options);
+    }
+    else if (cache.streamer && readTextureFile(key, bytes))
+    {
+        // hashed before streaming, so the same file under another name shares the texture already loaded
+        uint64_t contentHash = hashTextureBytes(bytes.data(), bytes.size());
+        map<uint64_t, unsigned int>::iterator sameFile = cache.registry.byContent.find(contentHash);
+        cache.registry.stats.requests++;
+        if (sameFile != cache.registry.byContent.end())
+        {
+            cache.registry.stats.contentHits++;
+            textureID = sameFile->second;
+        }
+        else
+        {
+            cache.registry.stats.uploads++;
+            textureID = streamTexture(*cache.streamer, key);
+        }
+        addRegisteredTexture(cache.registry, key, contentHash, textureID);
+    }
+    else
+    {
+        textureID = acquireTexture(cache.registry, key, upload); // a missing file gets the fallback
+    }
+    cache.textures[key] = textureID; // so a missing file is only reported once
+    return textureID;
+}
+
+// Loads every key not in the cache yet: the image files are decoded concurrently on up to threadCount workers
+// (0 uses every core) while this thread uploads each one as soon as it is decoded, so only glTex* calls run here.
+// Prints the decode time of each texture and the wall-clock time saved against decoding them one after the other.
+void loadCachedTextures(TextureCache &cache, const vector<string> &keys, int threadCount = 0)
+{
+    vector<string> pending;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (cache.textures.find(keys[i]) == cache.textures.end() && std::find(pending.begin(), pending.end(), keys[i]) == pending.end())
+        {
+            pending.push_back(keys[i]);
+        }
+    }
+    if (pending.empty())
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    AsyncLoadQueue<DecodedTexture> decoder;
+    startAsyncLoader(decoder, std::min(threadCount, (int)pending.size()));
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        string path = pending[i];
+        submitAsyncLoad<DecodedTexture>(decoder, (int)i, [path]()
+                                        { return decodeTextureFile(path); });
+    }
+
+    size_t uploaded = 0;
+    double decodeSeconds = 0.0, uploadSeconds = 0.0;
+    while (uploaded < pending.size())
+    {
+        int id;
+        DecodedTexture decoded;
+        if (!popFinishedLoad(decoder, id, decoded))
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        uploaded++;
+        decodeSeconds += decoded.seconds;
+        TextureRegistry &registry = cache.registry;
+        registry.stats.requests++;
+        if (!decoded.pixels)
+        {
+            std::cerr << pending[id] << (decoded.missing ? ": texture file missing" : ": texture could not be decoded") << ", using the fallback texture" << std::endl;
+            registry.stats.missing++;
+            cache.textures[pending[id]] = textureFallback(registry, CacheTextureUpload{&cache});
+            continue;
+        }
+        // another key of the batch, or an earlier load, may have had the same file
+        map<uint64_t, unsigned int>::iterator sameFile = registry.byContent.find(decoded.contentHash);
+        if (sameFile != registry.byContent.end())
+        {
+            registry.stats.contentHits++;
+            cache.textures[pending[id]] = sameFile->second;
+            stbi_image_free(decoded.pixels);
+            continue;
+        }
+        auto uploadStart = std::chrono::steady_clock::now();
+        GLuint textureID = uploadTexture(decoded.pixels, decoded.width, decoded.height, decoded.nrChannels, cache.options);
+        uploadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - uploadStart).count();
+        registry.stats.uploads++;
+        registry.stats.decodeSeconds += decoded.seconds;
+        addRegisteredTexture(registry, pending[id], decoded.contentHash, textureID);
+        cache.textures[pending[id]] = textureID;
+        stbi_image_free(decoded.pixels);
+        std::cout << pending[id] << ": decoded in " << decoded.seconds * 1000.0 << " ms" << std::endl;
+    }
+    stopAsyncLoader(decoder);
+
+    // one after the other, every decode and upload would have run on this thread
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << pending.size() << " textures decoded on " << std::min(threadCount, (int)pending.size()) << " threads and uploaded in " << seconds * 1000.0
+              << " ms (decoding " << decodeSeconds * 1000.0 << " ms, uploading " << uploadSeconds * 1000.0 << " ms), "
+              << (decodeSeconds + uploadSeconds - seconds) * 1000.0 << " ms saved over decoding them in turn" << std::endl;
+}
+
+// Frames a texture may go unused before the residency manager may evict it
+const int RESIDENCY_COLD_FRAMES = 120;
+
+// Bounding sphere of the unit primitives (cube, prism, tetra, pyramid) in model space, for their size on screen
+const float PRIMITIVE_RADIUS = 0.87f;
+
+// A texture the residency manager may shrink, by dropping the top levels of its mip chain, and grow back
+struct ResidentTexture
+{
+    string key; // image file it is reloaded from
+    int width;  // of level 0 of the full chain
+    int height;
+    int nrChannels;
+    int levelCount;      // of the full chain
+    int topLevel;        // first level of the full chain on the GPU, levelCount - 1 when only the 1x1 average is left
+    int requiredLevel;   // finest level a draw of the last frame it was used in needs, from its size on screen
+    size_t bytes;        // on the GPU
+    uint64_t lastUsed;   // frame
+    bool loading;        // a reload is decoding on the worker
+    int loadingLevel;    // first level of that reload, counted as used until it lands
+    bool pinned;         // only counted: immutable or compressed storage, or no file to reload from
+    unsigned char average[4];
+};
+
+// Chain of a texture decoded again on the worker, to replace the levels on the GPU from topLevel down
+struct ResidencyLoad
+{
+    GLuint texture = 0;
+    int topLevel = 0;
+    bool failed = true;
+    vector<uint8_t> chain;
+    uint64_t levelOffsets[BUNDLE_MAX_LEVELS];
+};
+
+struct ResidencyStats
+{
+    size_t evictions = 0;
+    size_t trims = 0;   // top levels dropped from a texture still in use
+    size_t reloads = 0; // levels streamed back in because a draw needed them
+    size_t peakBytes = 0;
+};
+
+// Keeps the textures of the cache within budget bytes of VRAM (--texture-budget). Draws report the textures
+// they use and their size on screen with touchResidentTexture; once a frame updateTextureResidency brings them
+// back within budget when they are over it, by evicting the textures unused for the longest and then trimming
+// the levels finer than their draws need from what is already on the GPU, and reloads the levels that are
+// needed but missing, freeing room for them the same way. Textures with immutable storage, block
+// compressed ones and those not loaded from a file are left alone and only counted.
+struct TextureResidency
+{
+    size_t budget = 0; // 0 turns the manager off
+    float viewportHeight = 600.0f;
+    uint64_t frame = 0;
+    TextureCache *cache = NULL;
+    size_t registeredKeys = 0;           // cache entries looked at so far
+    map<GLuint, ResidentTexture> textures;
+    size_t pinnedBytes = 0;              // textures the manager cannot resize
+    AsyncLoadQueue<ResidencyLoad> loader;
+    ResidencyStats stats;
+};
+
+void startTextureResidency(TextureResidency &residency, TextureCache &cache, size_t budget, float viewportHeight)
+{
+    residency.budget = budget;
+    residency.cache = &cache;
+    residency.viewportHeight = viewportHeight;
+    startAsyncLoader(residency.loader, 1);
+}
+
+// Bytes of levels first..levelCount - 1 of a chain, or of level first only without mips
+size_t residentBytes(const ResidentTexture &texture, int first, bool mipmaps)
+{
+    size_t bytes = 0;
+    int last = mipmaps ? texture.levelCount - 1 : first;
+    for (int level = first; level <= last; level++)
+    {
+        bytes += textureLevelBytes(TEXTURE_BLOCK_NONE, std::max(texture.width >> level, 1), std::max(texture.height >> level, 1), texture.nrChannels);
+    }
+    return bytes;
+}
+
+// Starts managing the cache's textures it has not seen yet: those loaded from a file with mutable, uncompressed storage
+void registerResidentTextures(TextureResidency &residency)
+{
+    TextureCache &cache = *residency.cache;
+    if (cache.textures.size() == residency.registeredKeys)
+    {
+        return;
+    }
+    residency.registeredKeys = cache.textures.size();
+    for (map<string, GLuint>::const_iterator it = cache.textures.begin(); it != cache.textures.end(); ++it)
+    {
+        GLuint id = it->second;
+        if (id == 0 || residency.textures.count(id))
+        {
+            continue;
+        }
+        bool streaming = false;
+        for (size_t i = 0; cache.streamer && i < cache.streamer->uploads.size(); i++)
+            streaming = streaming || cache.streamer->uploads[i].texture == id;
+        GLint width = 0, height = 0, compressed = GL_FALSE, immutable = GL_FALSE;
+        glBindTexture(GL_TEXTURE_2D, id);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        if (streaming || width == 0)
+        {
+            residency.registeredKeys--; // not uploaded yet, looked at again next frame
+            continue;
+        }
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+        FILE *source = it->first.compare(0, 9, "embedded:") == 0 ? NULL : fopen(it->first.c_str(), "rb");
+        ResidentTexture texture;
+        texture.key = it->first;
+        texture.width = width;
+        texture.height = height;
+        GLint internalFormat;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        texture.nrChannels = internalFormat == GL_R8 ? 1 : internalFormat == GL_RGB8 ? 3 : 4;
+        texture.levelCount = mipLevelCount(width, height);
+        texture.topLevel = 0;
+        texture.requiredLevel = 0;
+        texture.bytes = residentBytes(texture, 0, cache.options.mipmaps);
+        texture.lastUsed = residency.frame;
+        texture.loading = false;
+        texture.loadingLevel = 0;
+        texture.pinned = !source || compressed || immutable;
+        if (source)
+            fclose(source);
+        if (texture.pinned)
+        {
+            residency.pinnedBytes += texture.bytes;
+            residency.textures[id] = texture;
+            continue;
+        }
+        // what is left of an evicted texture
+        texture.average[0] = texture.average[1] = texture.average[2] = 128;
+        texture.average[3] = 255;
+        if (cache.options.mipmaps)
+        {
+            glGetTexImage(GL_TEXTURE_2D, texture.levelCount - 1, GL_RGBA, GL_UNSIGNED_BYTE, texture.average);
+        }
+        residency.textures[id] = texture;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Records that texture is drawn this frame at screenSize (a fraction of the viewport height, see projectedScreenSize)
+void touchResidentTexture(TextureResidency &residency, GLuint texture, float screenSize)
+{
+    map<GLuint, ResidentTexture>::iterator found = residency.textures.find(texture);
+    if (residency.budget == 0 || found == residency.textures.end() || found->second.pinned)
+    {
+        return;
+    }
+    // one texel per pixel across the object is enough
+    ResidentTexture &resident = found->second;
+    float pixels = std::max(screenSize * residency.viewportHeight, 1.0f);
+    int required = std::max(0, std::min(resident.levelCount - 1, (int)std::floor(std::log2(std::max(resident.width, resident.height) / pixels))));
+    resident.requiredLevel = resident.lastUsed == residency.frame ? std::min(resident.requiredLevel, required) : required;
+    resident.lastUsed = residency.frame;
+}
+
+// Replaces the levels of the bound texture with levels first.. of chain (first only without mips)
+void specifyResidentLevels(ResidentTexture &resident, const uint8_t *chain, const uint64_t *levelOffsets, int first, bool mipmaps)
+{
+    int last = mipmaps ? resident.levelCount - 1 : first;
+    GLenum format = textureFormat(resident.nrChannels);
+    GLenum internalFormat = textureInternalFormat(resident.nrChannels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = first; level <= last; level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level - first, internalFormat, std::max(resident.width >> level, 1), std::max(resident.height >> level, 1), 0, format, GL_UNSIGNED_BYTE,
+                     chain ? chain + levelOffsets[level] : resident.average);
+    }
+    // levels past the new chain are emptied so their memory goes back
+    for (int level = last - first + 1; level < resident.levelCount; level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, 0, 0, 0, format, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last - first);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    resident.topLevel = first;
+    resident.bytes = residentBytes(resident, first, mipmaps);
+}
+
+// Decodes resident's file again on the worker, to upload its chain from topLevel down
+void requestResidentLevels(TextureResidency &residency, GLuint id, ResidentTexture &resident, int topLevel)
+{
+    resident.loading = true;
+    resident.loadingLevel = topLevel;
+    string key = resident.key;
+    int width = resident.width, height = resident.height, nrChannels = resident.nrChannels;
+    submitAsyncLoad<ResidencyLoad>(residency.loader, (int)id, [key, id, topLevel, width, height, nrChannels]()
+                                   {
+        ResidencyLoad load;
+        load.texture = id;
+        load.topLevel = topLevel;
+        DecodedTexture decoded = decodeTextureFile(key);
+        load.failed = !decoded.pixels || decoded.width != width || decoded.height != height || decoded.nrChannels != nrChannels;
+        if (!load.failed)
+            buildMipChain(decoded.pixels, width, height, nrChannels, load.chain, load.levelOffsets);
+        stbi_image_free(decoded.pixels);
+        return load; });
+}
+
+// Drops the levels of the bound texture above first, rebuilding its chain from the levels already on the GPU
+void trimResidentLevels(ResidentTexture &resident, int first, bool mipmaps)
+{
+    // without mips only the top level is there, so the coarser ones are filtered down from it
+    int base = mipmaps ? first : resident.topLevel;
+    int width = std::max(resident.width >> base, 1), height = std::max(resident.height >> base, 1);
+    vector<uint8_t> pixels((size_t)width * height * resident.nrChannels), chain;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, base - resident.topLevel, textureFormat(resident.nrChannels), GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    uint64_t chainOffsets[BUNDLE_MAX_LEVELS], levelOffsets[BUNDLE_MAX_LEVELS];
+    int built = buildMipChain(pixels.data(), width, height, resident.nrChannels, chain, chainOffsets);
+    for (int level = base; level < resident.levelCount && level - base < built; level++)
+    {
+        levelOffsets[level] = chainOffsets[level - base];
+    }
+    specifyResidentLevels(resident, chain.data(), levelOffsets, first, mipmaps);
+}
+
+// Evicts the textures unused the longest, then trims the ones holding finer levels than their draws need, until
+// wanted more bytes fit in the budget; keep is left alone. Returns the bytes used after
+size_t freeResidentBytes(TextureResidency &residency, const vector<GLuint> &coldest, size_t used, size_t wanted, GLuint keep, bool mipmaps)
+{
+    for (size_t c = 0; c < coldest.size() && used + wanted > residency.budget; c++)
+    {
+        ResidentTexture &cold = residency.textures[coldest[c]];
+        if (coldest[c] == keep || cold.loading || cold.topLevel == cold.levelCount - 1 || residency.frame - cold.lastUsed < RESIDENCY_COLD_FRAMES)
+        {
+            continue;
+        }
+        size_t before = cold.bytes;
+        glBindTexture(GL_TEXTURE_2D, coldest[c]);
+        specifyResidentLevels(cold, NULL, NULL, cold.levelCount - 1, false);
+        used -= before - cold.bytes;
+        residency.stats.evictions++;
+    }
+    for (size_t c = 0; c < coldest.size() && used + wanted > residency.budget; c++)
+    {
+        ResidentTexture &fine = residency.textures[coldest[c]];
+        if (coldest[c] == keep || fine.loading || fine.topLevel >= fine.requiredLevel)
+        {
+            continue;
+        }
+        size_t before = fine.bytes;
+        glBindTexture(GL_TEXTURE_2D, coldest[c]);
+        trimResidentLevels(fine, fine.requiredLevel, mipmaps);
+        used -= before - fine.bytes;
+        residency.stats.trims++;
+    }
+    return used;
+}
+
+// Once per frame, after the draws that touched their textures
+void updateTextureResidency(TextureResidency &residency)
+{
+    if (residency.budget == 0)
+    {
+        return;
+    }
+    registerResidentTextures(residency);
+    bool mipmaps = residency.cache->options.mipmaps;
+
+    // one finished reload per frame, so a large texture never lands in the same frame as another
+    int id;
+    ResidencyLoad load;
+    if (popFinishedLoad(residency.loader, id, load))
+    {
+        ResidentTexture &resident = residency.textures[load.texture];
+        resident.loading = false;
+        if (!load.failed)
+        {
+            glBindTexture(GL_TEXTURE_2D, load.texture);
+            specifyResidentLevels(resident, load.chain.data(), load.levelOffsets, load.topLevel, mipmaps);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+
+    size_t used = residency.pinnedBytes;
+    vector<GLuint> coldest;
+    for (map<GLuint, ResidentTexture>::iterator it = residency.textures.begin(); it != residency.textures.end(); ++it)
+    {
+        const ResidentTexture &resident = it->second;
+        if (!resident.pinned)
+        {
+            used += resident.loading ? std::max(resident.bytes, residentBytes(resident, resident.loadingLevel, mipmaps)) : resident.bytes;
+            coldest.push_back(it->first);
+        }
+    }
+    std::sort(coldest.begin(), coldest.end(), [&residency](GLuint a, GLuint b)
+              { return residency.textures[a].lastUsed < residency.textures[b].lastUsed; });
+
+    residency.stats.peakBytes = std::max(residency.stats.peakBytes, used);
+
+    // back within budget every frame it is over, whether from textures registered or reloads landed
+    used = freeResidentBytes(residency, coldest, used, 0, 0, mipmaps);
+
+    // levels a draw needs, freeing room for them the same way
+    for (size_t i = 0; i < coldest.size(); i++)
+    {
+        ResidentTexture &resident = residency.textures[coldest[i]];
+        if (resident.lastUsed != residency.frame || resident.loading || resident.requiredLevel >= resident.topLevel)
+        {
+            continue;
+        }
+        size_t growth = residentBytes(resident, resident.requiredLevel, mipmaps) - resident.bytes;
+        used = freeResidentBytes(residency, coldest, used, growth, coldest[i], mipmaps);
+        // what still does not fit is loaded as fine as the budget allows
+        int level = resident.requiredLevel;
+        while (level < resident.topLevel && used + residentBytes(resident, level, mipmaps) - resident.bytes > residency.budget)
+        {
+            level++;
+        }
+        if (level < resident.topLevel)
+        {
+            used += residentBytes(resident, level, mipmaps) - resident.bytes;
+            requestResidentLevels(residency, coldest[i], resident, level);
+            residency.stats.reloads++;
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    residency.stats.peakBytes = std::max(residency.stats.peakBytes, used);
+    residency.frame++;
+}
+
+void printTextureResidency(const TextureResidency &residency)
+{
+    size_t used = residency.pinnedBytes, managed = 0;
+    for (map<GLuint, ResidentTexture>::const_iterator it = residency.textures.begin(); it != residency.textures.end(); ++it)
+    {
+        if (!it->second.pinned)
+        {
+            used += it->second.bytes;
+            managed++;
+        }
+    }
+    std::cout << "Texture residency: " << used / (1024.0 * 1024.0) << " MB of a " << residency.budget / (1024.0 * 1024.0) << " MB budget (peak "
+              << residency.stats.peakBytes / (1024.0 * 1024.0) << " MB, " << residency.pinnedBytes / (1024.0 * 1024.0) << " MB pinned), " << managed
+              << " textures managed, " << residency.stats.evictions << " evictions, " << residency.stats.trims << " trims, " << residency.stats.reloads << " reloads" << std::endl;
+}
+
+// Where a texture lives in a MaterialTextureArray
+struct MaterialTexture
+{
+    int layer;
+    vec4 rect; // uv offset in xy and scale in zw inside the layer, (0, 0, 1, 1) for a layer of its own
+};
+
+// The material textures packed into one GL_TEXTURE_2D_ARRAY (--texture-array), bound once on unit 1 so draws
+// only switch a layer uniform instead of binding a texture
+struct MaterialTextureArray
+{
+    GLuint texture = 0;                   // 0 when textures are bound one by one
+    map<GLuint, MaterialTexture> entries; // 2D texture -> its place in the array
+};
+
+// Packs every texture of the cache into an array, same-sized ones a layer each and the others into atlas layers
+// (see layoutTextureArray). Level 0 of each is read back from the GPU, so bundled and block-compressed textures
+// are packed like the rest. The 2D textures are kept for the draws of textures loaded afterwards.
+MaterialTextureArray buildMaterialTextureArray(const TextureCache &cache)
+{
+    MaterialTextureArray materials;
+    vector<GLuint> sources;
+    vector<ivec2> sizes;
+    for (map<string, GLuint>::const_iterator it = cache.textures.begin(); it != cache.textures.end(); ++it)
+    {
+        if (it->second == 0 || std::find(sources.begin(), sources.end(), it->second) != sources.end())
+        {
+            continue;
+        }
+        GLint width, height;
+        glBindTexture(GL_TEXTURE_2D, it->second);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        sources.push_back(it->second);
+        sizes.push_back(ivec2(width, height));
+    }
+    if (sources.empty())
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return materials;
+    }
+
+    AtlasLayout layout = layoutTextureArray(sizes);
+    size_t layerBytes = (size_t)layout.layerSize.x * layout.layerSize.y * 4;
+    vector<uint8_t> layers(layerBytes * layout.layerCount, 0);
+    vector<uint8_t> pixels, resized;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        pixels.resize((size_t)sizes[i].x * sizes[i].y * 4);
+        glBindTexture(GL_TEXTURE_2D, sources[i]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        const AtlasPlacement &placement = layout.placements[i];
+        const uint8_t *stored = pixels.data();
+        if (placement.width != sizes[i].x || placement.height != sizes[i].y)
+        {
+            resizeRGBA(pixels.data(), sizes[i].x, sizes[i].y, placement.width, placement.height, resized);
+            stored = resized.data();
+        }
+        blitAtlasPlacement(stored, placement, layout.layerSize, layers.data() + layerBytes * placement.layer);
+        MaterialTexture entry = {placement.layer, atlasRect(layout, placement)};
+        materials.entries[sources[i]] = entry;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenTextures(1, &materials.texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, materials.texture);
+    int levelCount = cache.options.mipmaps ? mipLevelCount(layout.layerSize.x, layout.layerSize.y) : 1;
+    applyTextureSampling(cache.options, levelCount, GL_TEXTURE_2D_ARRAY);
+    if (GLEW_ARB_texture_storage || GLEW_VERSION_4_2)
+    {
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, GL_RGBA8, layout.layerSize.x, layout.layerSize.y, layout.layerCount);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, layout.layerSize.x, layout.layerSize.y, layout.layerCount, GL_RGBA, GL_UNSIGNED_BYTE, layers.data());
+    }
+    else
+    {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layout.layerSize.x, layout.layerSize.y, layout.layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, layers.data());
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    }
+    if (levelCount > 1)
+    {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    std::cout << "Texture array: " << sources.size() << " textures in " << layout.layerCount << " layers of " << layout.layerSize.x << "x" << layout.layerSize.y
+              << " (" << layout.fullLayers << " of their own, " << layout.layerCount - layout.fullLayers << " atlas), "
+              << layerBytes * layout.layerCount / (1024.0 * 1024.0) << " MB at level 0" << std::endl;
+    return materials;
+}
+
+const char *getVertexShaderSource()
+{
+    return "#version 330 core\n"
+           "layout (location = 0) in vec3 aPos;\n"
+           "layout (location = 1) in vec3 aNormal;\n"
+           "layout (location = 2) in vec2 aUV;\n"
+           "layout (location = 3) in uvec4 aBones;\n"  // Skinned models: palette indices
+           "layout (location = 4) in vec4 aWeights;\n" // and their weights, summing to 1
+
+           "\n"
+           "out vec3 vertexNormal;\n"
+           "out vec2 vertexUV;\n"
+           "out vec3 worldPos;\n" // Added for spotlight calculations
+           "\n"
+           "uniform mat4 worldMatrix;\n"
+           "uniform mat4 viewMatrix;\n"
+           "uniform mat4 projectionMatrix;\n"
+           "uniform vec3 positionOffset = vec3(0.0);\n" // Compact vertices: aPos is in [0, 1] over the mesh AABB
+           "uniform vec3 positionScale = vec3(1.0);\n"
+           "uniform bool octahedralNormals = false;\n" // Compact vertices: aNormal.xy is octahedral encoded
+           "uniform bool skinned = false;\n"
+           "uniform mat4 bonePalette[48];\n" // SKIN_MAX_BONES
+           "\n"
+           "vec3 decodeOctahedral(vec2 e)\n"
+           "{\n"
+           "   vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+           "   if (n.z < 0.0)\n"
+           "       n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+           "   return normalize(n);\n"
+           "}\n"
+           "\n"
+           "void main()\n"
+           "{\n"
+           "   vec3 position = aPos * positionScale + positionOffset;\n"
+           "   vec3 normal = octahedralNormals ? decodeOctahedral(aNormal.xy) : aNormal;\n"
+           "   if (skinned)\n"
+           "   {\n"
+           "       mat4 skin = aWeights.x * bonePalette[aBones.x] + aWeights.y * bonePalette[aBones.y] +\n"
+           "                   aWeights.z * bonePalette[aBones.z] + aWeights.w * bonePalette[aBones.w];\n"
+           "       position = vec3(skin * vec4(position, 1.0));\n"
+           "       normal = mat3(skin) * normal;\n"
+           "   }\n"
+           "   vertexUV = aUV;\n"
+           "   vertexNormal = mat3(transpose(inverse(worldMatrix))) * normal;\n"
+           "   worldPos = vec3(worldMatrix * vec4(position, 1.0));\n" // Added world position
+           "   mat4 modelViewProjection = projectionMatrix * viewMatrix * worldMatrix;\n"
+           "   gl_Position = modelViewProjection * vec4(position, 1.0);\n"
+           "}";
+}
+
+const char *getFragmentShaderSource()
+{
+    return "#version 330 core\n"
+           "in vec3 vertexColor;\n"
+           "in vec2 vertexUV;\n"
+           "in vec3 vertexNormal;\n"
+           "in vec3 worldPos;\n"
+           "uniform sampler2D textureSampler;\n"
+           "uniform sampler2DArray textureArraySampler;\n" // --texture-array: every material texture, on unit 1
+           "uniform bool useTexture;\n"
+           "uniform bool useTextureArray = false;\n"
+           "uniform float textureLayer;\n"
+           "uniform vec4 layerRect = vec4(0.0, 0.0, 1.0, 1.0);\n" // Atlas layers: uv offset and scale of the texture's rectangle
+           "uniform vec3 objectColor;\n"
+           "uniform vec3 materialColor = vec3(1.0);\n" // Kd of an .mtl material, tints its texture
+           "uniform vec3 spotlightPos[3];\n" // Multiple spotlight uniforms - using explicit array size
+           "uniform vec3 spotlightDir[3];\n"
+           "uniform float spotlightCutoff[3];\n"
+           "uniform float spotlightOuterCutoff[3];\n"
+           "uniform vec3 spotlightColor[3];\n"
+           "uniform float spotlightIntensity[3];\n"
+           "\n"
+           "out vec4 FragColor;\n"
+           "float calculateSpotlight(vec3 lightPos, vec3 lightDir, float cutoff, float outerCutoff, vec3 fragPos)\n"
+           "{\n"
+           "    vec3 lightToFrag = normalize(fragPos - lightPos);\n"
+           "    float theta = dot(lightToFrag, normalize(lightDir));\n"
+           "    float epsilon = cutoff - outerCutoff;\n"
+           "    float intensity = clamp((theta - outerCutoff) / epsilon, 0.0, 1.0);\n"
+           "    return intensity;\n"
+           "}\n"
+           "void main()\n"
+           "{\n"
+           "   vec3 totalLightContribution = vec3(0.0);\n" // Calculate combined lighting from all 3 spotlights
+           "   \n"
+           "   for(int i = 0; i < 3; i++) {\n" // Process each spotlight individually (unrolled loop for better compatibility)
+           "       float spotIntensity = calculateSpotlight(spotlightPos[i], spotlightDir[i], spotlightCutoff[i], spotlightOuterCutoff[i], worldPos);\n"
+           "       \n"
+           "       vec3 normal = normalize(vertexNormal);\n"
+           "       vec3 lightDirection = normalize(spotlightPos[i] - worldPos);\n"
+           "       float diffuse = max(dot(normal, lightDirection), 0.0);\n"
+           "       \n"
+           "       float lightFactor = spotIntensity * diffuse * spotlightIntensity[i];\n"
+           "       totalLightContribution += spotlightColor[i] * lightFactor;\n"
+           "   }\n"
+           "   \n"
+           "   vec3 ambient = vec3(0.4);\n" // Higher ambient lighting so models are always visible
+           "   \n"
+           "   if (useTexture) {\n"
+           "       vec4 textureColor;\n"
+           "       if (useTextureArray) {\n"
+           "           vec2 layerUV = layerRect.zw == vec2(1.0) ? vertexUV : layerRect.xy + fract(vertexUV) * layerRect.zw;\n" // an atlas rectangle repeats with fract,
+           "           textureColor = textureGrad(textureArraySampler, vec3(layerUV, textureLayer), dFdx(vertexUV) * layerRect.zw, dFdy(vertexUV) * layerRect.zw);\n" // the gradients of the unwrapped uv keep mips continuous
+           "       } else {\n"
+           "           textureColor = texture(textureSampler, vertexUV);\n"
+           "       }\n"
+           "       FragColor = textureColor * vec4(materialColor * (ambient + totalLightContribution), 1.0);\n"
+           "   } else {\n"
+           "       float beam = sin(vertexUV.x * 10.0);\n" // Enhanced beam effect with better base color
+           "       beam = beam * 0.5 + 0.5;\n"
+           "       \n"
+           "       vec3 baseColor = max(objectColor, vec3(0.6)) * 2.3;\n"                     // Boost the objectColor to make it more visible and add beam multiplier
+           "       vec3 beamColor = baseColor * (beam * 0.7 + 0.8);\n"                        // Ensure minimum brightness
+           "       vec3 finalColor = beamColor * (ambient + totalLightContribution * 1.2);\n" // Beam effect with higher base
+           "       \n"
+           "       FragColor = vec4(finalColor, 1.0);\n"
+           "   }\n"
+           "}";
+}
+
+const char *getTexturedVertexShaderSource()
+{
+    return getVertexShaderSource(); // TODO: Replace this with the actual textured vertex shader
+}
+
+const char *getTexturedFragmentShaderSource()
+{
+    return getFragmentShaderSource(); // TODO: Replace this with the actual textured fragment shader
+}
+
+GLuint compileAndLinkShaders(const char *vertexShaderSource, const char *fragmentShaderSource)
+{
+    // 1. Create the shaders
+    GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
+    // std::cout << "DEBUG: Compiling vertex shader..." << std::endl;
+    glShaderSource(vertexShaderID, 1, &vertexShaderSource, NULL);
+    glCompileShader(vertexShaderID);
+
+    // Check vertex shader for compilation errors
+    GLint success = 0;
+    glGetShaderiv(vertexShaderID, GL_COMPILE_STATUS, &success);
+    if (success == GL_FALSE)
+    {
+        GLint infoLogLength = 0;
+        glGetShaderiv(vertexShaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
+        std::vector<char> vertexShaderErrorMessage(infoLogLength);
+        glGetShaderInfoLog(vertexShaderID, infoLogLength, NULL, &vertexShaderErrorMessage[0]);
+        // std::cerr << "Vertex shader compilation failed:\n" << &vertexShaderErrorMessage[0] << std::endl;
+        glDeleteShader(vertexShaderID);
+        glDeleteShader(fragmentShaderID);
+        return 0;
+    }
+    // std::cout << "DEBUG: Vertex shader compiled successfully." << std::endl;
+
+    // std::cout << "DEBUG: Compiling fragment shader..." << std::endl;
+    glShaderSource(fragmentShaderID, 1, &fragmentShaderSource, NULL);
+    glCompileShader(fragmentShaderID);
+
+    // Check fragment shader for compilation errors
+    success = 0;
+    glGetShaderiv(fragmentShaderID, GL_COMPILE_STATUS, &success);
+    if (success == GL_FALSE)
+    {
+        GLint infoLogLength = 0;
+        glGetShaderiv(fragmentShaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
+        std::vector<char> fragmentShaderErrorMessage(infoLogLength);
+        glGetShaderInfoLog(fragmentShaderID, infoLogLength, NULL, &fragmentShaderErrorMessage[0]);
+        // std::cerr << "Fragment shader compilation failed:\n" << &fragmentShaderErrorMessage[0] << std::endl;
+        glDeleteShader(vertexShaderID);
+        glDeleteShader(fragmentShaderID);
+        return 0;
+    }
+    // std::cout << "DEBUG: Fragment shader compiled successfully." << std::endl;
+
+    // 2. Link the program
+    // std::cout << "DEBUG: Linking program..." << std::endl;
+    GLuint programID = glCreateProgram();
+    glAttachShader(programID, vertexShaderID);
+    glAttachShader(programID, fragmentShaderID);
+    glLinkProgram(programID);
+
+    // Check for linking errors
+    success = 0;
+    glGetProgramiv(programID, GL_LINK_STATUS, &success);
+    if (success == GL_FALSE)
+    {
+        GLint infoLogLength = 0;
+        glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
+        std::vector<char> programErrorMessage(infoLogLength);
+        glGetProgramInfoLog(programID, infoLogLength, NULL, &programErrorMessage[0]);
+        // std::cerr << "Shader program linking failed:\n" << &programErrorMessage[0] << std::endl;
+        glDeleteProgram(programID);
+        return 0;
+    }
+
+    // 3. Clean up and return
+    glDetachShader(programID, vertexShaderID);
+    glDetachShader(programID, fragmentShaderID);
+    glDeleteShader(vertexShaderID);
+    glDeleteShader(fragmentShaderID);
+
+    return programID;
+}
+
+void setProjectionMatrix(int shaderProgram, mat4 projectionMatrix)
+{
+    glUseProgram(shaderProgram);
+    GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
+    glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
+}
+
+void setViewMatrix(int shaderProgram, mat4 viewMatrix)
+{
+    glUseProgram(shaderProgram);
+    GLuint viewMatrixLocation = glGetUniformLocation(shaderProgram, "viewMatrix");
+    glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
+}
+
+void setWorldMatrix(int shaderProgram, mat4 worldMatrix)
+{
+    glUseProgram(shaderProgram);
+    GLuint worldMatrixLocation = glGetUniformLocation(shaderProgram, "worldMatrix");
+    glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
+}
+
+// Sets the uniforms the vertex shader needs to decode the vertex format of the next draw
+void setVertexDecode(int shaderProgram, const VertexDecode &decode)
+{
+    glUseProgram(shaderProgram);
+    glUniform3fv(glGetUniformLocation(shaderProgram, "positionOffset"), 1, &decode.positionOffset[0]);
+    glUniform3fv(glGetUniformLocation(shaderProgram, "positionScale"), 1, &decode.positionScale[0]);
+    glUniform1i(glGetUniformLocation(shaderProgram, "octahedralNormals"), decode.octahedralNormals);
+}
+// Spotlight Track multiple objects
+void setMultipleSpotlightUniforms(int program, vec3 lightPositions[3], vec3 lightDirections[3], vec3 lightColors[3], float intensities[3])
+{
+    glUseProgram(program);
+
+    for (int i = 0; i < 3; i++)
+    {
+        string posName = "spotlightPos[" + to_string(i) + "]";
+        string dirName = "spotlightDir[" + to_string(i) + "]";
+        string colorName = "spotlightColor[" + to_string(i) + "]";
+        string intensityName = "spotlightIntensity[" + to_string(i) + "]";
+        string cutoffName = "spotlightCutoff[" + to_string(i) + "]";
+        string outerCutoffName = "spotlightOuterCutoff[" + to_string(i) + "]";
+
+        GLint posLoc = glGetUniformLocation(program, posName.c_str());
+        GLint dirLoc = glGetUniformLocation(program, dirName.c_str());
+        GLint colorLoc = glGetUniformLocation(program, colorName.c_str());
+        GLint intensityLoc = glGetUniformLocation(program, intensityName.c_str());
+        GLint cutoffLoc = glGetUniformLocation(program, cutoffName.c_str());
+        GLint outerCutoffLoc = glGetUniformLocation(program, outerCutoffName.c_str());
+
+        if (posLoc >= 0)
+            glUniform3fv(posLoc, 1, &lightPositions[i][0]);
+        if (dirLoc >= 0)
+            glUniform3fv(dirLoc, 1, &lightDirections[i][0]);
+        if (colorLoc >= 0)
+            glUniform3fv(colorLoc, 1, &lightColors[i][0]);
+        if (intensityLoc >= 0)
+            glUniform1f(intensityLoc, intensities[i]);
+
+        // Adjust these angles to make lights cover more area
+        float innerCutoff, outerCutoff;
+
+        if (i == 0)
+        {
+            // Main center light - very wide coverage
+            innerCutoff = cos(radians(8.0f));
+            outerCutoff = cos(radians(12.0f));
+        }
+        else
+        {
+            // Orbiting lights - medium wide coverage
+            innerCutoff = cos(radians(5.0f));
+            outerCutoff = cos(radians(8.0f));
+        }
+
+        if (cutoffLoc >= 0)
+            glUniform1f(cutoffLoc, innerCutoff);
+        if (outerCutoffLoc >= 0)
+            glUniform1f(outerCutoffLoc, outerCutoff);
+    }
+}
+
+struct TexturedColoredVertex
+{
+    TexturedColoredVertex(vec3 _position, vec3 _normal, vec2 _uv)
+        : position(_position), normal(_normal), uv(_uv)
+    {
+    }
+
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+};
+
+// Uploads already quantized vertices into one VBO and sets the compact layout on the bound VAO
+GLuint uploadQuantizedVertexBuffer(const CompactVertex *compactVertices, size_t vertexCount)
+{
+    GLuint vertexBufferObject;
+    glGenBuffers(1, &vertexBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(CompactVertex), compactVertices, GL_STATIC_DRAW);
+
+    // unorm16 position relative to the AABB, decoded with positionScale/positionOffset
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void *)offsetof(CompactVertex, position));
+    glEnableVertexAttribArray(0);
+
+    // snorm16 octahedral normal, aNormal.z reads as 0 and the shader decodes xy
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void *)offsetof(CompactVertex, normal));
+    glEnableVertexAttribArray(1);
+
+    // half float uv, converted by the vertex fetch
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void *)offsetof(CompactVertex, uv));
+    glEnableVertexAttribArray(2);
+
+    return vertexBufferObject;
+}
+
+// Vertex of an Assimp mesh while it is optimized and simplified, so its skin follows every reordering
+struct SkinnedVertex : TexturedColoredVertex
+{
+    SkinnedVertex(vec3 _position, vec3 _normal, vec2 _uv)
+        : TexturedColoredVertex(_position, _normal, _uv), skin()
+    {
+    }
+
+    SkinWeights skin;
+};
+
+// Quantizes vertices to CompactVertex and uploads them into one VBO on the bound VAO
+// decode receives the AABB the shader needs to read the positions back
+GLuint uploadCompactVertexBuffer(const TexturedColoredVertex *vertexArray, size_t arraySize, VertexDecode &decode)
+{
+    vector<CompactVertex> compactVertices;
+    quantizeVertices(vertexArray, arraySize / sizeof(TexturedColoredVertex), compactVertices, decode);
+    return uploadQuantizedVertexBuffer(compactVertices.data(), compactVertices.size());
+}
+
+// Uploads interleaved vertices into one VBO and sets the position/normal/uv layout on the bound VAO
+GLuint uploadTexturedVertexBuffer(const TexturedColoredVertex *vertexArray, size_t arraySize, VertexFormat format, VertexDecode &decode)
+{
+    if (format == VERTEX_FORMAT_COMPACT)
+    {
+        return uploadCompactVertexBuffer(vertexArray, arraySize, decode);
+    }
+    decode = VertexDecode();
+
+    GLuint vertexBufferObject;
+    glGenBuffers(1, &vertexBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, arraySize, vertexArray, GL_STATIC_DRAW);
+    glVertexAttribPointer(0,                                                // attribute 0 matches aPos in Vertex Shader
+                          3,                                                // size
+                          GL_FLOAT,                                         // type
+                          GL_FALSE,                                         // normalized?
+                          sizeof(TexturedColoredVertex),                    // stride
+                          (void *)offsetof(TexturedColoredVertex, position) // array buffer offset
+    );
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, // attribute 1 matches aNormal in Vertex Shader
+                          3,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          sizeof(TexturedColoredVertex),
+                          (void *)offsetof(TexturedColoredVertex, normal));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, // attribute 2 matches aUV in Vertex Shader
+                          2,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          sizeof(TexturedColoredVertex),
+                          (void *)offsetof(TexturedColoredVertex, uv));
+    glEnableVertexAttribArray(2);
+
+    return vertexBufferObject;
+}
+
+// Uploads an index buffer to the bound VAO, as 16-bit indices when every vertex fits
+// Returns the index type to pass to glDrawElements
+GLenum uploadIndexBuffer(const vector<unsigned int> &indices, size_t vertexCount)
+{
+    GLuint EBO;
+    glGenBuffers(1, &EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    if (vertexCount <= 65536)
+    {
+        vector<GLushort> shortIndices(indices.begin(), indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+        return GL_UNSIGNED_SHORT;
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    return GL_UNSIGNED_INT;
+}
+
+size_t indexTypeSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+// Uploads the skin of a skinned buffer as a second vertex stream of the bound VAO,
+// so unskinned models keep their vertex size
+GLuint uploadSkinBuffer(const SkinWeights *skin, size_t vertexCount)
+{
+    GLuint skinBufferObject;
+    glGenBuffers(1, &skinBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, skinBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(SkinWeights), skin, GL_STATIC_DRAW);
+    glVertexAttribIPointer(3, SKIN_BONES_PER_VERTEX, GL_UNSIGNED_BYTE, sizeof(SkinWeights), (void *)offsetof(SkinWeights, bones));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, SKIN_BONES_PER_VERTEX, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SkinWeights), (void *)offsetof(SkinWeights, weights));
+    glEnableVertexAttribArray(4);
+    return skinBufferObject;
+}
+
+// New structs to handle multiple meshes
+struct Mesh
+{
+    GLuint VAO;
+    int vertexCount;
+    string name; // Add a name to identify the mesh
+    GLenum indexType;    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, GL_NONE when drawn unindexed
+    VertexDecode decode; // Set with setVertexDecode before drawing
+    vector<Meshlet> meshlets; // Empty unless the model was loaded with meshlets
+    vector<LODLevel> lods;    // Ranges of the index buffer, lods[0] is the full mesh
+    int baseVertex = 0;       // Added to every index, for meshes sharing merged buffers
+    vec3 boundsCenter;        // Bounding sphere in model space, for LOD selection
+    float boundsRadius;
+    GLuint texture = 0;       // Diffuse map of the mesh's material, 0 keeps the bound texture
+    bool hasMaterial = false; // Drawn in diffuseColor instead of the caller's color (.mtl materials)
+    vec3 diffuseColor = vec3(1.0f); // Kd, tints the diffuse map
+    int node = -1;            // First node drawing the mesh, into Model::nodes
+};
+
+// One entry of a skinned model's bone palette
+struct SkinBone
+{
+    int node;    // Into Model::nodes
+    mat4 offset; // Mesh space to the bone's space in the bind pose
+};
+
+// One node of a model's scene graph, meshes are placed by their node and its parents
+struct ModelNode
+{
+    string name;
+    int parent;          // Into Model::nodes, -1 for the root; parents always come before their children
+    mat4 localTransform; // Relative to the parent
+    vector<int> meshes;  // Into Model::meshes
+};
+
+struct Model
+{
+    std::vector<Mesh> meshes;
+    std::vector<ModelNode> nodes; // Node handles are indices into this, nodes[0] is the root
+    std::vector<SkinBone> bones;  // Bone palette, empty unless the model is skinned
+    std::vector<Animation> animations;
+    mat4 globalInverse = mat4(1.0f); // Undoes the root transform in the palette
+    vec3 boundsCenter; // Bounding sphere of all meshes, so every mesh uses the same level
+    float boundsRadius;
+    bool loaded = false; // Until then the bounds are placeholders and there are no meshes
+};
+
+// How a model is loaded, the same for every load path
+struct ModelLoadOptions
+{
+    VertexFormat format = VERTEX_FORMAT_COMPACT;
+    bool buildClusters = false;                       // Meshlets for per-cluster culling
+    ImportProfile profile = IMPORT_PROFILE_FAST_LOAD; // Assimp post-processing
+    bool mergeMeshes = false;                         // One VBO and EBO for all meshes, drawn with base vertices
+};
+
+// Resolves a node to its handle, by node name or else by the name of a mesh it draws
+// Meant for load time: the handle then indexes per-node data every frame without any string work
+int findNode(const Model &model, const string &name)
+{
+    for (size_t i = 0; i < model.nodes.size(); i++)
+    {
+        if (model.nodes[i].name == name)
+            return (int)i;
+    }
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        if (model.meshes[i].name == name)
+            return model.meshes[i].node;
+    }
+    return -1;
+}
+
+// Builds the LOD chain of an optimized mesh, appending the simplified levels to its indices
+template <typename Vertex>
+vector<LODLevel> buildMeshLODs(const string &name, const vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    vector<vector<unsigned int>> levels;
+    vector<float> errors;
+    buildLODChain(vertices, indices, levels, errors);
+
+    vector<LODLevel> lods;
+    appendLODLevels(levels, errors, vertices.size(), indices, lods);
+    std::cout << name << ": " << lods.size() << " LODs,";
+    for (size_t i = 0; i < lods.size(); i++)
+    {
+        std::cout << " " << lods[i].indexCount / 3 << " triangles (error " << lods[i].error << ")";
+    }
+    std::cout << std::endl;
+    return lods;
+}
+
+// Vertices and indices of one VAO, ready to upload
+struct ModelBufferData
+{
+    string name;
+    vector<TexturedColoredVertex> vertices; // VERTEX_FORMAT_FLOAT
+    vector<CompactVertex> compactVertices;  // VERTEX_FORMAT_COMPACT, quantized by the loading thread
+    VertexDecode decode;
+    vector<unsigned int> indices;
+    vector<SkinWeights> skin; // One per vertex for skinned models, else empty
+};
+
+// Everything a model needs but its GL objects, so it can be loaded on a worker thread
+// and handed to the GL thread for uploadModelData
+struct ModelData
+{
+    string path;
+    VertexFormat format;
+    vector<ModelBufferData> buffers; // One VAO each
+    Model model;                     // Meshes still without VAO, indexType, decode and texture
+    vector<size_t> meshBuffers;      // Buffer of each mesh
+    vector<string> meshTextures;     // Diffuse map of each mesh as a TextureCache key, empty for none
+    vector<EmbeddedTexture> embeddedTextures; // Textures stored in the model file, each once
+    double loadSeconds = 0.0;
+    bool failed = false; // The file could not be read or imported, there is nothing to upload
+};
+
+// Packs every buffer of data into one VBO and EBO, before quantization
+// Indices stay relative to their mesh, which is drawn from its own index range with its baseVertex
+void mergeModelBuffers(ModelData &data)
+{
+    ModelBufferData merged;
+    merged.name = data.path + " (merged)";
+    vector<size_t> baseVertex, firstIndex;
+    for (size_t i = 0; i < data.buffers.size(); i++)
+    {
+        baseVertex.push_back(merged.vertices.size());
+        firstIndex.push_back(merged.indices.size());
+        merged.vertices.insert(merged.vertices.end(), data.buffers[i].vertices.begin(), data.buffers[i].vertices.end());
+        merged.indices.insert(merged.indices.end(), data.buffers[i].indices.begin(), data.buffers[i].indices.end());
+        merged.skin.insert(merged.skin.end(), data.buffers[i].skin.begin(), data.buffers[i].skin.end());
+    }
+    for (size_t i = 0; i < data.model.meshes.size(); i++)
+    {
+        Mesh &mesh = data.model.meshes[i];
+        size_t buffer = data.meshBuffers[i];
+        mesh.baseVertex = (int)baseVertex[buffer];
+        for (size_t l = 0; l < mesh.lods.size(); l++)
+        {
+            mesh.lods[l].firstIndex += firstIndex[buffer];
+        }
+        for (size_t m = 0; m < mesh.meshlets.size(); m++)
+        {
+            mesh.meshlets[m].firstIndex += firstIndex[buffer];
+        }
+        data.meshBuffers[i] = 0;
+    }
+    data.buffers.clear();
+    data.buffers.push_back(std::move(merged));
+}
+
+// Moves the vertices of a buffer into the upload format, quantizing them for VERTEX_FORMAT_COMPACT
+void prepareModelBuffer(ModelBufferData &buffer, VertexFormat format)
+{
+    if (format == VERTEX_FORMAT_COMPACT)
+    {
+        quantizeVertices(buffer.vertices.data(), buffer.vertices.size(), buffer.compactVertices, buffer.decode);
+        vector<TexturedColoredVertex>().swap(buffer.vertices);
+    }
+}
+
+// Assimp matrices are row-major, glm's are column-major
+mat4 toMat4(const aiMatrix4x4 &m)
+{
+    const float *rows = &m.a1;
+    mat4 result;
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+            result[c][r] = rows[r * 4 + c];
+    return result;
+}
+
+// Appends node and its subtree to model.nodes depth first, so parents come before their children
+void appendModelNodes(const aiNode *node, int parent, Model &model)
+{
+    int handle = (int)model.nodes.size();
+    ModelNode modelNode;
+    modelNode.name = node->mName.C_Str();
+    modelNode.parent = parent;
+    modelNode.localTransform = toMat4(node->mTransformation);
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        modelNode.meshes.push_back(node->mMeshes[i]);
+        if (model.meshes[node->mMeshes[i]].node < 0)
+        {
+            model.meshes[node->mMeshes[i]].node = handle;
+        }
+    }
+    model.nodes.push_back(modelNode);
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        appendModelNodes(node->mChildren[i], handle, model);
+    }
+}
+
+// TextureCache key of the diffuse (or PBR base color) map of mesh's material, empty for none
+// Embedded textures are copied into data once; referenced files are looked for the way exporters
+// write them: as given, next to the model, and in the Textures directory beside the model's
+string findMaterialTexture(const aiScene *scene, const aiMesh *mesh, const string &path, ModelData &data)
+{
+    if (mesh->mMaterialIndex >= scene->mNumMaterials)
+    {
+        return string();
+    }
+    const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+    aiString texturePath;
+    if (material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath) != aiReturn_SUCCESS &&
+        material->GetTexture(aiTextureType_BASE_COLOR, 0, &texturePath) != aiReturn_SUCCESS)
+    {
+        return string();
+    }
+
+    const aiTexture *texture = scene->GetEmbeddedTexture(texturePath.C_Str());
+    if (texture)
+    {
+        EmbeddedTexture embedded;
+        if (texture->mHeight == 0)
+        {
+            // a whole image file of mWidth bytes
+            const unsigned char *bytes = (const unsigned char *)texture->pcData;
+            embedded.bytes.assign(bytes, bytes + texture->mWidth);
+        }
+        else
+        {
+            // raw BGRA texels
+            embedded.width = texture->mWidth;
+            embedded.height = texture->mHeight;
+            embedded.bytes.resize((size_t)texture->mWidth * texture->mHeight * 4);
+            for (size_t i = 0; i < (size_t)texture->mWidth * texture->mHeight; i++)
+            {
+                embedded.bytes[i * 4] = texture->pcData[i].r;
+                embedded.bytes[i * 4 + 1] = texture->pcData[i].g;
+                embedded.bytes[i * 4 + 2] = texture->pcData[i].b;
+                embedded.bytes[i * 4 + 3] = texture->pcData[i].a;
+            }
+        }
+        char key[32];
+        snprintf(key, sizeof(key), "embedded:%016llx", (unsigned long long)hashTextureBytes(embedded.bytes.data(), embedded.bytes.size()));
+        embedded.key = key;
+        for (size_t i = 0; i < data.embeddedTextures.size(); i++)
+        {
+            if (data.embeddedTextures[i].key == embedded.key)
+            {
+                return embedded.key;
+            }
+        }
+        data.embeddedTextures.push_back(std::move(embedded));
+        return data.embeddedTextures.back().key;
+    }
+
+    string file = texturePath.C_Str();
+    std::replace(file.begin(), file.end(), '\\', '/');
+    string directory = directoryOf(path);
+    size_t slash = file.find_last_of('/');
+    string name = slash == string::npos ? file : file.substr(slash + 1);
+    const string candidates[] = {file, directory + file, directory + name, directory + "../Textures/" + name};
+    for (const string &candidate : candidates)
+    {
+        FILE *exists = fopen(candidate.c_str(), "rb");
+        if (exists)
+        {
+            fclose(exists);
+            return candidate;
+        }
+    }
+    return directory + file; // reported once by the cache when it fails to load
+}
+
+// Finishes the skin of a model with bones: resolves the bones to nodes, binds every mesh without
+// bones rigidly to its node so the whole model is drawn through the palette, and reads the animations
+void setupModelSkin(const aiScene *scene, const vector<string> &boneNames, ModelData &data)
+{
+    Model &model = data.model;
+    for (size_t b = 0; b < model.bones.size(); b++)
+    {
+        model.bones[b].node = 0;
+        for (size_t n = 0; n < model.nodes.size(); n++)
+        {
+            if (model.nodes[n].name == boneNames[b])
+            {
+                model.bones[b].node = (int)n;
+            }
+        }
+    }
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        ModelBufferData &buffer = data.buffers[data.meshBuffers[i]];
+        if (!buffer.skin.empty())
+        {
+            continue;
+        }
+        SkinBone rigid = {model.meshes[i].node, mat4(1.0f)};
+        model.bones.push_back(rigid);
+        SkinInfluences influence;
+        SkinWeights skin = packSkinWeights(influence, (int)model.bones.size() - 1);
+        buffer.skin.assign(buffer.vertices.size(), skin);
+    }
+
+    if (model.bones.size() > (size_t)SKIN_MAX_BONES)
+    {
+        std::cerr << data.path << ": " << model.bones.size() << " bones, more than the " << SKIN_MAX_BONES << " of the palette; drawn unskinned" << std::endl;
+        model.bones.clear();
+        for (size_t i = 0; i < data.buffers.size(); i++)
+        {
+            data.buffers[i].skin.clear();
+        }
+        return;
+    }
+
+    // meshlet bounds only hold for the bind pose
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        model.meshes[i].meshlets.clear();
+    }
+    model.globalInverse = glm::inverse(model.nodes[0].localTransform);
+
+    for (unsigned int a = 0; a < scene->mNumAnimations; a++)
+    {
+        const aiAnimation *source = scene->mAnimations[a];
+        Animation animation;
+        animation.name = source->mName.C_Str();
+        animation.duration = source->mDuration;
+        animation.ticksPerSecond = source->mTicksPerSecond;
+        for (unsigned int c = 0; c < source->mNumChannels; c++)
+        {
+            const aiNodeAnim *sourceChannel = source->mChannels[c];
+            AnimationChannel channel;
+            channel.node = -1;
+            for (size_t n = 0; n < model.nodes.size(); n++)
+            {
+                if (model.nodes[n].name == sourceChannel->mNodeName.C_Str())
+                {
+                    channel.node = (int)n;
+                }
+            }
+            if (channel.node < 0)
+            {
+                continue;
+            }
+            for (unsigned int k = 0; k < sourceChannel->mNumPositionKeys; k++)
+            {
+                const aiVectorKey &key = sourceChannel->mPositionKeys[k];
+                VectorKey added = {key.mTime, vec3(key.mValue.x, key.mValue.y, key.mValue.z)};
+                channel.positions.push_back(added);
+            }
+            for (unsigned int k = 0; k < sourceChannel->mNumRotationKeys; k++)
+            {
+                const aiQuatKey &key = sourceChannel->mRotationKeys[k];
+                RotationKey added = {key.mTime, glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z)};
+                channel.rotations.push_back(added);
+            }
+            for (unsigned int k = 0; k < sourceChannel->mNumScalingKeys; k++)
+            {
+                const aiVectorKey &key = sourceChannel->mScalingKeys[k];
+                VectorKey added = {key.mTime, vec3(key.mValue.x, key.mValue.y, key.mValue.z)};
+                channel.scales.push_back(added);
+            }
+            animation.channels.push_back(channel);
+        }
+        model.animations.push_back(animation);
+    }
+    std::cout << data.path << ": skinned, " << model.bones.size() << " bones, " << model.animations.size() << " animations" << std::endl;
+}
+
+// A new function to load a model using Assimp, post-processed according to profile
+// Only touches CPU memory, so it can run on any thread
+ModelData loadFBXModelData(const std::string &path, const ModelLoadOptions &options)
+{
+    ModelData data;
+    data.path = path;
+    data.format = options.format;
+    Model &model = data.model;
+    Assimp::Importer importer;
+    ImportStats importStats;
+    const aiScene *scene = importScene(importer, path, options.profile, importStats);
+
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
+        data.failed = true;
+        return data;
+    }
+    printImportStats(path.c_str(), options.profile, importStats);
+
+    // std::cout << "Loading model from: " << path << std::endl;
+    // std::cout << "Assimp found " << scene->mNumMeshes << " meshes." << std::endl;
+
+    vec3 modelMin(0.0f), modelMax(0.0f);
+    vector<string> boneNames; // Of model.bones, resolved to nodes once the node tree is read
+
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+    {
+        aiMesh *mesh = scene->mMeshes[i];
+
+        // std::cout << "Processing mesh " << i << " with " << mesh->mNumVertices << " vertices and " << mesh->mNumFaces << " faces." << std::endl;
+
+        std::vector<SkinnedVertex> vertices;
+        std::vector<unsigned int> indices;
+
+        vertices.reserve(mesh->mNumVertices);
+        for (unsigned int j = 0; j < mesh->mNumVertices; j++)
+        {
+            vec3 normal(0.0f);
+            vec2 uv(0.0f);
+            if (mesh->HasNormals())
+            {
+                normal = glm::vec3(mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z);
+            }
+            if (mesh->HasTextureCoords(0))
+            {
+                uv = glm::vec2(mesh->mTextureCoords[0][j].x, mesh->mTextureCoords[0][j].y);
+            }
+            vertices.push_back(SkinnedVertex(glm::vec3(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z), normal, uv));
+        }
+
+        // the heaviest bone influences of every vertex, bones are shared by all meshes of the model
+        if (mesh->HasBones())
+        {
+            vector<SkinInfluences> influences(mesh->mNumVertices);
+            for (unsigned int b = 0; b < mesh->mNumBones; b++)
+            {
+                const aiBone *bone = mesh->mBones[b];
+                size_t boneIndex = std::find(boneNames.begin(), boneNames.end(), string(bone->mName.C_Str())) - boneNames.begin();
+                if (boneIndex == boneNames.size())
+                {
+                    SkinBone added = {0, toMat4(bone->mOffsetMatrix)};
+                    model.bones.push_back(added);
+                    boneNames.push_back(bone->mName.C_Str());
+                }
+                for (unsigned int w = 0; w < bone->mNumWeights; w++)
+                {
+                    addSkinInfluence(influences[bone->mWeights[w].mVertexId], (int)boneIndex, bone->mWeights[w].mWeight);
+                }
+            }
+            for (unsigned int j = 0; j < mesh->mNumVertices; j++)
+            {
+                vertices[j].skin = packSkinWeights(influences[j]);
+            }
+        }
+
+        for (unsigned int j = 0; j < mesh->mNumFaces; j++)
+        {
+            aiFace face = mesh->mFaces[j];
+            for (unsigned int k = 0; k < face.mNumIndices; k++)
+            {
+                indices.push_back(face.mIndices[k]);
+            }
+        }
+
+        // reorder triangles and vertices for the post-transform cache, overdraw and vertex fetch
+        MeshOptimizeStats optimizeStats;
+        optimizeMesh(vertices, indices, &optimizeStats);
+        printMeshOptimizeStats((path + " " + mesh->mName.C_Str()).c_str(), optimizeStats);
+
+        // split into meshlets for culling, bounds are taken before quantization
+        Mesh loadedMesh;
+        loadedMesh.name = mesh->mName.C_Str();
+        loadedMesh.vertexCount = (int)indices.size();
+        if (options.buildClusters)
+        {
+            buildMeshlets(vertices, indices, loadedMesh.meshlets);
+        }
+
+        // simplified levels go after the full mesh in the same index buffer
+        loadedMesh.lods = buildMeshLODs(path + " " + loadedMesh.name, vertices, indices);
+        computeBoundingSphere(vertices, loadedMesh.boundsCenter, loadedMesh.boundsRadius);
+        vec3 meshMin = loadedMesh.boundsCenter - vec3(loadedMesh.boundsRadius);
+        vec3 meshMax = loadedMesh.boundsCenter + vec3(loadedMesh.boundsRadius);
+        modelMin = model.meshes.empty() ? meshMin : glm::min(modelMin, meshMin);
+        modelMax = model.meshes.empty() ? meshMax : glm::max(modelMax, meshMax);
+
+        // one VAO per mesh, uploaded later by uploadModelData
+        ModelBufferData buffer;
+        buffer.name = path + " " + loadedMesh.name;
+        buffer.vertices.assign(vertices.begin(), vertices.end());
+        buffer.indices.swap(indices);
+        for (size_t j = 0; mesh->HasBones() && j < vertices.size(); j++)
+        {
+            buffer.skin.push_back(vertices[j].skin);
+        }
+        data.meshBuffers.push_back(data.buffers.size());
+        data.meshTextures.push_back(findMaterialTexture(scene, mesh, path, data));
+        data.buffers.push_back(std::move(buffer));
+        model.meshes.push_back(loadedMesh);
+        // std::cout << "Successfully loaded mesh " << i << " with name '" << mesh->mName.C_Str() << "'. Vertex count: " << indices.size() << std::endl;
+    }
+
+    // keep the node tree, meshes no node refers to hang off the root
+    appendModelNodes(scene->mRootNode, -1, model);
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        if (model.meshes[i].node < 0)
+        {
+            model.meshes[i].node = 0;
+        }
+    }
+
+    if (!model.bones.empty())
+    {
+        setupModelSkin(scene, boneNames, data);
+    }
+
+    model.boundsCenter = (modelMin + modelMax) * 0.5f;
+    model.boundsRadius = glm::length(modelMax - modelMin) * 0.5f;
+
+    if (options.mergeMeshes && data.buffers.size() > 1)
+    {
+        mergeModelBuffers(data);
+    }
+    for (size_t i = 0; i < data.buffers.size(); i++)
+    {
+        prepareModelBuffer(data.buffers[i], options.format);
+    }
+    return data;
+}
+
+// Creates the VAOs, buffers and textures of loaded model data, on the GL thread
+Model uploadModelData(ModelData &data, TextureCache &textures)
+{
+    vector<GLuint> VAOs;
+    vector<GLenum> indexTypes;
+    size_t bufferObjects = 0;
+    for (size_t i = 0; i < data.buffers.size(); i++)
+    {
+        const ModelBufferData &buffer = data.buffers[i];
+        size_t vertexCount = data.format == VERTEX_FORMAT_COMPACT ? buffer.compactVertices.size() : buffer.vertices.size();
+
+        GLuint VAO;
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+
+        // one interleaved VBO for position, normal and uv
+        if (data.format == VERTEX_FORMAT_COMPACT)
+        {
+            uploadQuantizedVertexBuffer(buffer.compactVertices.data(), buffer.compactVertices.size());
+        }
+        else
+        {
+            VertexDecode decode;
+            uploadTexturedVertexBuffer(buffer.vertices.data(), buffer.vertices.size() * sizeof(TexturedColoredVertex), VERTEX_FORMAT_FLOAT, decode);
+        }
+
+        // merged meshes index relative to their base vertex, so the largest index decides the type
+        size_t indexedVertices = buffer.indices.empty() ? 0 : *std::max_element(buffer.indices.begin(), buffer.indices.end()) + 1;
+        GLenum indexType = uploadIndexBuffer(buffer.indices, indexedVertices);
+
+        if (!buffer.skin.empty())
+        {
+            uploadSkinBuffer(buffer.skin.data(), buffer.skin.size());
+            bufferObjects++;
+        }
+        printVertexFormatSavings(buffer.name.c_str(), vertexCount, buffer.indices.size(), vertexFormatSize(data.format), indexTypeSize(indexType));
+
+        glBindVertexArray(0);
+        VAOs.push_back(VAO);
+        indexTypes.push_back(indexType);
+        bufferObjects += 2;
+    }
+
+    Model model = data.model;
+    size_t texturedMeshes = 0, cachedTextures = 0;
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        size_t buffer = data.meshBuffers[i];
+        model.meshes[i].VAO = VAOs[buffer];
+        model.meshes[i].indexType = indexTypes[buffer];
+        model.meshes[i].decode = data.buffers[buffer].decode;
+        const string &key = data.meshTextures[i];
+        if (key.empty())
+        {
+            continue;
+        }
+        const EmbeddedTexture *embedded = NULL;
+        for (size_t e = 0; e < data.embeddedTextures.size(); e++)
+        {
+            if (data.embeddedTextures[e].key == key)
+            {
+                embedded = &data.embeddedTextures[e];
+            }
+        }
+        if (textures.textures.count(key))
+        {
+            cachedTextures++;
+        }
+        model.meshes[i].texture = loadCachedTexture(textures, key, embedded);
+        texturedMeshes++;
+    }
+    std::cout << data.path << ": " << model.meshes.size() << " meshes in " << VAOs.size() << " VAOs, "
+              << bufferObjects << " buffer objects, " << texturedMeshes << " textured meshes ("
+              << cachedTextures << " cache hits, " << data.embeddedTextures.size() << " embedded)" << std::endl;
+    model.loaded = true;
+    return model;
+}
+
+// Draws the meshlets of the bound indexed mesh that pass frustum and back-face culling
+// Consecutive visible meshlets are merged into one glDrawElements, a mesh without meshlets is drawn whole
+void drawMeshlets(const vector<Meshlet> &meshlets, size_t firstIndex, int indexCount, GLenum indexType, int baseVertex, const MeshletFrustum &frustum, MeshletCullStats &stats)
+{
+    stats.trianglesSubmitted += indexCount / 3;
+    if (meshlets.empty())
+    {
+        stats.trianglesDrawn += indexCount / 3;
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void *)(firstIndex * indexTypeSize(indexType)), baseVertex);
+        return;
+    }
+
+    size_t runFirst = 0, runCount = 0;
+    for (size_t i = 0; i <= meshlets.size(); i++)
+    {
+        if (i < meshlets.size())
+        {
+            const Meshlet &meshlet = meshlets[i];
+            if (!isMeshletInFrustum(meshlet, frustum))
+            {
+                stats.meshletsFrustumCulled++;
+                continue;
+            }
+            if (isMeshletBackFacing(meshlet, frustum))
+            {
+                stats.meshletsConeCulled++;
+                continue;
+            }
+            if (runCount > 0 && runFirst + runCount == meshlet.firstIndex)
+            {
+                runCount += meshlet.indexCount;
+                continue;
+            }
+        }
+        if (runCount > 0)
+        {
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)runCount, indexType, (void *)(runFirst * indexTypeSize(indexType)), baseVertex);
+            stats.trianglesDrawn += runCount / 3;
+        }
+        if (i < meshlets.size())
+        {
+            runFirst = meshlets[i].firstIndex;
+            runCount = meshlets[i].indexCount;
+        }
+    }
+}
+
+// Draws one level of a mesh, the full mesh going through meshlet culling
+// lodStats counts the triangles of the chosen level against the full mesh
+void drawMesh(const Mesh &mesh, int level, const MeshletFrustum &frustum, MeshletCullStats &meshletStats, LODStats &lodStats)
+{
+    level = std::min(level, (int)mesh.lods.size() - 1);
+    lodStats.trianglesFull += mesh.vertexCount / 3;
+    if (mesh.indexType == GL_NONE)
+    {
+        lodStats.trianglesDrawn += mesh.vertexCount / 3;
+        glDrawArrays(GL_TRIANGLES, mesh.baseVertex, mesh.vertexCount);
+        return;
+    }
+    if (level <= 0)
+    {
+        lodStats.trianglesDrawn += mesh.vertexCount / 3;
+        drawMeshlets(mesh.meshlets, mesh.lods.empty() ? 0 : mesh.lods[0].firstIndex, mesh.vertexCount, mesh.indexType, mesh.baseVertex, frustum, meshletStats);
+        return;
+    }
+    const LODLevel &lod = mesh.lods[level];
+    lodStats.trianglesDrawn += lod.indexCount / 3;
+    glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)lod.indexCount, mesh.indexType, (void *)(lod.firstIndex * indexTypeSize(mesh.indexType)), mesh.baseVertex);
+}
+
+// VAO and texture binds of the draws, printed with the LOD stats
+struct BindStats
+{
+    size_t vertexArrayBinds = 0;
+    size_t textureBinds = 0;   // glBindTexture of a material
+    size_t layerSwitches = 0;  // materials picked from the texture array instead
+    size_t frames = 0;
+};
+
+// Binds the VAO of mesh and sets its vertex decode, unless boundVAO says it is already bound
+void bindMeshVertexArray(int shaderProgram, const Mesh &mesh, GLuint &boundVAO, BindStats &stats)
+{
+    if (mesh.VAO == boundVAO)
+    {
+        return;
+    }
+    setVertexDecode(shaderProgram, mesh.decode);
+    glBindVertexArray(mesh.VAO);
+    boundVAO = mesh.VAO;
+    stats.vertexArrayBinds++;
+}
+
+// Scratch space for posing a skinned model, reused from frame to frame
+struct SkinPose
+{
+    vector<mat4> localTransforms;
+    vector<mat4> nodeTransforms;
+    vector<mat4> palette; // One matrix per bone, for setSkinning
+};
+
+// Poses model with animation (-1 for the bind pose) at seconds, looping, and builds its bone palette
+void poseSkeleton(const Model &model, int animation, double seconds, SkinPose &pose)
+{
+    pose.localTransforms.resize(model.nodes.size());
+    for (size_t i = 0; i < model.nodes.size(); i++)
+    {
+        pose.localTransforms[i] = model.nodes[i].localTransform;
+    }
+    if (animation >= 0 && animation < (int)model.animations.size())
+    {
+        sampleAnimation(model.animations[animation], seconds, pose.localTransforms);
+    }
+    pose.nodeTransforms.resize(model.nodes.size());
+    for (size_t i = 0; i < model.nodes.size(); i++)
+    {
+        int parent = model.nodes[i].parent;
+        pose.nodeTransforms[i] = parent < 0 ? pose.localTransforms[i] : pose.nodeTransforms[parent] * pose.localTransforms[i];
+    }
+    pose.palette.resize(model.bones.size());
+    for (size_t b = 0; b < model.bones.size(); b++)
+    {
+        pose.palette[b] = model.globalInverse * pose.nodeTransforms[model.bones[b].node] * model.bones[b].offset;
+    }
+}
+
+// Uploads the bone palette of the next skinned draws in one call, an empty palette turns skinning off
+void setSkinning(int shaderProgram, const vector<mat4> &palette)
 {
     glUseProgram(shaderProgram);
-    GLuint worldMatrixLocation = glGetUniformLocation(shaderProgram, "worldMatrix");
-    glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
+    glUniform1i(glGetUniformLocation(shaderProgram, "skinned"), !palette.empty());
+    if (!palette.empty())
+    {
+        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "bonePalette"), (GLsizei)palette.size(), GL_FALSE, &palette[0][0][0]);
+    }
+}
+
+// Makes texture the material of the next draws: its layer of the texture array when it was packed there, else a bind
+void bindMaterialTexture(int shaderProgram, const MaterialTextureArray &materials, GLuint texture, BindStats &stats)
+{
+    map<GLuint, MaterialTexture>::const_iterator found = materials.entries.find(texture);
+    if (materials.texture != 0)
+    {
+        glUniform1i(glGetUniformLocation(shaderProgram, "useTextureArray"), found != materials.entries.end());
+    }
+    if (found == materials.entries.end())
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        stats.textureBinds++;
+        return;
+    }
+    glUniform1f(glGetUniformLocation(shaderProgram, "textureLayer"), (float)found->second.layer);
+    glUniform4fv(glGetUniformLocation(shaderProgram, "layerRect"), 1, &found->second.rect[0]);
+    stats.layerSwitches++;
+}
+
+// Makes the texture of mesh's material, or fallback for meshes without one, current unless it already is
+void bindMeshTexture(int shaderProgram, const MaterialTextureArray &materials, const Mesh &mesh, GLuint fallback, GLuint &boundTexture, BindStats &stats)
+{
+    GLuint texture = mesh.texture != 0 ? mesh.texture : fallback;
+    if (texture != boundTexture)
+    {
+        bindMaterialTexture(shaderProgram, materials, texture, stats);
+        boundTexture = texture;
+    }
+}
+
+void printBindStats(const BindStats &stats)
+{
+    size_t frames = stats.frames ? stats.frames : 1;
+    std::cout << "Model draws: " << (double)stats.vertexArrayBinds / frames << " VAO binds/frame over " << stats.frames << " frames" << std::endl;
+    std::cout << "Materials: " << (double)stats.textureBinds / frames << " texture binds/frame, " << (double)stats.layerSwitches / frames << " texture array layer switches/frame" << std::endl;
+}
+
+// Records the material textures of model as drawn this frame at screenSize
+void touchModelTextures(TextureResidency &residency, const Model &model, float screenSize)
+{
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        if (model.meshes[i].texture != 0)
+        {
+            touchResidentTexture(residency, model.meshes[i].texture, screenSize);
+        }
+    }
+}
+
+// Draws every mesh of a model, binding each VAO once. Meshes with an .mtl material are drawn in its Kd color,
+// which tints its map_Kd texture when there is one; the others are drawn in color, untextured
+void drawModelMeshes(int shaderProgram, const Model &model, int level, vec3 color, const MaterialTextureArray &materialTextures, const MeshletFrustum &frustum, MeshletCullStats &meshletStats, LODStats &lodStats, BindStats &bindStats)
+{
+    GLuint boundVAO = 0, boundTexture = 0;
+    GLint useTextureLocation = glGetUniformLocation(shaderProgram, "useTexture");
+    GLint objectColorLocation = glGetUniformLocation(shaderProgram, "objectColor");
+    GLint materialColorLocation = glGetUniformLocation(shaderProgram, "materialColor");
+    for (const auto &mesh : model.meshes)
+    {
+        bindMeshVertexArray(shaderProgram, mesh, boundVAO, bindStats);
+        vec3 diffuse = mesh.hasMaterial ? mesh.diffuseColor : color;
+        glUniform3fv(objectColorLocation, 1, &diffuse[0]);
+        glUniform3fv(materialColorLocation, 1, &diffuse[0]);
+        glUniform1i(useTextureLocation, mesh.texture != 0);
+        if (mesh.texture != 0)
+        {
+            bindMeshTexture(shaderProgram, materialTextures, mesh, 0, boundTexture, bindStats);
+        }
+        drawMesh(mesh, level, frustum, meshletStats, lodStats);
+    }
+    glUniform3f(materialColorLocation, 1.0f, 1.0f, 1.0f);
+}
+
+// Sets up an OBJ model too large to hold in RAM (--stream-obj): triangles are streamed from the file in batches
+// straight into one interleaved VBO, never using more than memoryCeiling bytes on the CPU side. Every corner is
+// its own vertex, so the mesh is drawn unindexed (GL_NONE). The vertices stay VERTEX_FORMAT_FLOAT, quantizing
+// needs the AABB before the first batch; there are no LODs or meshlets either, they need the whole mesh.
+// False when the file could not be streamed under the ceiling
+bool setupOBJModelStreamed(const string &path, size_t memoryCeiling, Model &model)
+{
+    GLuint VAO;
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    GLuint VBO = 0;
+    VertexDecode decode;
+    vec3 boundsMin(0.0f), boundsMax(0.0f);
+
+    OBJStreamOptions options;
+    options.memoryCeiling = memoryCeiling;
+    options.sinkCornerBytes = sizeof(TexturedColoredVertex);
+    OBJStreamStats stats;
+    vector<TexturedColoredVertex> vertices;
+    bool streamed = streamOBJ(path.c_str(), options, [&](const OBJTriangleBatch &batch)
+                              {
+        // the counting pass already ran, so the full buffer size is known
+        size_t corners = stats.counts.triangles * 3;
+        if (VBO == 0)
+        {
+            VBO = uploadTexturedVertexBuffer(NULL, corners * sizeof(TexturedColoredVertex), VERTEX_FORMAT_FLOAT, decode);
+        }
+        if (batch.firstCorner + batch.vertices.size() > corners)
+        {
+            return false;
+        }
+
+        // normals and uvs are per corner, or empty when the file has none at all
+        bool normals = !batch.normals.empty(), uvs = !batch.uvs.empty();
+        vertices.clear();
+        for (size_t i = 0; i < batch.vertices.size(); i++)
+        {
+            vertices.push_back(TexturedColoredVertex(batch.vertices[i], normals ? batch.normals[i] : vec3(0.0f, 1.0f, 0.0f), uvs ? batch.uvs[i] : vec2(0.0f)));
+            boundsMin = batch.firstCorner + i == 0 ? batch.vertices[i] : glm::min(boundsMin, batch.vertices[i]);
+            boundsMax = batch.firstCorner + i == 0 ? batch.vertices[i] : glm::max(boundsMax, batch.vertices[i]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, batch.firstCorner * sizeof(TexturedColoredVertex), vertices.size() * sizeof(TexturedColoredVertex), vertices.data());
+        return true; }, &stats);
+    glBindVertexArray(0);
+    if (!streamed || VBO == 0)
+    {
+        glDeleteBuffers(1, &VBO);
+        glDeleteVertexArrays(1, &VAO);
+        return false;
+    }
+
+    Mesh mesh;
+    mesh.VAO = VAO;
+    mesh.vertexCount = (int)(stats.counts.triangles * 3);
+    mesh.name = path;
+    mesh.indexType = GL_NONE;
+    mesh.decode = decode;
+    LODLevel full = {0, (size_t)mesh.vertexCount, 0.0f};
+    mesh.lods.push_back(full);
+    model.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    model.boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+    mesh.boundsCenter = model.boundsCenter;
+    mesh.boundsRadius = model.boundsRadius;
+    mesh.node = 0;
+    model.meshes.assign(1, mesh);
+    ModelNode root;
+    root.name = path;
+    root.parent = -1;
+    root.localTransform = mat4(1.0f);
+    root.meshes.push_back(0);
+    model.nodes.assign(1, root);
+    model.loaded = true;
+    return true;
+}
+
+// Loads an OBJ model with its .mtl materials: one VAO and one index buffer with the faces grouped by material
+// Every material becomes a Mesh drawing its own range of that buffer, so draw calls scale with materials, not files
+// Only touches CPU memory, so it can run on any thread
+ModelData loadOBJModelData(string path, const ModelLoadOptions &options)
+{
+    ModelData data;
+    data.path = path;
+    data.format = options.format;
+    Model &model = data.model;
+    vector<unsigned int> vertexIndices;
+    vector<TexturedColoredVertex> vertices;
+    vector<string> materialLibraries;
+    vector<OBJMaterialRun> materialRuns;
+
+    // read and weld the vertices from the OBJ file, then its material libraries
+    WeldStats weldStats;
+    if (!loadOBJWeldedMaterials(path.c_str(), vertexIndices, vertices, materialLibraries, materialRuns, 0, &weldStats))
+    {
+        data.failed = true;
+        return data;
+    }
+    std::cout << path << ": welded " << weldStats.corners << " corners into " << weldStats.vertices
+              << " vertices (dedup ratio " << weldStats.ratio() << ")" << std::endl;
+    vector<OBJMaterial> materials;
+    loadOBJMaterials(path.c_str(), materialLibraries, materials);
+
+    // one contiguous range per material, each optimized on its own
+    vector<unsigned int> groupedIndices;
+    vector<MaterialRange> ranges;
+    groupTrianglesByMaterial(vertexIndices, materialRuns, materials, groupedIndices, ranges);
+    vector<size_t> rangeStarts;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        rangeStarts.push_back(ranges[i].firstIndex);
+    }
+    MeshOptimizeStats optimizeStats;
+    optimizeMeshRanges(vertices, groupedIndices, rangeStarts, &optimizeStats);
+    printMeshOptimizeStats(path.c_str(), optimizeStats);
+    computeBoundingSphere(vertices, model.boundsCenter, model.boundsRadius);
+
+    // every range keeps its meshlets and LODs next to it in the final index buffer
+    vector<unsigned int> indices;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        const MaterialRange &range = ranges[i];
+        vector<unsigned int> rangeIndices(groupedIndices.begin() + range.firstIndex, groupedIndices.begin() + range.firstIndex + range.indexCount);
+        size_t base = indices.size();
+
+        Mesh loadedMesh;
+        loadedMesh.name = range.material >= 0 ? materials[range.material].name : path;
+        loadedMesh.vertexCount = rangeIndices.size();
+        if (range.material >= 0)
+        {
+            loadedMesh.hasMaterial = true;
+            loadedMesh.diffuseColor = materials[range.material].diffuse;
+        }
+        if (options.buildClusters)
+        {
+            buildMeshlets(vertices, rangeIndices, loadedMesh.meshlets);
+            for (size_t m = 0; m < loadedMesh.meshlets.size(); m++)
+            {
+                loadedMesh.meshlets[m].firstIndex += base;
+            }
+        }
+        loadedMesh.lods = buildMeshLODs(path + " " + loadedMesh.name, vertices, rangeIndices);
+        for (size_t l = 0; l < loadedMesh.lods.size(); l++)
+        {
+            loadedMesh.lods[l].firstIndex += base;
+        }
+        loadedMesh.boundsCenter = model.boundsCenter;
+        loadedMesh.boundsRadius = model.boundsRadius;
+        indices.insert(indices.end(), rangeIndices.begin(), rangeIndices.end());
+        data.meshBuffers.push_back(0);
+        data.meshTextures.push_back(range.material >= 0 ? materials[range.material].diffuseMap : string());
+        loadedMesh.node = 0;
+        model.meshes.push_back(loadedMesh);
+    }
+
+    // OBJ files have no hierarchy, a single root node draws every material
+    ModelNode root;
+    root.name = path;
+    root.parent = -1;
+    root.localTransform = mat4(1.0f);
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        root.meshes.push_back((int)i);
+    }
+    model.nodes.push_back(root);
+
+    // Single interleaved VBO and EBO shared by all materials
+    ModelBufferData buffer;
+    buffer.name = path;
+    buffer.vertices.swap(vertices);
+    buffer.indices.swap(indices);
+    prepareModelBuffer(buffer, options.format);
+    data.buffers.push_back(std::move(buffer));
+    std::cout << path << ": " << materials.size() << " materials, " << model.meshes.size() << " draw ranges in one VAO" << std::endl;
+    return data;
+}
+
+// Time the GL thread may spend per frame uploading finished models, in seconds
+const double MODEL_UPLOAD_BUDGET = 0.004;
+
+// Loads a model (.obj through the OBJ loader, anything else through Assimp) on a worker of loader
+// The result comes back to uploadFinishedModels under id
+void loadModelAsync(AsyncLoadQueue<ModelData> &loader, int id, const string &path, const ModelLoadOptions &options)
+{
+    submitAsyncLoad<ModelData>(loader, id, [path, options]()
+                               {
+        auto start = std::chrono::steady_clock::now();
+        bool isOBJ = path.size() >= 4 && path.compare(path.size() - 4, 4, ".obj") == 0;
+        ModelData data = isOBJ ? loadOBJModelData(path, options) : loadFBXModelData(path, options);
+        data.loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return data; });
+}
+
+// Uploads the models the loader has finished into models[id], on the GL thread, until budget seconds have passed
+// One model is always uploaded when available, so a model bigger than the budget still gets in. A model that
+// failed to load keeps its placeholder bounds and stays unloaded
+int uploadFinishedModels(AsyncLoadQueue<ModelData> &loader, Model *models[], TextureCache &textures, double budget)
+{
+    double start = glfwGetTime();
+    int uploaded = 0;
+    int id;
+    ModelData data;
+    while ((uploaded == 0 || glfwGetTime() - start < budget) && popFinishedLoad(loader, id, data))
+    {
+        if (data.failed)
+        {
+            std::cerr << data.path << ": failed to load, drawn as its placeholder bounds" << std::endl;
+            continue;
+        }
+        double uploadStart = glfwGetTime();
+        *models[id] = uploadModelData(data, textures);
+        std::cout << data.path << ": loaded in " << data.loadSeconds * 1000.0 << " ms on a worker, uploaded in "
+                  << (glfwGetTime() - uploadStart) * 1000.0 << " ms, ready " << glfwGetTime() * 1000.0 << " ms after startup" << std::endl;
+        uploaded++;
+    }
+    return uploaded;
+}
+
+// Draws a model that is still loading as a wireframe box around its placeholder bounds
+// boxVAO is the light cube: positions only, 36 indices, half size 0.1
+void drawPlaceholderBounds(int shaderProgram, GLuint boxVAO, mat4 worldMatrix, const Model &model)
+{
+    setWorldMatrix(shaderProgram, worldMatrix * translate(mat4(1.0f), model.boundsCenter) * scale(mat4(1.0f), vec3(model.boundsRadius / 0.1f)));
+    setVertexDecode(shaderProgram, VertexDecode());
+    glUniform1i(glGetUniformLocation(shaderProgram, "useTexture"), 0);
+    glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 0.5f, 0.5f, 0.5f);
+    glBindVertexArray(boxVAO);
+    glVertexAttrib3f(1, 0.0f, 1.0f, 0.0f); // the box has no normals
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+// Records of an asset bundle (see AssetBundle.h), read in place from the mapping
+// Strings are offsets into the bundle's string table, arrays are chunk indices (-1 when empty)
+struct BundleRootRecord
+{
+    int32_t textures; // BundleTextureRecord array
+    int32_t models;   // BundleModelRecord array
+};
+
+struct BundleTextureRecord
+{
+    uint32_t key; // TextureCache key the texture is loaded under
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t levelCount;
+    int32_t pixels;      // Chunk holding every mip level
+    int32_t blockFormat; // TextureBlockFormat of every level, raw pixels when NONE
+    int32_t reserved;
+    uint64_t levelOffsets[BUNDLE_MAX_LEVELS];
+    uint64_t contentHash; // hashTextureBytes of the source file, registered with the texture registry on load
+};
+
+struct BundleModelRecord
+{
+    uint32_t path;   // Model file the bundle was built from
+    uint32_t format; // VertexFormat of every buffer
+    int32_t buffers; // BundleBufferRecord array
+    int32_t meshes;  // BundleMeshRecord array
+    int32_t meshlets;
+    int32_t nodes;      // BundleNodeRecord array
+    int32_t nodeMeshes; // int32_t array, the meshes of every node back to back
+    int32_t bones;      // SkinBone array
+    int32_t animations; // BundleAnimationRecord array
+    int32_t channels;   // BundleChannelRecord array
+    int32_t vectorKeys; // Positions and scales of every channel
+    int32_t rotationKeys;
+    mat4 globalInverse;
+    vec3 boundsCenter;
+    float boundsRadius;
+};
+
+struct BundleBufferRecord
+{
+    int32_t vertices; // CompactVertex or TexturedColoredVertex array, as the model's format
+    int32_t indices;  // GLushort or GLuint array, as indexType
+    int32_t skin;     // SkinWeights array, -1 unless the model is skinned
+    uint32_t indexType;
+    vec3 positionOffset; // VertexDecode
+    vec3 positionScale;
+    uint32_t octahedralNormals;
+};
+
+struct BundleMeshRecord
+{
+    uint32_t name;
+    uint32_t texture; // TextureCache key, the empty string for none
+    int32_t buffer;
+    int32_t vertexCount;
+    int32_t baseVertex;
+    int32_t node;
+    int32_t firstMeshlet; // Into the model's meshlets
+    int32_t meshletCount;
+    int32_t lodCount;
+    float lodErrors[LOD_MAX_LEVELS];
+    uint64_t lodFirstIndices[LOD_MAX_LEVELS];
+    uint64_t lodIndexCounts[LOD_MAX_LEVELS];
+    vec3 boundsCenter;
+    float boundsRadius;
+    vec3 diffuseColor;    // Kd of an .mtl material
+    int32_t hasMaterial;
+};
+
+struct BundleNodeRecord
+{
+    uint32_t name;
+    int32_t parent;
+    int32_t firstMesh; // Into the model's nodeMeshes
+    int32_t meshCount;
+    mat4 localTransform;
+};
+
+struct BundleAnimationRecord
+{
+    uint32_t name;
+    int32_t firstChannel;
+    int32_t channelCount;
+    int32_t reserved;
+    double duration;
+    double ticksPerSecond;
+};
+
+struct BundleChannelRecord
+{
+    int32_t node;
+    int32_t firstPosition; // Positions and scales are in the model's vectorKeys
+    int32_t positionCount;
+    int32_t firstRotation;
+    int32_t rotationCount;
+    int32_t firstScale;
+    int32_t scaleCount;
+};
+
+// Changes with the size of any record, so a bundle is only read by a build that lays them out the same way
+uint32_t bundleRecordLayout()
+{
+    const uint64_t sizes[] = {sizeof(BundleRootRecord), sizeof(BundleTextureRecord), sizeof(BundleModelRecord), sizeof(BundleBufferRecord),
+                              sizeof(BundleMeshRecord), sizeof(BundleNodeRecord), sizeof(BundleAnimationRecord), sizeof(BundleChannelRecord),
+                              sizeof(Meshlet), sizeof(SkinBone), sizeof(VectorKey), sizeof(RotationKey),
+                              sizeof(CompactVertex), sizeof(TexturedColoredVertex), sizeof(SkinWeights)};
+    return (uint32_t)hashTextureBytes((const unsigned char *)sizes, sizeof(sizes));
+}
+
+// Decodes a texture the way loadCachedTexture would and writes its mip chain as one chunk, every level
+// block compressed unless compression is NONE. decodeSeconds gets the time spent decoding the source image
+bool writeBundleTexture(BundleWriter &writer, const string &key, const EmbeddedTexture *embedded, TextureCompression compression, BundleTextureRecord &record, double &decodeSeconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    int width, height, nrChannels = 4;
+    unsigned char *decoded = NULL;
+    const unsigned char *pixels = NULL;
+    vector<unsigned char> source;
+    uint64_t contentHash = 0;
+    if (embedded)
+    {
+        contentHash = hashTextureBytes(embedded->bytes.data(), embedded->bytes.size());
+    }
+    else if (readTextureFile(key, source))
+    {
+        contentHash = hashTextureBytes(source.data(), source.size());
+    }
+    if (embedded && embedded->width > 0)
+    {
+        width = embedded->width;
+        height = embedded->height;
+        pixels = embedded->bytes.data();
+    }
+    else
+    {
+        const vector<unsigned char> &bytes = embedded ? embedded->bytes : source;
+        decoded = bytes.empty() ? NULL : stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &nrChannels, 0);
+        pixels = decoded;
+    }
+    decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!pixels)
+    {
+        std::cerr << "ERROR::texture could not load texture file\n"
+                  << key << std::endl;
+        return false;
+    }
+
+    memset((void *)&record, 0, sizeof(record));
+    record.key = addBundleString(writer, key);
+    record.width = width;
+    record.height = height;
+    record.channels = nrChannels;
+    record.contentHash = contentHash;
+    vector<uint8_t> chain;
+    record.levelCount = buildMipChain(pixels, width, height, nrChannels, chain, record.levelOffsets);
+    TextureBlockFormat blockFormat = chooseTextureBlockFormat(compression, nrChannels);
+    record.blockFormat = blockFormat;
+    if (blockFormat != TEXTURE_BLOCK_NONE)
+    {
+        // levels are compressed one after the other, so the offsets are rewritten to the compressed chain
+        vector<uint8_t> blocks;
+        int levelWidth = width, levelHeight = height;
+        for (int l = 0; l < record.levelCount; l++)
+        {
+            vector<uint8_t> level;
+            compressTextureLevel(chain.data() + record.levelOffsets[l], levelWidth, levelHeight, nrChannels, blockFormat, level);
+            record.levelOffsets[l] = blocks.size();
+            blocks.insert(blocks.end(), level.begin(), level.end());
+            levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+            levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+        }
+        chain.swap(blocks);
+    }
+    record.pixels = addBundleArray(writer, chain);
+    stbi_image_free(decoded);
+    return true;
+}
+
+// Writes the loaded data of a model, GPU-ready: vertices in their upload format and indices already 16 or 32-bit
+BundleModelRecord writeBundleModel(BundleWriter &writer, const ModelData &data)
+{
+    const Model &model = data.model;
+    BundleModelRecord record;
+    memset((void *)&record, 0, sizeof(record));
+    record.path = addBundleString(writer, data.path);
+    record.format = data.format;
+
+    vector<BundleBufferRecord> buffers;
+    for (size_t i = 0; i < data.buffers.size(); i++)
+    {
+        const ModelBufferData &buffer = data.buffers[i];
+        BundleBufferRecord bufferRecord;
+        memset((void *)&bufferRecord, 0, sizeof(bufferRecord));
+        bufferRecord.vertices = data.format == VERTEX_FORMAT_COMPACT ? addBundleArray(writer, buffer.compactVertices) : addBundleArray(writer, buffer.vertices);
+
+        // same rule as uploadIndexBuffer, so the bundle holds exactly what would be uploaded
+        size_t indexedVertices = buffer.indices.empty() ? 0 : *std::max_element(buffer.indices.begin(), buffer.indices.end()) + 1;
+        if (indexedVertices <= 65536)
+        {
+            vector<GLushort> shortIndices(buffer.indices.begin(), buffer.indices.end());
+            bufferRecord.indices = addBundleArray(writer, shortIndices);
+            bufferRecord.indexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            bufferRecord.indices = addBundleArray(writer, buffer.indices);
+            bufferRecord.indexType = GL_UNSIGNED_INT;
+        }
+        bufferRecord.skin = addBundleArray(writer, buffer.skin);
+        bufferRecord.positionOffset = buffer.decode.positionOffset;
+        bufferRecord.positionScale = buffer.decode.positionScale;
+        bufferRecord.octahedralNormals = buffer.decode.octahedralNormals;
+        buffers.push_back(bufferRecord);
+    }
+
+    vector<BundleMeshRecord> meshes;
+    vector<Meshlet> meshlets;
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        const Mesh &mesh = model.meshes[i];
+        BundleMeshRecord meshRecord;
+        memset((void *)&meshRecord, 0, sizeof(meshRecord));
+        meshRecord.name = addBundleString(writer, mesh.name);
+        meshRecord.texture = addBundleString(writer, data.meshTextures[i]);
+        meshRecord.buffer = (int32_t)data.meshBuffers[i];
+        meshRecord.vertexCount = mesh.vertexCount;
+        meshRecord.baseVertex = mesh.baseVertex;
+        meshRecord.node = mesh.node;
+        meshRecord.firstMeshlet = (int32_t)meshlets.size();
+        meshRecord.meshletCount = (int32_t)mesh.meshlets.size();
+        meshlets.insert(meshlets.end(), mesh.meshlets.begin(), mesh.meshlets.end());
+        meshRecord.lodCount = (int32_t)std::min(mesh.lods.size(), (size_t)LOD_MAX_LEVELS);
+        for (int l = 0; l < meshRecord.lodCount; l++)
+        {
+            meshRecord.lodFirstIndices[l] = mesh.lods[l].firstIndex;
+            meshRecord.lodIndexCounts[l] = mesh.lods[l].indexCount;
+            meshRecord.lodErrors[l] = mesh.lods[l].error;
+        }
+        meshRecord.boundsCenter = mesh.boundsCenter;
+        meshRecord.boundsRadius = mesh.boundsRadius;
+        meshRecord.diffuseColor = mesh.diffuseColor;
+        meshRecord.hasMaterial = mesh.hasMaterial;
+        meshes.push_back(meshRecord);
+    }
+
+    vector<BundleNodeRecord> nodes;
+    vector<int32_t> nodeMeshes;
+    for (size_t i = 0; i < model.nodes.size(); i++)
+    {
+        BundleNodeRecord nodeRecord;
+        memset((void *)&nodeRecord, 0, sizeof(nodeRecord));
+        nodeRecord.name = addBundleString(writer, model.nodes[i].name);
+        nodeRecord.parent = model.nodes[i].parent;
+        nodeRecord.firstMesh = (int32_t)nodeMeshes.size();
+        nodeRecord.meshCount = (int32_t)model.nodes[i].meshes.size();
+        nodeMeshes.insert(nodeMeshes.end(), model.nodes[i].meshes.begin(), model.nodes[i].meshes.end());
+        nodeRecord.localTransform = model.nodes[i].localTransform;
+        nodes.push_back(nodeRecord);
+    }
+
+    vector<BundleAnimationRecord> animations;
+    vector<BundleChannelRecord> channels;
+    vector<VectorKey> vectorKeys;
+    vector<RotationKey> rotationKeys;
+    for (size_t i = 0; i < model.animations.size(); i++)
+    {
+        const Animation &animation = model.animations[i];
+        BundleAnimationRecord animationRecord;
+        memset((void *)&animationRecord, 0, sizeof(animationRecord));
+        animationRecord.name = addBundleString(writer, animation.name);
+        animationRecord.firstChannel = (int32_t)channels.size();
+        animationRecord.channelCount = (int32_t)animation.channels.size();
+        animationRecord.duration = animation.duration;
+        animationRecord.ticksPerSecond = animation.ticksPerSecond;
+        animations.push_back(animationRecord);
+        for (size_t c = 0; c < animation.channels.size(); c++)
+        {
+            const AnimationChannel &channel = animation.channels[c];
+            BundleChannelRecord channelRecord;
+            channelRecord.node = channel.node;
+            channelRecord.firstPosition = (int32_t)vectorKeys.size();
+            channelRecord.positionCount = (int32_t)channel.positions.size();
+            vectorKeys.insert(vectorKeys.end(), channel.positions.begin(), channel.positions.end());
+            channelRecord.firstRotation = (int32_t)rotationKeys.size();
+            channelRecord.rotationCount = (int32_t)channel.rotations.size();
+            rotationKeys.insert(rotationKeys.end(), channel.rotations.begin(), channel.rotations.end());
+            channelRecord.firstScale = (int32_t)vectorKeys.size();
+            channelRecord.scaleCount = (int32_t)channel.scales.size();
+            vectorKeys.insert(vectorKeys.end(), channel.scales.begin(), channel.scales.end());
+            channels.push_back(channelRecord);
+        }
+    }
+
+    record.buffers = addBundleArray(writer, buffers);
+    record.meshes = addBundleArray(writer, meshes);
+    record.meshlets = addBundleArray(writer, meshlets);
+    record.nodes = addBundleArray(writer, nodes);
+    record.nodeMeshes = addBundleArray(writer, nodeMeshes);
+    record.bones = addBundleArray(writer, model.bones);
+    record.animations = addBundleArray(writer, animations);
+    record.channels = addBundleArray(writer, channels);
+    record.vectorKeys = addBundleArray(writer, vectorKeys);
+    record.rotationKeys = addBundleArray(writer, rotationKeys);
+    record.globalInverse = model.globalInverse;
+    record.boundsCenter = model.boundsCenter;
+    record.boundsRadius = model.boundsRadius;
+    return record;
 }
-// Spotlight Track multiple objects
-void setMultipleSpotlightUniforms(int program, vec3 lightPositions[3], vec3 lightDirections[3], vec3 lightColors[3], float intensities[3])
+
+// How writeAssetBundle packs what it loaded
+struct BundleWriteOptions
 {
-    glUseProgram(program);
+    bool compressChunks = false;        // LZ compress chunks that shrink by it
+    bool packReferencedTextures = true; // textures the models reference by path; embedded ones are always packed
+    TextureCompression textures = TEXTURE_COMPRESSION_NONE;
+};
 
-    for (int i = 0; i < 3; i++)
+// Loads models and textures through the usual text/FBX/JPEG loaders and packs them GPU-ready into one bundle
+// The time spent in those loaders is printed, the cost loadAssetBundle saves at startup
+// Returns false, and leaves no file, when the bundle could not be written or nothing loaded
+bool writeAssetBundle(const string &path, const vector<string> &modelPaths, const vector<string> &texturePaths, const ModelLoadOptions &options, const BundleWriteOptions &writeOptions)
+{
+    auto start = std::chrono::steady_clock::now();
+    vector<ModelData> models;
+    for (size_t i = 0; i < modelPaths.size(); i++)
     {
-        string posName = "spotlightPos[" + to_string(i) + "]";
-        string dirName = "spotlightDir[" + to_string(i) + "]";
-        string colorName = "spotlightColor[" + to_string(i) + "]";
-        string intensityName = "spotlightIntensity[" + to_string(i) + "]";
-        string cutoffName = "spotlightCutoff[" + to_string(i) + "]";
-        string outerCutoffName = "spotlightOuterCutoff[" + to_string(i) + "]";
+        const string &modelPath = modelPaths[i];
+        bool isOBJ = modelPath.size() >= 4 && modelPath.compare(modelPath.size() - 4, 4, ".obj") == 0;
+        ModelData data = isOBJ ? loadOBJModelData(modelPath, options) : loadFBXModelData(modelPath, options);
+        if (data.model.meshes.empty())
+        {
+            std::cerr << modelPath << ": nothing loaded, left out of the bundle" << std::endl;
+            continue;
+        }
+        models.push_back(std::move(data));
+    }
+    double modelSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-        GLint posLoc = glGetUniformLocation(program, posName.c_str());
-        GLint dirLoc = glGetUniformLocation(program, dirName.c_str());
-        GLint colorLoc = glGetUniformLocation(program, colorName.c_str());
-        GLint intensityLoc = glGetUniformLocation(program, intensityName.c_str());
-        GLint cutoffLoc = glGetUniformLocation(program, cutoffName.c_str());
-        GLint outerCutoffLoc = glGetUniformLocation(program, outerCutoffName.c_str());
+    BundleWriter writer;
+    if (!openBundleWriter(writer, path.c_str(), bundleRecordLayout(), writeOptions.compressChunks))
+    {
+        return false;
+    }
 
-        if (posLoc >= 0)
-            glUniform3fv(posLoc, 1, &lightPositions[i][0]);
-        if (dirLoc >= 0)
-            glUniform3fv(dirLoc, 1, &lightDirections[i][0]);
-        if (colorLoc >= 0)
-            glUniform3fv(colorLoc, 1, &lightColors[i][0]);
-        if (intensityLoc >= 0)
-            glUniform1f(intensityLoc, intensities[i]);
+    // the scene's textures, then those of the models' materials, each key once
+    vector<string> keys = texturePaths;
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        for (size_t m = 0; m < models[i].meshTextures.size(); m++)
+        {
+            const string &key = models[i].meshTextures[m];
+            bool embedded = key.compare(0, 9, "embedded:") == 0;
+            if (!key.empty() && (writeOptions.packReferencedTextures || embedded) && std::find(keys.begin(), keys.end(), key) == keys.end())
+            {
+                keys.push_back(key);
+            }
+        }
+    }
+    vector<BundleTextureRecord> textures;
+    double decodeSeconds = 0.0;
+    for (size_t k = 0; k < keys.size(); k++)
+    {
+        const EmbeddedTexture *embedded = NULL;
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            for (size_t e = 0; e < models[i].embeddedTextures.size(); e++)
+            {
+                if (models[i].embeddedTextures[e].key == keys[k])
+                {
+                    embedded = &models[i].embeddedTextures[e];
+                }
+            }
+        }
+        BundleTextureRecord record;
+        if (writeBundleTexture(writer, keys[k], embedded, writeOptions.textures, record, decodeSeconds))
+        {
+            textures.push_back(record);
+        }
+    }
 
-        // Adjust these angles to make lights cover more area
-        float innerCutoff, outerCutoff;
+    vector<BundleModelRecord> modelRecords;
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        modelRecords.push_back(writeBundleModel(writer, models[i]));
+    }
+    BundleRootRecord root;
+    root.textures = addBundleArray(writer, textures);
+    root.models = addBundleArray(writer, modelRecords);
+    int rootChunk = addBundleChunk(writer, &root, sizeof(root));
+    if (!closeBundleWriter(writer, rootChunk) || (models.empty() && textures.empty()))
+    {
+        std::cerr << "Could not write the bundle " << path << std::endl;
+        remove(path.c_str());
+        return false;
+    }
 
-        if (i == 0)
+    std::cout << "Text/FBX/JPEG path: models loaded in " << modelSeconds * 1000.0 << " ms, textures decoded in " << decodeSeconds * 1000.0 << " ms" << std::endl;
+    std::cout << path << ": " << models.size() << " models, " << textures.size() << " textures in " << writer.chunks.size() << " chunks, "
+              << writer.storedBytes / (1024.0 * 1024.0) << " MB (" << writer.rawBytes / (1024.0 * 1024.0) << " MB unpacked)" << std::endl;
+    return true;
+}
+
+// Largest index of indices[first, first + count), 0 for an empty range
+size_t maxBundleIndex(const void *indices, GLenum indexType, size_t first, size_t count)
+{
+    size_t largest = 0;
+    for (size_t i = first; i < first + count; i++)
+    {
+        size_t index = indexType == GL_UNSIGNED_SHORT ? ((const GLushort *)indices)[i] : ((const GLuint *)indices)[i];
+        largest = std::max(largest, index);
+    }
+    return largest;
+}
+
+// Checks that every index a model record holds lies inside the arrays it indexes: node, mesh, bone, channel and
+// key references, the index ranges of LODs and meshlets and the vertices those indices name, and skin weights
+// for every vertex, so a truncated or corrupt bundle is rejected before anything is uploaded instead of read out
+// of bounds while drawing
+bool validBundleModel(AssetBundle &bundle, const BundleModelRecord &record)
+{
+    size_t bufferCount, meshCount, meshletCount, nodeCount, nodeMeshCount, boneCount, animationCount, channelCount, vectorKeyCount, rotationKeyCount, indexBytes, skinCount;
+    const BundleBufferRecord *buffers = bundleArray<BundleBufferRecord>(bundle, record.buffers, bufferCount);
+    const BundleMeshRecord *meshes = bundleArray<BundleMeshRecord>(bundle, record.meshes, meshCount);
+    const Meshlet *meshlets = bundleArray<Meshlet>(bundle, record.meshlets, meshletCount);
+    const BundleNodeRecord *nodes = bundleArray<BundleNodeRecord>(bundle, record.nodes, nodeCount);
+    const int32_t *nodeMeshes = bundleArray<int32_t>(bundle, record.nodeMeshes, nodeMeshCount);
+    const SkinBone *bones = bundleArray<SkinBone>(bundle, record.bones, boneCount);
+    const BundleAnimationRecord *animations = bundleArray<BundleAnimationRecord>(bundle, record.animations, animationCount);
+    const BundleChannelRecord *channels = bundleArray<BundleChannelRecord>(bundle, record.channels, channelCount);
+    bundleArray<VectorKey>(bundle, record.vectorKeys, vectorKeyCount);
+    bundleArray<RotationKey>(bundle, record.rotationKeys, rotationKeyCount);
+
+    vector<size_t> bufferIndices(bufferCount), bufferVertices(bufferCount);
+    vector<const void *> bufferIndexData(bufferCount);
+    for (size_t i = 0; i < bufferCount; i++)
+    {
+        if (buffers[i].indexType != GL_UNSIGNED_SHORT && buffers[i].indexType != GL_UNSIGNED_INT)
         {
-            // Main center light - very wide coverage
-            innerCutoff = cos(radians(8.0f));
-            outerCutoff = cos(radians(12.0f));
+            return false;
+        }
+        bufferIndexData[i] = bundleChunkData(bundle, buffers[i].indices, indexBytes);
+        bufferIndices[i] = indexBytes / indexTypeSize(buffers[i].indexType);
+        if (record.format == VERTEX_FORMAT_COMPACT)
+        {
+            bundleArray<CompactVertex>(bundle, buffers[i].vertices, bufferVertices[i]);
+        }
+        else
+        {
+            bundleArray<TexturedColoredVertex>(bundle, buffers[i].vertices, bufferVertices[i]);
+        }
+        // skin weights are a second stream of the same vertices
+        if (bundleArray<SkinWeights>(bundle, buffers[i].skin, skinCount) && skinCount != bufferVertices[i])
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < meshCount; i++)
+    {
+        const BundleMeshRecord &mesh = meshes[i];
+        if (mesh.buffer < 0 || mesh.buffer >= (int32_t)bufferCount || mesh.node < 0 || mesh.node >= (int32_t)nodeCount ||
+            mesh.vertexCount < 0 || mesh.lodCount < 0 || mesh.lodCount > LOD_MAX_LEVELS || mesh.firstMeshlet < 0 || mesh.meshletCount < 0 ||
+            (size_t)mesh.firstMeshlet + mesh.meshletCount > meshletCount)
+        {
+            return false;
+        }
+        size_t indexCount = bufferIndices[mesh.buffer];
+        const void *indices = bufferIndexData[mesh.buffer];
+        // every index drawn, plus baseVertex, has to name a vertex of the buffer
+        size_t largest = 0, drawn = 0;
+        for (int l = 0; l < mesh.lodCount; l++)
+        {
+            if (mesh.lodFirstIndices[l] > indexCount || mesh.lodIndexCounts[l] > indexCount - mesh.lodFirstIndices[l])
+            {
+                return false;
+            }
+            largest = std::max(largest, maxBundleIndex(indices, buffers[mesh.buffer].indexType, mesh.lodFirstIndices[l], mesh.lodIndexCounts[l]));
+            drawn += mesh.lodIndexCounts[l];
+        }
+        // level 0 draws vertexCount indices from the start of the first LOD
+        size_t first = mesh.lodCount > 0 ? (size_t)mesh.lodFirstIndices[0] : 0;
+        if (first > indexCount || (size_t)mesh.vertexCount > indexCount - first)
+        {
+            return false;
+        }
+        largest = std::max(largest, maxBundleIndex(indices, buffers[mesh.buffer].indexType, first, mesh.vertexCount));
+        drawn += mesh.vertexCount;
+        for (int32_t m = mesh.firstMeshlet; m < mesh.firstMeshlet + mesh.meshletCount; m++)
+        {
+            if (meshlets[m].firstIndex > indexCount || meshlets[m].indexCount > indexCount - meshlets[m].firstIndex)
+            {
+                return false;
+            }
+            largest = std::max(largest, maxBundleIndex(indices, buffers[mesh.buffer].indexType, meshlets[m].firstIndex, meshlets[m].indexCount));
+            drawn += meshlets[m].indexCount;
+        }
+        if (mesh.baseVertex < 0 || (drawn > 0 && (size_t)mesh.baseVertex + largest >= bufferVertices[mesh.buffer]))
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < nodeCount; i++)
+    {
+        // parents come before their children, the pose is built in one pass
+        if (nodes[i].parent < -1 || nodes[i].parent >= (int32_t)i || nodes[i].firstMesh < 0 || nodes[i].meshCount < 0 ||
+            (size_t)nodes[i].firstMesh + nodes[i].meshCount > nodeMeshCount)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < nodeMeshCount; i++)
+    {
+        if (nodeMeshes[i] < 0 || nodeMeshes[i] >= (int32_t)meshCount)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < boneCount; i++)
+    {
+        if (bones[i].node < 0 || bones[i].node >= (int)nodeCount)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < animationCount; i++)
+    {
+        if (animations[i].firstChannel < 0 || animations[i].channelCount < 0 || (size_t)animations[i].firstChannel + animations[i].channelCount > channelCount)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < channelCount; i++)
+    {
+        const BundleChannelRecord &channel = channels[i];
+        if (channel.node < 0 || channel.node >= (int32_t)nodeCount || channel.firstPosition < 0 || channel.positionCount < 0 ||
+            channel.firstRotation < 0 || channel.rotationCount < 0 || channel.firstScale < 0 || channel.scaleCount < 0 ||
+            (size_t)channel.firstPosition + channel.positionCount > vectorKeyCount || (size_t)channel.firstScale + channel.scaleCount > vectorKeyCount ||
+            (size_t)channel.firstRotation + channel.rotationCount > rotationKeyCount)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Creates the GL objects of one bundled model, reading its buffers straight from the mapping
+Model uploadBundleModel(AssetBundle &bundle, const BundleModelRecord &record, TextureCache &textures)
+{
+    Model model;
+    size_t bufferCount, vertexCount, indexBytes, skinCount;
+    const BundleBufferRecord *buffers = bundleArray<BundleBufferRecord>(bundle, record.buffers, bufferCount);
+    vector<GLuint> VAOs;
+    for (size_t i = 0; i < bufferCount; i++)
+    {
+        GLuint VAO;
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+        if (record.format == VERTEX_FORMAT_COMPACT)
+        {
+            const CompactVertex *vertices = bundleArray<CompactVertex>(bundle, buffers[i].vertices, vertexCount);
+            uploadQuantizedVertexBuffer(vertices, vertexCount);
+        }
+        else
+        {
+            const TexturedColoredVertex *vertices = bundleArray<TexturedColoredVertex>(bundle, buffers[i].vertices, vertexCount);
+            VertexDecode decode;
+            uploadTexturedVertexBuffer(vertices, vertexCount * sizeof(TexturedColoredVertex), VERTEX_FORMAT_FLOAT, decode);
+        }
+
+        GLuint EBO;
+        glGenBuffers(1, &EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        const void *indices = bundleChunkData(bundle, buffers[i].indices, indexBytes);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+
+        const SkinWeights *skin = bundleArray<SkinWeights>(bundle, buffers[i].skin, skinCount);
+        if (skin)
+        {
+            uploadSkinBuffer(skin, skinCount);
+        }
+        glBindVertexArray(0);
+        VAOs.push_back(VAO);
+    }
+
+    size_t meshCount, meshletCount;
+    const BundleMeshRecord *meshes = bundleArray<BundleMeshRecord>(bundle, record.meshes, meshCount);
+    const Meshlet *meshlets = bundleArray<Meshlet>(bundle, record.meshlets, meshletCount);
+    for (size_t i = 0; i < meshCount; i++)
+    {
+        const BundleMeshRecord &meshRecord = meshes[i];
+        const BundleBufferRecord &buffer = buffers[meshRecord.buffer];
+        Mesh mesh;
+        mesh.VAO = VAOs[meshRecord.buffer];
+        mesh.vertexCount = meshRecord.vertexCount;
+        mesh.name = bundleString(bundle, meshRecord.name);
+        mesh.indexType = buffer.indexType;
+        mesh.decode.positionOffset = buffer.positionOffset;
+        mesh.decode.positionScale = buffer.positionScale;
+        mesh.decode.octahedralNormals = buffer.octahedralNormals != 0;
+        if (meshRecord.meshletCount > 0)
+        {
+            mesh.meshlets.assign(meshlets + meshRecord.firstMeshlet, meshlets + meshRecord.firstMeshlet + meshRecord.meshletCount);
+        }
+        for (int l = 0; l < meshRecord.lodCount; l++)
+        {
+            LODLevel level = {(size_t)meshRecord.lodFirstIndices[l], (size_t)meshRecord.lodIndexCounts[l], meshRecord.lodErrors[l]};
+            mesh.lods.push_back(level);
+        }
+        mesh.baseVertex = meshRecord.baseVertex;
+        mesh.boundsCenter = meshRecord.boundsCenter;
+        mesh.boundsRadius = meshRecord.boundsRadius;
+        mesh.diffuseColor = meshRecord.diffuseColor;
+        mesh.hasMaterial = meshRecord.hasMaterial != 0;
+        string key = bundleString(bundle, meshRecord.texture);
+        mesh.texture = key.empty() ? 0 : loadCachedTexture(textures, key);
+        mesh.node = meshRecord.node;
+        model.meshes.push_back(mesh);
+    }
+
+    size_t nodeCount, nodeMeshCount;
+    const BundleNodeRecord *nodes = bundleArray<BundleNodeRecord>(bundle, record.nodes, nodeCount);
+    const int32_t *nodeMeshes = bundleArray<int32_t>(bundle, record.nodeMeshes, nodeMeshCount);
+    for (size_t i = 0; i < nodeCount; i++)
+    {
+        ModelNode node;
+        node.name = bundleString(bundle, nodes[i].name);
+        node.parent = nodes[i].parent;
+        node.localTransform = nodes[i].localTransform;
+        if (nodes[i].meshCount > 0)
+        {
+            node.meshes.assign(nodeMeshes + nodes[i].firstMesh, nodeMeshes + nodes[i].firstMesh + nodes[i].meshCount);
+        }
+        model.nodes.push_back(node);
+    }
+
+    size_t boneCount;
+    const SkinBone *bones = bundleArray<SkinBone>(bundle, record.bones, boneCount);
+    model.bones.assign(bones, bones + boneCount);
+
+    size_t animationCount, channelCount, vectorKeyCount, rotationKeyCount;
+    const BundleAnimationRecord *animations = bundleArray<BundleAnimationRecord>(bundle, record.animations, animationCount);
+    const BundleChannelRecord *channels = bundleArray<BundleChannelRecord>(bundle, record.channels, channelCount);
+    const VectorKey *vectorKeys = bundleArray<VectorKey>(bundle, record.vectorKeys, vectorKeyCount);
+    const RotationKey *rotationKeys = bundleArray<RotationKey>(bundle, record.rotationKeys, rotationKeyCount);
+    for (size_t i = 0; i < animationCount; i++)
+    {
+        Animation animation;
+        animation.name = bundleString(bundle, animations[i].name);
+        animation.duration = animations[i].duration;
+        animation.ticksPerSecond = animations[i].ticksPerSecond;
+        for (int32_t c = animations[i].firstChannel; c < animations[i].firstChannel + animations[i].channelCount; c++)
+        {
+            const BundleChannelRecord &channelRecord = channels[c];
+            AnimationChannel channel;
+            channel.node = channelRecord.node;
+            channel.positions.assign(vectorKeys + channelRecord.firstPosition, vectorKeys + channelRecord.firstPosition + channelRecord.positionCount);
+            channel.rotations.assign(rotationKeys + channelRecord.firstRotation, rotationKeys + channelRecord.firstRotation + channelRecord.rotationCount);
+            channel.scales.assign(vectorKeys + channelRecord.firstScale, vectorKeys + channelRecord.firstScale + channelRecord.scaleCount);
+            animation.channels.push_back(channel);
+        }
+        model.animations.push_back(animation);
+    }
+
+    model.globalInverse = record.globalInverse;
+    model.boundsCenter = record.boundsCenter;
+    model.boundsRadius = record.boundsRadius;
+    model.loaded = true;
+    return model;
+}
+
+// Maps a bundle written by --write-bundle and creates every texture and model in it straight from the mapping
+// Textures go into the cache under their original key, so loading them by path afterwards is a cache hit;
+// models go into models under the path they were built from
+bool loadAssetBundle(const string &path, TextureCache &textures, map<string, Model> &models)
+{
+    double start = glfwGetTime();
+    AssetBundle bundle;
+    size_t rootCount;
+    const BundleRootRecord *root = NULL;
+    if (openAssetBundle(path.c_str(), bundleRecordLayout(), bundle))
+    {
+        root = bundleArray<BundleRootRecord>(bundle, bundle.header->rootChunk, rootCount);
+    }
+    if (!root)
+    {
+        std::cerr << path << ": not a usable bundle, loading the source assets instead" << std::endl;
+        closeAssetBundle(bundle);
+        return false;
+    }
+
+    size_t textureCount, modelCount, pixelBytes;
+    size_t textureBytes = 0, uncompressedBytes = 0;
+    const BundleTextureRecord *textureRecords = bundleArray<BundleTextureRecord>(bundle, root->textures, textureCount);
+    for (size_t i = 0; i < textureCount; i++)
+    {
+        const BundleTextureRecord &record = textureRecords[i];
+        const unsigned char *pixels = (const unsigned char *)bundleChunkData(bundle, record.pixels, pixelBytes);
+        TextureBlockFormat blockFormat = (TextureBlockFormat)record.blockFormat;
+        bool valid = pixels && record.levelCount >= 1 && record.levelCount <= BUNDLE_MAX_LEVELS && textureFormat(record.channels) != 0 &&
+                     blockFormat >= TEXTURE_BLOCK_NONE && blockFormat <= TEXTURE_BLOCK_BC7;
+        if (valid)
+        {
+            // every level has to lie inside the chunk, the last one ends it
+            size_t levelWidth = record.width, levelHeight = record.height;
+            for (int l = 0; l < record.levelCount && valid; l++)
+            {
+                valid = record.levelOffsets[l] + textureLevelBytes(blockFormat, (int)levelWidth, (int)levelHeight, record.channels) <= pixelBytes;
+                levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+                levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+            }
+        }
+        const char *key = bundleString(bundle, record.key);
+        if (!valid)
+        {
+            std::cerr << path << ": texture " << key << " has a bad bundle record, skipped" << std::endl;
+            continue;
+        }
+        map<string, GLuint>::const_iterator cached = textures.textures.find(key);
+        if (cached != textures.textures.end() && cached->second != 0)
+        {
+            continue; // meshes already hold the loaded texture
+        }
+        // the same chain as RGBA8 is what the texture would take uncompressed
+        size_t rgbaBytes = 0, levelBytes = 0;
+        for (int l = 0, w = record.width, h = record.height; l < record.levelCount; l++, w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+        {
+            rgbaBytes += (size_t)w * h * 4;
+            levelBytes += textureLevelBytes(TEXTURE_BLOCK_NONE, w, h, record.channels);
+        }
+        if (blockFormat == TEXTURE_BLOCK_NONE)
+        {
+            textures.textures[key] = uploadTextureLevels(pixels, record.levelOffsets, record.levelCount, record.width, record.height, record.channels, textures.options);
+        }
+        else
+        {
+            textures.textures[key] = uploadCompressedTextureLevels(pixels, record.levelOffsets, record.levelCount, record.width, record.height, blockFormat, textures.options, levelBytes);
+            std::cout << key << ": " << textureBlockFormatName(blockFormat) << (compressedTextureFormat(blockFormat) ? "" : " (decoded, the driver lacks the format)") << ", "
+                      << levelBytes / 1024.0 << " KB of VRAM instead of " << rgbaBytes / 1024.0 << " KB as RGBA8" << std::endl;
+        }
+        addRegisteredTexture(textures.registry, key, record.contentHash, textures.textures[key]);
+        textureBytes += levelBytes;
+        uncompressedBytes += rgbaBytes;
+    }
+    if (textureCount > 0)
+    {
+        std::cout << path << ": textures take " << textureBytes / (1024.0 * 1024.0) << " MB of VRAM, " << uncompressedBytes / (1024.0 * 1024.0) << " MB as RGBA8" << std::endl;
+    }
+
+    const BundleModelRecord *modelRecords = bundleArray<BundleModelRecord>(bundle, root->models, modelCount);
+    for (size_t i = 0; i < modelCount; i++)
+    {
+        const char *modelPath = bundleString(bundle, modelRecords[i].path);
+        if (!validBundleModel(bundle, modelRecords[i]))
+        {
+            std::cerr << path << ": model " << modelPath << " has a bad bundle record, loading its source instead" << std::endl;
+            continue;
+        }
+        models[modelPath] = uploadBundleModel(bundle, modelRecords[i], textures);
+    }
+
+    std::cout << path << ": " << textureCount << " textures and " << modelCount << " models uploaded from a "
+              << bundle.file.size / (1024.0 * 1024.0) << " MB mapping (" << bundle.unpackedBytes / (1024.0 * 1024.0) << " MB unpacked) in "
+              << (glfwGetTime() - start) * 1000.0 << " ms, ready " << glfwGetTime() * 1000.0 << " ms after startup" << std::endl;
+    closeAssetBundle(bundle);
+    return true;
+}
+
+// Offline cooking (--cook): every model and texture under Models/ and Textures/ becomes its own bundle in a
+// content-addressed cache. A bundle is named after the hash of the asset's path, source files and cook settings,
+// so only assets where one of those changed are cooked again, and undoing a change finds the old bundle still there.
+const char *COOK_MODEL_EXTENSIONS[] = {".obj", ".fbx", ".dae", ".gltf", ".glb", ".3ds"};
+const char *COOK_TEXTURE_EXTENSIONS[] = {".jpg", ".jpeg", ".png", ".tga", ".bmp"};
+
+struct CookResult
+{
+    bool isModel = false;
+    string path; // Source, relative to the working directory like the paths the scene loads
+    string key;  // Hash naming the cooked bundle
+    bool cached = false;
+    bool failed = false;
+    double seconds = 0.0;
+};
+
+// Case-insensitive check of path's extension against a list such as COOK_MODEL_EXTENSIONS
+bool hasExtension(const string &path, const char *const extensions[], size_t count)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos)
+    {
+        return false;
+    }
+    string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (extension == extensions[i])
+            return true;
+    }
+    return false;
+}
+
+// Appends the files of directory to out, and those of its subdirectories when recursive, sorted
+void listFiles(const string &directory, bool recursive, vector<string> &out)
+{
+    vector<string> files, subdirectories;
+#ifdef _WIN32
+    _finddata_t entry;
+    intptr_t search = _findfirst((directory + "/*").c_str(), &entry);
+    if (search == -1)
+    {
+        return;
+    }
+    do
+    {
+        string name = entry.name;
+        if (name == "." || name == "..")
+            continue;
+        string path = directory + "/" + name;
+        if (entry.attrib & _A_SUBDIR)
+            subdirectories.push_back(path);
+        else
+            files.push_back(path);
+    } while (_findnext(search, &entry) == 0);
+    _findclose(search);
+#else
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+    {
+        return;
+    }
+    while (dirent *entry = readdir(dir))
+    {
+        string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            subdirectories.push_back(path);
+        else if (S_ISREG(info.st_mode))
+            files.push_back(path);
+    }
+    closedir(dir);
+#endif
+    for (size_t i = 0; recursive && i < subdirectories.size(); i++)
+    {
+        listFiles(subdirectories[i], true, files);
+    }
+    std::sort(files.begin(), files.end());
+    out.insert(out.end(), files.begin(), files.end());
+}
+
+// Continues hash over the bytes of a file, false when it cannot be read
+bool hashFile(const string &path, uint64_t &hash)
+{
+    MappedFile file;
+    if (!openMappedFile(path.c_str(), file))
+    {
+        return false;
+    }
+    hash = hashTextureBytes((const unsigned char *)file.data, file.size, hash);
+    closeMappedFile(file);
+    return true;
+}
+
+// What an asset's cooked bundle depends on, empty when the source cannot be read
+// An OBJ also depends on the .mtl libraries next to it; textures referenced by a model are assets of their own
+string cookKey(const CookResult &asset, const string &settings)
+{
+    string header = settings + "\n" + asset.path + "\n";
+    uint64_t hash = hashTextureBytes((const unsigned char *)header.data(), header.size());
+    if (!hashFile(asset.path, hash))
+    {
+        return string();
+    }
+    const char *obj[] = {".obj"}, *mtl[] = {".mtl"};
+    if (hasExtension(asset.path, obj, 1))
+    {
+        vector<string> neighbours;
+        listFiles(directoryOf(asset.path) + ".", false, neighbours);
+        for (size_t i = 0; i < neighbours.size(); i++)
+        {
+            if (hasExtension(neighbours[i], mtl, 1))
+                hashFile(neighbours[i], hash);
+        }
+    }
+    char key[32];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+    return key;
+}
+
+// Cook settings as text, hashed into every key: whatever changes the bundle of an asset belongs here
+string cookSettings(bool isModel, const ModelLoadOptions &options, const BundleWriteOptions &writeOptions)
+{
+    char settings[256];
+    if (isModel)
+        snprintf(settings, sizeof(settings), "model bundle %u layout %08x format %d meshlets %d profile %s merge %d textures %s lz", BUNDLE_VERSION,
+                 bundleRecordLayout(), (int)options.format, (int)options.buildClusters, importProfileName(options.profile), (int)options.mergeMeshes,
+                 textureCompressionName(writeOptions.textures));
+    else
+        snprintf(settings, sizeof(settings), "texture bundle %u layout %08x mips %s lz", BUNDLE_VERSION, bundleRecordLayout(), textureCompressionName(writeOptions.textures));
+    return settings;
+}
+
+// Cooks one asset into directory, unless a bundle with its key is already there
+CookResult cookAsset(CookResult asset, const string &directory, const ModelLoadOptions &options, const BundleWriteOptions &writeOptions)
+{
+    auto start = std::chrono::steady_clock::now();
+    asset.key = cookKey(asset, cookSettings(asset.isModel, options, writeOptions));
+    string bundlePath = directory + "/" + asset.key + ".bundle";
+    FILE *exists = asset.key.empty() ? NULL : fopen(bundlePath.c_str(), "rb");
+    if (exists)
+    {
+        fclose(exists);
+        asset.cached = true;
+    }
+    else if (!asset.key.empty())
+    {
+        // written under another name and renamed once complete, so an interrupted cook never leaves a bundle behind
+        string temporary = bundlePath + ".tmp";
+        vector<string> models, textures;
+        (asset.isModel ? models : textures).push_back(asset.path);
+        asset.failed = !writeAssetBundle(temporary, models, textures, options, writeOptions) || rename(temporary.c_str(), bundlePath.c_str()) != 0;
+    }
+    else
+    {
+        asset.failed = true;
+    }
+    asset.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return asset;
+}
+
+// Cooks every model and texture under Models/ and Textures/ into directory on all cores, and lists them in
+// directory/manifest.txt for --cooked. Returns false when an asset failed to cook.
+bool cookAssets(const string &directory, const ModelLoadOptions &options, TextureCompression textureCompression)
+{
+    // each asset gets its own bundle, so the textures a model references are cooked on their own
+    BundleWriteOptions writeOptions;
+    writeOptions.compressChunks = true;
+    writeOptions.packReferencedTextures = false;
+    writeOptions.textures = textureCompression;
+    auto start = std::chrono::steady_clock::now();
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+
+    vector<string> files;
+    listFiles("Models", true, files);
+    listFiles("Textures", true, files);
+    vector<CookResult> assets;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        CookResult asset;
+        asset.path = files[i];
+        asset.isModel = hasExtension(files[i], COOK_MODEL_EXTENSIONS, sizeof(COOK_MODEL_EXTENSIONS) / sizeof(COOK_MODEL_EXTENSIONS[0]));
+        if (asset.isModel || hasExtension(files[i], COOK_TEXTURE_EXTENSIONS, sizeof(COOK_TEXTURE_EXTENSIONS) / sizeof(COOK_TEXTURE_EXTENSIONS[0])))
+            assets.push_back(asset);
+    }
+
+    AsyncLoadQueue<CookResult> cooker;
+    startAsyncLoader(cooker, 0);
+    for (size_t i = 0; i < assets.size(); i++)
+    {
+        CookResult asset = assets[i];
+        submitAsyncLoad<CookResult>(cooker, (int)i, [asset, directory, options, writeOptions]()
+                                    { return cookAsset(asset, directory, options, writeOptions); });
+    }
+    size_t finished = 0, cooked = 0, cached = 0, failed = 0;
+    double cookSeconds = 0.0;
+    while (finished < assets.size())
+    {
+        int id;
+        CookResult result;
+        if (!popFinishedLoad(cooker, id, result))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        assets[id] = result;
+        finished++;
+        cookSeconds += result.seconds;
+        if (result.failed)
+        {
+            failed++;
+            std::cerr << result.path << ": failed to cook" << std::endl;
+        }
+        else if (result.cached)
+        {
+            cached++;
         }
         else
         {
-            // Orbiting lights - medium wide coverage
-            innerCutoff = cos(radians(5.0f));
-            outerCutoff = cos(radians(8.0f));
+            cooked++;
+            std::cout << result.path << ": cooked in " << result.seconds * 1000.0 << " ms" << std::endl;
         }
+    }
+    stopAsyncLoader(cooker);
 
-        if (cutoffLoc >= 0)
-            glUniform1f(cutoffLoc, innerCutoff);
-        if (outerCutoffLoc >= 0)
-            glUniform1f(outerCutoffLoc, outerCutoff);
+    string manifestPath = directory + "/manifest.txt";
+    FILE *manifest = fopen((manifestPath + ".tmp").c_str(), "w");
+    if (!manifest)
+    {
+        std::cerr << "Could not write " << manifestPath << std::endl;
+        return false;
+    }
+    // textures first, so the models referencing them find them in the cache
+    for (int models = 0; models < 2; models++)
+    {
+        for (size_t i = 0; i < assets.size(); i++)
+        {
+            if (!assets[i].failed && assets[i].isModel == (models == 1))
+                fprintf(manifest, "%s %s %s\n", assets[i].isModel ? "model" : "texture", assets[i].key.c_str(), assets[i].path.c_str());
+        }
     }
+    bool written = fclose(manifest) == 0 && rename((manifestPath + ".tmp").c_str(), manifestPath.c_str()) == 0;
+
+    std::cout << directory << ": " << assets.size() << " assets, " << cooked << " cooked, " << cached << " up to date, " << failed << " failed in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0 << " ms ("
+              << cookSeconds * 1000.0 << " ms of work across " << cooker.workers.size() << " threads)" << std::endl;
+    return written && failed == 0;
 }
 
-struct TexturedColoredVertex
+// Loads every bundle a --cook run listed in directory/manifest.txt
+bool loadCookedAssets(const string &directory, TextureCache &textures, map<string, Model> &models)
 {
-    TexturedColoredVertex(vec3 _position, vec3 _normal, vec2 _uv)
-        : position(_position), normal(_normal), uv(_uv)
+    string manifestPath = directory + "/manifest.txt";
+    FILE *manifest = fopen(manifestPath.c_str(), "r");
+    if (!manifest)
+    {
+        std::cerr << "No cooked assets in " << directory << ", run with --cook " << directory << " first" << std::endl;
+        return false;
+    }
+    double start = glfwGetTime();
+    vector<string> textureBundles, modelBundles;
+    char line[1024];
+    while (fgets(line, sizeof(line), manifest))
+    {
+        char kind[16], key[32];
+        if (sscanf(line, "%15s %31s", kind, key) == 2)
+            (strcmp(kind, "texture") == 0 ? textureBundles : modelBundles).push_back(directory + "/" + key + ".bundle");
+    }
+    fclose(manifest);
+    // textures before models whatever the manifest's order, or the models would decode their textures from the sources
+    textureBundles.insert(textureBundles.end(), modelBundles.begin(), modelBundles.end());
+    size_t loaded = 0;
+    for (size_t i = 0; i < textureBundles.size(); i++)
     {
+        if (loadAssetBundle(textureBundles[i], textures, models))
+            loaded++;
     }
+    std::cout << directory << ": " << loaded << " cooked bundles uploaded in " << (glfwGetTime() - start) * 1000.0 << " ms" << std::endl;
+    return true;
+}
 
-    vec3 position;
-    vec3 normal;
-    vec2 uv;
-};
+// --texture-benchmark flies the camera along a fixed path over the scene twice: first sampling only level 0 of every
+// texture with GL_LINEAR (how textures used to be loaded), then with the mip chains, trilinear and anisotropic filtering.
+// GPU time per frame comes from timer queries; with the geometry the same in both passes, the difference is the
+// texture fetch bandwidth the mips save on minified surfaces such as the distant ground.
+const float TEXTURE_BENCHMARK_SECONDS = 10.0f; // per pass
+const int TEXTURE_BENCHMARK_QUERIES = 3;       // frames in flight before a result is read
 
-// New structs to handle multiple meshes
-struct Mesh
+struct TextureBenchmark
 {
-    GLuint VAO;
-    int vertexCount;
-    string name; // Add a name to identify the mesh
+    bool running = false;
+    int pass = 0; // 0: level 0 only, 1: mipmapped
+    double passStart = 0.0;
+    int frame = 0; // Frames of the current pass, also picks the query
+    GLuint queries[TEXTURE_BENCHMARK_QUERIES];
+    bool timerQueries = false;
+    double gpuSeconds[2] = {0.0, 0.0};
+    double frameSeconds[2] = {0.0, 0.0};
+    int frames[2] = {0, 0};
 };
 
-struct Model
+// Sets the sampling of every texture in the cache, each created with a full mip chain
+void setCachedTextureSampling(const TextureCache &cache, const TextureOptions &options)
 {
-    std::vector<Mesh> meshes;
-};
+    for (map<string, GLuint>::const_iterator it = cache.textures.begin(); it != cache.textures.end(); ++it)
+    {
+        if (it->second == 0)
+            continue;
+        glBindTexture(GL_TEXTURE_2D, it->second);
+        applyTextureSampling(options, BUNDLE_MAX_LEVELS);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-// A new function to load a model using Assimp
-Model setupFBXModel(const std::string &path)
+// Camera of the fly-through seconds into a pass: a low circle over the ground, looking ahead and slightly down
+void flyThroughCamera(double seconds, vec3 &position, vec3 &lookAt)
 {
-    Model model;
-    Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    float angle = (float)(seconds / TEXTURE_BENCHMARK_SECONDS) * radians(360.0f);
+    position = vec3(4.0f * cosf(angle), 0.8f + 0.5f * sinf(2.0f * angle), 4.0f * sinf(angle));
+    lookAt = normalize(vec3(-sinf(angle), -0.2f, cosf(angle)));
+}
 
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+void startTextureBenchmark(TextureBenchmark &benchmark, const TextureCache &cache, const TextureOptions &options)
+{
+    benchmark.running = true;
+    benchmark.timerQueries = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+    if (benchmark.timerQueries)
     {
-        std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
-        return model;
+        glGenQueries(TEXTURE_BENCHMARK_QUERIES, benchmark.queries);
     }
+    glfwSwapInterval(0); // frame times, not the display's refresh rate
+    TextureOptions levelZero = options;
+    levelZero.mipmaps = false;
+    setCachedTextureSampling(cache, levelZero);
+    benchmark.passStart = glfwGetTime();
+}
 
-    // std::cout << "Loading model from: " << path << std::endl;
-    // std::cout << "Assimp found " << scene->mNumMeshes << " meshes." << std::endl;
-
-    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+void beginTextureBenchmarkFrame(TextureBenchmark &benchmark)
+{
+    if (benchmark.timerQueries)
     {
-        aiMesh *mesh = scene->mMeshes[i];
-
-        // std::cout << "Processing mesh " << i << " with " << mesh->mNumVertices << " vertices and " << mesh->mNumFaces << " faces." << std::endl;
-
-        std::vector<glm::vec3> vertices;
-        std::vector<glm::vec3> normals;
-        std::vector<glm::vec2> uvs;
-        std::vector<int> indices;
-
-        for (unsigned int j = 0; j < mesh->mNumVertices; j++)
-        {
-            vertices.push_back(glm::vec3(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z));
-            if (mesh->HasNormals())
-            {
-                normals.push_back(glm::vec3(mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z));
-            }
-            if (mesh->HasTextureCoords(0))
-            {
-                uvs.push_back(glm::vec2(mesh->mTextureCoords[0][j].x, mesh->mTextureCoords[0][j].y));
-            }
-        }
-
-        for (unsigned int j = 0; j < mesh->mNumFaces; j++)
-        {
-            aiFace face = mesh->mFaces[j];
-            for (unsigned int k = 0; k < face.mNumIndices; k++)
-            {
-                indices.push_back(face.mIndices[k]);
-            }
-        }
-
-        GLuint VAO;
-        glGenVertexArrays(1, &VAO);
-        glBindVertexArray(VAO);
-
-        GLuint vertices_VBO;
-        glGenBuffers(1, &vertices_VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, vertices_VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices.front(), GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid *)0);
-        glEnableVertexAttribArray(0);
-
-        GLuint normals_VBO;
-        glGenBuffers(1, &normals_VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normals_VBO);
-        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals.front(), GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid *)0);
-        glEnableVertexAttribArray(1);
-
-        GLuint uvs_VBO;
-        glGenBuffers(1, &uvs_VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvs_VBO);
-        glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs.front(), GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid *)0);
-        glEnableVertexAttribArray(2);
-
-        GLuint EBO;
-        glGenBuffers(1, &EBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices.front(), GL_STATIC_DRAW);
-
-        glBindVertexArray(0);
-        model.meshes.push_back({VAO, (int)indices.size(), mesh->mName.C_Str()});
-        // std::cout << "Successfully loaded mesh " << i << " with name '" << mesh->mName.C_Str() << "'. Vertex count: " << indices.size() << std::endl;
+        glBeginQuery(GL_TIME_ELAPSED, benchmark.queries[benchmark.frame % TEXTURE_BENCHMARK_QUERIES]);
     }
-
-    return model;
 }
 
-GLuint setupModelVBO(string path, int &vertexCount)
+// Adds the GPU time of frame of the current pass, waiting for it if needed
+void collectTextureBenchmarkFrame(TextureBenchmark &benchmark, int frame)
 {
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> UVs;
-
-    // read the vertex data from the model's OBJ file
-    loadOBJ(path.c_str(), vertices, normals, UVs);
-
-    GLuint VAO;
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO); // Becomes active VAO
-    // Bind the Vertex Array Object first, then bind and set vertex buffer(s) and attribute pointer(s).
-
-    // Vertex VBO setup
-    GLuint vertices_VBO;
-    glGenBuffers(1, &vertices_VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, vertices_VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices.front(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid *)0);
-    glEnableVertexAttribArray(0);
-
-    // Normals VBO setup
-    GLuint normals_VBO;
-    glGenBuffers(1, &normals_VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, normals_VBO);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals.front(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid *)0);
-    glEnableVertexAttribArray(1);
-
-    // UVs VBO setup
-    GLuint uvs_VBO;
-    glGenBuffers(1, &uvs_VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, uvs_VBO);
-    glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs.front(), GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid *)0);
-    glEnableVertexAttribArray(2);
-
-    glBindVertexArray(0); // Unbind VAO (it's always a good thing to unbind any buffer/array to prevent strange bugs, as we are using multiple VAOs)
-    vertexCount = vertices.size();
-    return VAO;
+    if (!benchmark.timerQueries)
+    {
+        return;
+    }
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(benchmark.queries[frame % TEXTURE_BENCHMARK_QUERIES], GL_QUERY_RESULT, &elapsed);
+    benchmark.gpuSeconds[benchmark.pass] += elapsed * 1e-9;
 }
 
-// Sets up a model using an Element Buffer Object to refer to vertex data
-GLuint setupModelEBO(string path, int &vertexCount)
+// Ends a benchmark frame of dt seconds; switches to the mipmapped pass and then prints the results
+// Returns false once both passes are done
+bool endTextureBenchmarkFrame(TextureBenchmark &benchmark, const TextureCache &cache, const TextureOptions &options, float dt)
 {
-    vector<int> vertexIndices; // The contiguous sets of three indices of vertices, normals and UVs, used to make a triangle
-    vector<glm::vec3> vertices;
-    vector<glm::vec3> normals;
-    vector<glm::vec2> UVs;
-
-    // read the vertices from the cube.obj file
-    // We won't be needing the normals or UVs for this program
-    loadOBJ2(path.c_str(), vertexIndices, vertices, normals, UVs);
-
-    GLuint VAO;
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO); // Becomes active VAO
-    // Bind the Vertex Array Object first, then bind and set vertex buffer(s) and attribute pointer(s).
-
-    // Vertex VBO setup
-    GLuint vertices_VBO;
-    glGenBuffers(1, &vertices_VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, vertices_VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices.front(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid *)0);
-    glEnableVertexAttribArray(0);
-
-    // Normals VBO setup
-    GLuint normals_VBO;
-    glGenBuffers(1, &normals_VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, normals_VBO);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals.front(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid *)0);
-    glEnableVertexAttribArray(1);
-
-    // UVs VBO setup
-    GLuint uvs_VBO;
-    glGenBuffers(1, &uvs_VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, uvs_VBO);
-    glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs.front(), GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid *)0);
-    glEnableVertexAttribArray(2);
+    if (benchmark.timerQueries)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        if (benchmark.frame >= TEXTURE_BENCHMARK_QUERIES - 1)
+        {
+            collectTextureBenchmarkFrame(benchmark, benchmark.frame - (TEXTURE_BENCHMARK_QUERIES - 1));
+        }
+    }
+    benchmark.frameSeconds[benchmark.pass] += dt;
+    benchmark.frames[benchmark.pass]++;
+    benchmark.frame++;
+    if (glfwGetTime() - benchmark.passStart < TEXTURE_BENCHMARK_SECONDS)
+    {
+        return true;
+    }
 
-    // EBO setup
-    GLuint EBO;
-    glGenBuffers(1, &EBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, vertexIndices.size() * sizeof(int), &vertexIndices.front(), GL_STATIC_DRAW);
+    // the frames still in flight belong to this pass
+    for (int frame = std::max(0, benchmark.frame - (TEXTURE_BENCHMARK_QUERIES - 1)); frame < benchmark.frame; frame++)
+    {
+        collectTextureBenchmarkFrame(benchmark, frame);
+    }
+    if (benchmark.pass == 0)
+    {
+        setCachedTextureSampling(cache, options);
+        benchmark.pass = 1;
+        benchmark.frame = 0;
+        benchmark.passStart = glfwGetTime();
+        return true;
+    }
 
-    glBindVertexArray(0); // Unbind VAO (it's always a good thing to unbind any buffer/array to prevent strange bugs), remember: do NOT unbind the EBO, keep it bound to this VAO
-    vertexCount = vertexIndices.size();
-    return VAO;
+    const char *names[2] = {"level 0 only", "mipmapped"};
+    for (int pass = 0; pass < 2; pass++)
+    {
+        int frames = std::max(1, benchmark.frames[pass]);
+        std::cout << "Texture benchmark, " << names[pass] << ": " << benchmark.frames[pass] << " frames, " << benchmark.frameSeconds[pass] / frames * 1000.0 << " ms per frame";
+        if (benchmark.timerQueries)
+            std::cout << ", " << benchmark.gpuSeconds[pass] / frames * 1000.0 << " ms of GPU time";
+        std::cout << std::endl;
+    }
+    if (benchmark.timerQueries && benchmark.gpuSeconds[0] > 0.0)
+    {
+        double before = benchmark.gpuSeconds[0] / std::max(1, benchmark.frames[0]);
+        double after = benchmark.gpuSeconds[1] / std::max(1, benchmark.frames[1]);
+        std::cout << "Mipmapped textures (anisotropy " << std::max(1.0f, std::min(options.anisotropy, maxTextureAnisotropy())) << ") take "
+                  << (1.0 - after / before) * 100.0 << "% less GPU time per frame" << std::endl;
+        glDeleteQueries(TEXTURE_BENCHMARK_QUERIES, benchmark.queries);
+    }
+    benchmark.running = false;
+    return false;
 }
 
 const TexturedColoredVertex texturedPrism2VertexArray[] = {
@@ -770,7 +4036,7 @@ vec3 prism1VertexArray[] = {                           // position,
     vec3(-0.5f, 0.5f, -0.5f), vec3(0.5f, 0.5f, 0.5f),
     vec3(-0.5f, 0.5f, 0.5f), vec3(0.5f, 0.5f, 0.5f)};
 
-int createTexturedVertexArrayObject(const TexturedColoredVertex *vertexArray, int arraySize)
+int createTexturedVertexArrayObject(const TexturedColoredVertex *vertexArray, int arraySize, VertexDecode &decode, VertexFormat format)
 {
     // Create a vertex array
     GLuint vertexArrayObject;
@@ -778,34 +4044,7 @@ int createTexturedVertexArrayObject(const TexturedColoredVertex *vertexArray, in
     glBindVertexArray(vertexArrayObject);
 
     // Upload Vertex Buffer to the GPU, keep a reference to it (vertexBufferObject)
-    GLuint vertexBufferObject;
-    glGenBuffers(1, &vertexBufferObject);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
-    glBufferData(GL_ARRAY_BUFFER, arraySize, vertexArray, GL_STATIC_DRAW);
-    glVertexAttribPointer(0,                                                // attribute 0 matches aPos in Vertex Shader
-                          3,                                                // size
-                          GL_FLOAT,                                         // type
-                          GL_FALSE,                                         // normalized?
-                          sizeof(TexturedColoredVertex),                    // stride
-                          (void *)offsetof(TexturedColoredVertex, position) // array buffer offset
-    );
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, // attribute 1 matches aNormal in Vertex Shader
-                          3,
-                          GL_FLOAT,
-                          GL_FALSE,
-                          sizeof(TexturedColoredVertex),
-                          (void *)offsetof(TexturedColoredVertex, normal));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, // attribute 2 matches aUV in Vertex Shader
-                          2,
-                          GL_FLOAT,
-                          GL_FALSE,
-                          sizeof(TexturedColoredVertex),
-                          (void *)offsetof(TexturedColoredVertex, uv));
-    glEnableVertexAttribArray(2);
+    uploadTexturedVertexBuffer(vertexArray, arraySize, format, decode);
 
     return vertexArrayObject;
 }
@@ -880,6 +4119,102 @@ int createVertexArrayObject(const glm::vec3 *vertexArray, int arraySize)
 
 int main(int argc, char *argv[])
 {
+    // Vertex layout for every mesh, --float-vertices keeps the full 32-byte vertices
+    // --meshlets splits the loaded models into clusters culled on the CPU every frame
+    // --import-profile <fast-load|optimized-render|minimal-memory> picks the Assimp post-processing of the plane
+    // --compare-import-profiles imports the plane with every profile and prints their cost first
+    // --merge-meshes packs all meshes of a model into one VBO and EBO, drawn under a single VAO bind
+    // --write-bundle <file> packs the scene's models and textures GPU-ready into a bundle and exits (--compress-bundle LZ compresses its chunks)
+    // --bundle <file> uploads the models and textures in the bundle straight from its mapping instead of loading their sources
+    VertexFormat vertexFormat = VERTEX_FORMAT_COMPACT;
+    bool useMeshlets = false;
+    ModelLoadOptions modelOptions;
+    // --cook <dir> cooks every asset under Models/ and Textures/ into a bundle cache in dir on all cores, skipping unchanged ones, and exits
+    // --cooked <dir> uploads the cooked bundles listed in dir like --bundle
+    // --no-mipmaps samples only level 0 of every texture, --anisotropy <n> caps anisotropic filtering (default 16, 1 turns it off)
+    // --texture-benchmark flies a fixed path without then with mips and prints the GPU time per frame of each, then exits
+    // --texture-compression <none|bc|bc7> block compresses the textures of --write-bundle (default none) and --cook (default bc)
+    // --texture-array packs the material textures into one texture array, so draws switch a layer instead of binding a texture
+    // --texture-budget <MB> keeps textures within that much VRAM, evicting and trimming the mips of cold ones (default 0, off)
+    // --texture-stream-budget <KB> caps the texture bytes streamed to the GPU per frame once the scene is up (default 2048, 0 loads them at once)
+    string writeBundlePath, bundlePath, cookPath, cookedPath;
+    BundleWriteOptions bundleOptions;
+    bool importProfileChosen = false;
+    bool textureCompressionChosen = false;
+    TextureOptions textureOptions;
+    bool textureBenchmark = false;
+    bool useTextureArray = false;
+    size_t textureStreamBudget = 2048 * 1024;
+    size_t textureBudget = 0;
+    size_t streamCeiling = 0; // --stream-obj, 0 loads OBJ models whole
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--float-vertices")
+            vertexFormat = VERTEX_FORMAT_FLOAT;
+        if (string(argv[i]) == "--meshlets")
+            useMeshlets = true;
+        if (string(argv[i]) == "--merge-meshes")
+            modelOptions.mergeMeshes = true;
+        if (string(argv[i]) == "--import-profile")
+            importProfileChosen = true;
+        if (string(argv[i]) == "--import-profile" && i + 1 < argc && !parseImportProfile(argv[++i], modelOptions.profile))
+            std::cerr << "Unknown import profile " << argv[i] << ", using " << importProfileName(modelOptions.profile) << std::endl;
+        if (string(argv[i]) == "--compare-import-profiles")
+            compareImportProfiles("Models/plane.fbx");
+        if (string(argv[i]) == "--write-bundle" && i + 1 < argc)
+            writeBundlePath = argv[++i];
+        if (string(argv[i]) == "--compress-bundle")
+            bundleOptions.compressChunks = true;
+        if (string(argv[i]) == "--texture-compression")
+            textureCompressionChosen = true;
+        if (string(argv[i]) == "--texture-compression" && i + 1 < argc && !parseTextureCompression(argv[++i], bundleOptions.textures))
+            std::cerr << "Unknown texture compression " << argv[i] << ", using " << textureCompressionName(bundleOptions.textures) << std::endl;
+        if (string(argv[i]) == "--bundle" && i + 1 < argc)
+            bundlePath = argv[++i];
+        if (string(argv[i]) == "--cook" && i + 1 < argc)
+            cookPath = argv[++i];
+        if (string(argv[i]) == "--cooked" && i + 1 < argc)
+            cookedPath = argv[++i];
+        if (string(argv[i]) == "--no-mipmaps")
+            textureOptions.mipmaps = false;
+        if (string(argv[i]) == "--anisotropy" && i + 1 < argc)
+            textureOptions.anisotropy = (float)atof(argv[++i]);
+        if (string(argv[i]) == "--texture-benchmark")
+            textureBenchmark = true;
+        if (string(argv[i]) == "--texture-array")
+            useTextureArray = true;
+        if (string(argv[i]) == "--texture-stream-budget" && i + 1 < argc)
+            textureStreamBudget = (size_t)std::max(0, atoi(argv[++i])) * 1024;
+        if (string(argv[i]) == "--stream-obj" && i + 1 < argc)
+            streamCeiling = (size_t)std::max(0, atoi(argv[++i])) << 20;
+        if (string(argv[i]) == "--texture-budget" && i + 1 < argc)
+            textureBudget = (size_t)(std::max(0.0, atof(argv[++i])) * 1024.0 * 1024.0);
+    }
+    modelOptions.format = vertexFormat;
+    modelOptions.buildClusters = useMeshlets;
+    if (textureBudget > 0)
+    {
+        textureOptions.immutableStorage = false; // the residency manager respecifies the levels of a texture in place
+    }
+
+    // Assets of the scene, loaded below from their sources or from a bundle
+    string planePath = "Models/plane.fbx";
+    string cubePath = "Models/cube.obj";
+    const vector<string> sceneModels = {planePath, cubePath};
+    const vector<string> sceneTextures = {"Textures/brick.jpg", "Textures/cement.jpg", "Textures/stone.jpg", "Textures/granite.jpg",
+                                          "Textures/soilsand.jpg", "Textures/wood.jpg", "Textures/plane.png"};
+    if (!writeBundlePath.empty())
+    {
+        return writeAssetBundle(writeBundlePath, sceneModels, sceneTextures, modelOptions, bundleOptions) ? 0 : -1;
+    }
+    if (!cookPath.empty())
+    {
+        // cooked meshes are welded and cache ordered unless another profile was asked for
+        ModelLoadOptions cookOptions = modelOptions;
+        if (!importProfileChosen)
+            cookOptions.profile = IMPORT_PROFILE_OPTIMIZED_RENDER;
+        return cookAssets(cookPath, cookOptions, textureCompressionChosen ? bundleOptions.textures : TEXTURE_COMPRESSION_BC) ? 0 : -1;
+    }
 
     // Initialize GLFW and OpenGL version
     if (!glfwInit())
@@ -915,14 +4250,56 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    // Load Textures
-    GLuint brickTextureID = loadTexture("Textures/brick.jpg");
-    GLuint cementTextureID = loadTexture("Textures/cement.jpg");
-    GLuint stoneTextureID = loadTexture("Textures/stone.jpg");
-    GLuint graniteTextureID = loadTexture("Textures/granite.jpg");
-    GLuint sandTextureID = loadTexture("Textures/soilsand.jpg");
-    GLuint woodTextureID = loadTexture("Textures/wood.jpg");
-    GLuint planeTextureID = loadTexture("Textures/plane.png");
+    // Models and textures of the bundle go straight to the GPU, the texture loads below then hit the cache
+    TextureCache textureCache;
+    textureCache.options = textureOptions;
+    if (textureBenchmark)
+    {
+        textureCache.options.mipmaps = true; // the benchmark switches between level 0 and the mips of the same textures
+    }
+    map<string, Model> bundledModels;
+    if (!bundlePath.empty())
+    {
+        loadAssetBundle(bundlePath, textureCache, bundledModels);
+    }
+    if (!cookedPath.empty())
+    {
+        loadCookedAssets(cookedPath, textureCache, bundledModels);
+    }
+
+    // Load Textures, decoded together on every core; the lookups below then hit the cache
+    double textureStart = glfwGetTime();
+    loadCachedTextures(textureCache, sceneTextures);
+    GLuint brickTextureID = loadCachedTexture(textureCache, "Textures/brick.jpg");
+    GLuint cementTextureID = loadCachedTexture(textureCache, "Textures/cement.jpg");
+    GLuint stoneTextureID = loadCachedTexture(textureCache, "Textures/stone.jpg");
+    GLuint graniteTextureID = loadCachedTexture(textureCache, "Textures/granite.jpg");
+    GLuint sandTextureID = loadCachedTexture(textureCache, "Textures/soilsand.jpg");
+    GLuint woodTextureID = loadCachedTexture(textureCache, "Textures/wood.jpg");
+    GLuint planeTextureID = loadCachedTexture(textureCache, "Textures/plane.png");
+    std::cout << "Textures ready in " << (glfwGetTime() - textureStart) * 1000.0 << " ms" << std::endl;
+    printTextureRegistryStats(textureCache.registry);
+    MaterialTextureArray materialTextures;
+    if (useTextureArray)
+    {
+        materialTextures = buildMaterialTextureArray(textureCache);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, materialTextures.texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Textures first needed from here on, by the models still loading, are streamed in without stalling a frame
+    TextureStreamer textureStreamer;
+    if (textureStreamBudget > 0)
+    {
+        startTextureStreamer(textureStreamer, textureStreamBudget, textureCache.options);
+        textureCache.streamer = &textureStreamer;
+    }
+    TextureResidency textureResidency;
+    if (textureBudget > 0)
+    {
+        startTextureResidency(textureResidency, textureCache, textureBudget, 600.0f); // the window's height
+    }
 
     // Black background
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -932,25 +4309,64 @@ int main(int argc, char *argv[])
     // Compile and link shaders here ...
     int colorShaderProgram = compileAndLinkShaders(getVertexShaderSource(), getFragmentShaderSource());
     int texturedShaderProgram = compileAndLinkShaders(getTexturedVertexShaderSource(), getTexturedFragmentShaderSource());
+    // samplers of different types may not share a unit, so the array sampler reads unit 1 even when it is unused
+    int programs[] = {shaderProgram, colorShaderProgram, texturedShaderProgram};
+    for (int i = 0; i < 3; i++)
+    {
+        glUseProgram(programs[i]);
+        glUniform1i(glGetUniformLocation(programs[i], "textureArraySampler"), 1);
+    }
 
     // int lightShaderProgram = compileAndLinkShaders(getLightVertexShaderSource(), getLightFragmentShaderSource());
 
+    // Models are parsed on worker threads and uploaded a few per frame, the scene draws their placeholder bounds until then
+    AsyncLoadQueue<ModelData> modelLoader;
+    startAsyncLoader(modelLoader, 2);
+
     // Plane model setup
-    string planePath = "Models/plane.fbx";
-    Model planeModel = setupFBXModel(planePath);
+    Model planeModel;
+    planeModel.boundsCenter = vec3(0.0f);
+    planeModel.boundsRadius = 2.5f;
+    if (bundledModels.count(planePath))
+        planeModel = bundledModels[planePath];
+    else
+        loadModelAsync(modelLoader, 0, planePath, modelOptions);
 
     // Use a pointer to the active model
     const Model *activeModel = &planeModel;
 
-    // Setup models
-    string cubePath = "Models/cube.obj";
+    // Animated plane nodes, resolved to handles once the plane is loaded
+    int propellerNode = -1, cockpitNode = -1;
+    bool planeNodesBound = false;
+    vector<mat4> planeNodeMotion; // Extra transform of every plane node for this frame, indexed by handle
+    SkinPose planePose;           // Bone palette of each plane instance, when the model is skinned
 
     // Load models as EBOs
-    int cubeVertices;
-    GLuint cubeVAO = setupModelEBO(cubePath, cubeVertices);
-
-    int activeVAOVertices = cubeVertices;
-    GLuint activeVAO = cubeVAO;
+    Model cubeModel;
+    cubeModel.boundsCenter = vec3(0.0f);
+    cubeModel.boundsRadius = 5.0f;
+    if (bundledModels.count(cubePath))
+        cubeModel = bundledModels[cubePath];
+    else if (streamCeiling == 0)
+        loadModelAsync(modelLoader, 1, cubePath, modelOptions);
+    else if (!setupOBJModelStreamed(cubePath, streamCeiling, cubeModel))
+        std::cerr << cubePath << ": could not be streamed under the --stream-obj ceiling, left on its placeholder bounds" << std::endl;
+
+    // Model each load id is uploaded into
+    Model *loadingModels[] = {&planeModel, &cubeModel};
+    bool firstFrameShown = false;
+
+    // Use a pointer to the active cube model
+    const Model *activeCubeModel = &cubeModel;
+
+    // Triangles submitted vs drawn by meshlet culling, printed on exit
+    MeshletCullStats meshletStats;
+
+    // Level of detail of every drawn object, and triangles saved by it, printed every few seconds
+    LODSelection planeLOD[2], cubeLOD[3];
+    LODStats lodStats;
+    BindStats bindStats;
+    float lastLODReportTime = glfwGetTime();
 
     // Camera parameters for view transform
     vec3 cameraPosition(0.6f, 1.0f, 10.0f);
@@ -994,11 +4410,17 @@ int main(int argc, char *argv[])
     setProjectionMatrix(texturedShaderProgram, projectionMatrix);
 
     // Define and upload geometry to the GPU here ...
-    int texturedPyramidVAO = createTexturedVertexArrayObject(texturedPyramidVertexArray, sizeof(texturedPyramidVertexArray));
-    int texturedVaoTetra = createTexturedVertexArrayObject(texturedTetraVertexArray, sizeof(texturedTetraVertexArray));
-    int texturedVaoPrism = createTexturedVertexArrayObject(texturedPrism2VertexArray, sizeof(texturedPrism2VertexArray));
+    VertexDecode pyramidDecode, tetraDecode, prismDecode, groundDecode;
+    int texturedPyramidVAO = createTexturedVertexArrayObject(texturedPyramidVertexArray, sizeof(texturedPyramidVertexArray), pyramidDecode, vertexFormat);
+    int texturedVaoTetra = createTexturedVertexArrayObject(texturedTetraVertexArray, sizeof(texturedTetraVertexArray), tetraDecode, vertexFormat);
+    int texturedVaoPrism = createTexturedVertexArrayObject(texturedPrism2VertexArray, sizeof(texturedPrism2VertexArray), prismDecode, vertexFormat);
+
+    int texturedGround = createTexturedVertexArrayObject(texturedGroundVertexArray, sizeof(texturedGroundVertexArray), groundDecode, vertexFormat);
 
-    int texturedGround = createTexturedVertexArrayObject(texturedGroundVertexArray, sizeof(texturedGroundVertexArray));
+    printVertexFormatSavings("pyramid", sizeof(texturedPyramidVertexArray) / sizeof(TexturedColoredVertex), 0, vertexFormatSize(vertexFormat), 0);
+    printVertexFormatSavings("tetra", sizeof(texturedTetraVertexArray) / sizeof(TexturedColoredVertex), 0, vertexFormatSize(vertexFormat), 0);
+    printVertexFormatSavings("prism", sizeof(texturedPrism2VertexArray) / sizeof(TexturedColoredVertex), 0, vertexFormatSize(vertexFormat), 0);
+    printVertexFormatSavings("ground", sizeof(texturedGroundVertexArray) / sizeof(TexturedColoredVertex), 0, vertexFormatSize(vertexFormat), 0);
 
     GLuint lightVAO, lightVBO, lightEBO;
     glGenVertexArrays(1, &lightVAO);
@@ -1032,6 +4454,12 @@ int main(int argc, char *argv[])
     // Container for projectiles to be implemented in tutorial
     list<Projectile> projectileList;
 
+    TextureBenchmark benchmark;
+    if (textureBenchmark)
+    {
+        startTextureBenchmark(benchmark, textureCache, textureCache.options);
+    }
+
     // Entering Main Loop
     while (!glfwWindowShouldClose(window))
     {
@@ -1039,6 +4467,29 @@ int main(int argc, char *argv[])
         float dt = glfwGetTime() - lastFrameTime;
         lastFrameTime += dt;
 
+        // Upload the models the loader finished since the last frame, within the frame's budget
+        uploadFinishedModels(modelLoader, loadingModels, textureCache, MODEL_UPLOAD_BUDGET);
+        if (textureCache.streamer)
+        {
+            updateTextureStreamer(textureStreamer);
+        }
+        if (planeModel.loaded && !planeNodesBound)
+        {
+            propellerNode = findNode(planeModel, "Propeller.001");
+            cockpitNode = findNode(planeModel, "Cylinder.001");
+            planeNodeMotion.assign(planeModel.nodes.size(), mat4(1.0f));
+            planeNodesBound = true;
+        }
+
+        // The benchmark flies the camera, whatever the inputs
+        if (benchmark.running)
+        {
+            flyThroughCamera(glfwGetTime() - benchmark.passStart, cameraPosition, cameraLookAt);
+            viewMatrix = lookAt(cameraPosition, cameraPosition + cameraLookAt, cameraUp);
+            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
+            beginTextureBenchmarkFrame(benchmark);
+        }
+
         // Each frame, reset color of each pixel to glClearColor
 
         // @TODO 1 - Clear Depth Buffer Bit as well
@@ -1051,6 +4502,12 @@ int main(int argc, char *argv[])
         setViewMatrix(texturedShaderProgram, viewMatrix);
         setViewMatrix(colorShaderProgram, viewMatrix);
 
+        // Meshlets are culled against this frame's camera
+        mat4 viewProjection = projectionMatrix * viewMatrix;
+        meshletStats.frames++;
+        lodStats.frames++;
+        bindStats.frames++;
+
         // Draw light source
         // glUseProgram(lightShaderProgram);
 
@@ -1105,11 +4562,13 @@ int main(int argc, char *argv[])
         // Draw ground
         glUseProgram(texturedShaderProgram);
         glUniform1i(glGetUniformLocation(texturedShaderProgram, "useTexture"), 1);
-        glBindTexture(GL_TEXTURE_2D, stoneTextureID);
+        bindMaterialTexture(texturedShaderProgram, materialTextures, stoneTextureID, bindStats);
         glBindVertexArray(texturedGround);
+        setVertexDecode(texturedShaderProgram, groundDecode);
         mat4 groundWorldMatrix = translate(mat4(1.0f), vec3(0.0f, -0.01f, 0.0f)) * scale(mat4(1.0f), vec3(10.0f, 0.02f, 10.0f));
         GLuint worldMatrixLocation = glGetUniformLocation(texturedShaderProgram, "worldMatrix");
         glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &groundWorldMatrix[0][0]);
+        touchResidentTexture(textureResidency, stoneTextureID, projectedScreenSize(groundWorldMatrix, vec3(0.0f), PRIMITIVE_RADIUS, cameraPosition, projectionMatrix));
         glDrawArrays(GL_TRIANGLES, 0, 36); // 6 vertices for the ground, not 36
                                            // 36 vertices, starting at index 0
 
@@ -1119,16 +4578,20 @@ int main(int argc, char *argv[])
 
         // Draw prism
         glBindVertexArray(texturedVaoPrism);
-        glBindTexture(GL_TEXTURE_2D, woodTextureID);
+        bindMaterialTexture(texturedShaderProgram, materialTextures, woodTextureID, bindStats);
+        setVertexDecode(texturedShaderProgram, prismDecode);
         mat4 prismWorldMatrix = translate(mat4(1.0f), vec3(0.0f, 0.5f, 0.8f)) * scale(mat4(1.0f), vec3(1.0f, 1.0f, 1.0f));
         setWorldMatrix(texturedShaderProgram, prismWorldMatrix);
+        touchResidentTexture(textureResidency, woodTextureID, projectedScreenSize(prismWorldMatrix, vec3(0.0f), PRIMITIVE_RADIUS, cameraPosition, projectionMatrix));
         glDrawArrays(GL_TRIANGLES, 0, 36);
 
         // Draw tetra
         glBindVertexArray(texturedVaoTetra);
-        glBindTexture(GL_TEXTURE_2D, graniteTextureID);
+        bindMaterialTexture(texturedShaderProgram, materialTextures, graniteTextureID, bindStats);
+        setVertexDecode(texturedShaderProgram, tetraDecode);
         mat4 tetraWorldMatrix = translate(mat4(1.0f), vec3(2.0f, 0.7f, -1.5f)) * scale(mat4(1.0f), vec3(0.7f, 0.7f, 0.7f));
         setWorldMatrix(texturedShaderProgram, tetraWorldMatrix);
+        touchResidentTexture(textureResidency, graniteTextureID, projectedScreenSize(tetraWorldMatrix, vec3(0.0f), PRIMITIVE_RADIUS, cameraPosition, projectionMatrix));
         glDrawArrays(GL_TRIANGLES, 0, 12);
 
         // Draw spinning tetra
@@ -1136,17 +4599,20 @@ int main(int argc, char *argv[])
         for (int i = 0; i < 4; i++)
         {
             glBindVertexArray(texturedVaoTetra);
-            glBindTexture(GL_TEXTURE_2D, brickTextureID);
+            bindMaterialTexture(texturedShaderProgram, materialTextures, brickTextureID, bindStats);
             mat4 spinTetraWorldMatrix = glm::rotate(mat4(1.0f), radians(i * 120.f + 0.5f * spinningCubeAngle), vec3(0.0f, 1.0f, 0.0f)) * translate(mat4(1.0f), vec3(2.8f, 2.0f, 0.f)) * scale(mat4(1.0f), vec3(0.3f, 0.3f, 0.3f));
             setWorldMatrix(texturedShaderProgram, spinTetraWorldMatrix);
+            touchResidentTexture(textureResidency, brickTextureID, projectedScreenSize(spinTetraWorldMatrix, vec3(0.0f), PRIMITIVE_RADIUS, cameraPosition, projectionMatrix));
             glDrawArrays(GL_TRIANGLES, 0, 12);
         }
 
         // Draw pyramid
         glBindVertexArray(texturedPyramidVAO);
-        glBindTexture(GL_TEXTURE_2D, sandTextureID);
+        bindMaterialTexture(texturedShaderProgram, materialTextures, sandTextureID, bindStats);
+        setVertexDecode(texturedShaderProgram, pyramidDecode);
         mat4 pyramidWorldMatrix = translate(mat4(1.0f), vec3(-2.0f, 0.5f, -1.f)) * scale(mat4(1.0f), vec3(1.0f, 1.0f, 1.0f));
         setWorldMatrix(texturedShaderProgram, pyramidWorldMatrix);
+        touchResidentTexture(textureResidency, sandTextureID, projectedScreenSize(pyramidWorldMatrix, vec3(0.0f), PRIMITIVE_RADIUS, cameraPosition, projectionMatrix));
         glDrawArrays(GL_TRIANGLES, 0, 18);
 
         // Draw the plane model
@@ -1178,26 +4644,44 @@ int main(int argc, char *argv[])
                                    glm::scale(mat4(1.0f),
                                               vec3(0.5f));
 
-            glBindTexture(GL_TEXTURE_2D, planeTextureID);
+            bindMaterialTexture(texturedShaderProgram, materialTextures, planeTextureID, bindStats);
 
-            for (const auto &mesh : activeModel->meshes)
+            // one level for the whole plane, from its size on screen
+            float planeScreenSize = projectedScreenSize(baseModelMatrix, activeModel->boundsCenter, activeModel->boundsRadius, cameraPosition, projectionMatrix);
+            int planeLevel = selectLOD(planeLOD[0], planeScreenSize, LOD_MAX_LEVELS);
+            if (!activeModel->loaded)
             {
-                mat4 finalWorldMatrix = baseModelMatrix;
+                drawPlaceholderBounds(colorShaderProgram, lightVAO, baseModelMatrix, *activeModel);
+            }
 
-                if (mesh.name == "Propeller.001")
-                {
-                    finalWorldMatrix = finalWorldMatrix * glm::translate(mat4(1.0f), vec3(0.0f, -0.25f, 2.0f)) * glm::rotate(mat4(1.0f), radians(propellerAngle), vec3(0.0f, 0.0f, 1.0f));
-                }
+            // motion of the animated nodes, shared by both planes
+            if (propellerNode >= 0)
+            {
+                planeNodeMotion[propellerNode] = glm::translate(mat4(1.0f), vec3(0.0f, -0.25f, 2.0f)) * glm::rotate(mat4(1.0f), radians(propellerAngle), vec3(0.0f, 0.0f, 1.0f));
+            }
+            if (cockpitNode >= 0)
+            {
+                planeNodeMotion[cockpitNode] = glm::translate(mat4(1.0f), vec3(0.0f, 0.5f, -1.2f)) * glm::scale(mat4(1.0f), vec3(1.5f, 1.0f, 1.0f));
+            }
 
-                if (mesh.name == "Cylinder.001")
-                {
-                    // cockpit
-                    finalWorldMatrix = finalWorldMatrix * glm::translate(mat4(1.0f), vec3(0.0f, 0.5f, -1.2f)) * glm::scale(mat4(1.0f), vec3(1.5f, 1.0f, 1.0f));
-                }
+            // a skinned plane costs one palette upload per instance, posed by its first animation
+            if (!activeModel->bones.empty())
+            {
+                poseSkeleton(*activeModel, 0, currentTime, planePose);
+                setSkinning(texturedShaderProgram, planePose.palette);
+            }
+
+            GLuint boundVAO = 0; // merged meshes share one VAO, bound once per plane
+            GLuint boundTexture = planeTextureID;
+            for (const auto &mesh : activeModel->meshes)
+            {
+                mat4 finalWorldMatrix = baseModelMatrix * planeNodeMotion[mesh.node];
 
                 setWorldMatrix(texturedShaderProgram, finalWorldMatrix);
-                glBindVertexArray(mesh.VAO);
-                glDrawElements(GL_TRIANGLES, mesh.vertexCount, GL_UNSIGNED_INT, 0);
+                bindMeshVertexArray(texturedShaderProgram, mesh, boundVAO, bindStats);
+                bindMeshTexture(texturedShaderProgram, materialTextures, mesh, planeTextureID, boundTexture, bindStats);
+                touchResidentTexture(textureResidency, boundTexture, planeScreenSize);
+                drawMesh(mesh, planeLevel, makeMeshletFrustum(viewProjection, finalWorldMatrix, cameraPosition), meshletStats, lodStats);
             }
 
             // new angle for the second plane, behind the first
@@ -1218,66 +4702,88 @@ int main(int argc, char *argv[])
                                     glm::scale(mat4(1.0f),
                                                vec3(0.5f));
 
-            // loop through the meshes again to draw the second plane
-            for (const auto &mesh : activeModel->meshes)
+            float secondPlaneScreenSize = projectedScreenSize(baseModelMatrix2, activeModel->boundsCenter, activeModel->boundsRadius, cameraPosition, projectionMatrix);
+            int secondPlaneLevel = selectLOD(planeLOD[1], secondPlaneScreenSize, LOD_MAX_LEVELS);
+            if (!activeModel->loaded)
             {
-                mat4 finalWorldMatrix = baseModelMatrix2;
-
-                if (mesh.name == "Propeller.001")
-                {
-                    finalWorldMatrix = finalWorldMatrix * glm::translate(mat4(1.0f), vec3(0.0f, -0.25f, 2.0f)) * glm::rotate(mat4(1.0f), radians(propellerAngle), vec3(0.0f, 0.0f, 1.0f));
-                }
+                drawPlaceholderBounds(colorShaderProgram, lightVAO, baseModelMatrix2, *activeModel);
+            }
 
-                if (mesh.name == "Cylinder.001")
-                {
-                    finalWorldMatrix = finalWorldMatrix * glm::translate(mat4(1.0f), vec3(0.0f, 0.5f, -1.2f)) * glm::scale(mat4(1.0f), vec3(1.5f, 1.0f, 1.0f));
-                }
+            // loop through the meshes again to draw the second plane, half a second behind in its animation
+            if (!activeModel->bones.empty())
+            {
+                poseSkeleton(*activeModel, 0, currentTime - 0.5f, planePose);
+                setSkinning(texturedShaderProgram, planePose.palette);
+            }
+            boundVAO = 0;
+            for (const auto &mesh : activeModel->meshes)
+            {
+                mat4 finalWorldMatrix = baseModelMatrix2 * planeNodeMotion[mesh.node];
 
                 setWorldMatrix(texturedShaderProgram, finalWorldMatrix);
-                glBindVertexArray(mesh.VAO);
-                glDrawElements(GL_TRIANGLES, mesh.vertexCount, GL_UNSIGNED_INT, 0);
+                bindMeshVertexArray(texturedShaderProgram, mesh, boundVAO, bindStats);
+                bindMeshTexture(texturedShaderProgram, materialTextures, mesh, planeTextureID, boundTexture, bindStats);
+                touchResidentTexture(textureResidency, boundTexture, secondPlaneScreenSize);
+                drawMesh(mesh, secondPlaneLevel, makeMeshletFrustum(viewProjection, finalWorldMatrix, cameraPosition), meshletStats, lodStats);
             }
             glBindTexture(GL_TEXTURE_2D, 0);
+            if (!activeModel->bones.empty())
+            {
+                setSkinning(texturedShaderProgram, vector<mat4>());
+            }
         }
 
         glBindTexture(GL_TEXTURE_2D, 0); // This unbinds any active texture
 
-        // Draw colored geometry
-        glUseProgram(colorShaderProgram);                                       // Use color shader program
-        glUniform1i(glGetUniformLocation(colorShaderProgram, "useTexture"), 0); // Disable texture usage in color shader
+        // Draw the cubes, in their color unless the model has .mtl materials
+        glUseProgram(texturedShaderProgram);
 
         // Spinning cube at camera position
 
-        // Draw spinning model
-        glBindVertexArray(activeVAO);
-        GLuint objectColorLocation = glGetUniformLocation(colorShaderProgram, "objectColor");
-
         // Draw center cube (red)
-        glUniform3f(objectColorLocation, 1.0f, 0.0f, 0.0f);
         mat4 CentreCube = glm::translate(mat4(1.0f), vec3(0.0f, 6.0f, 0.0f)) *
                           glm::rotate(mat4(1.0f), radians(spinningCubeAngle), vec3(0.0f, 1.0f, 0.0f)) *
                           glm::rotate(mat4(1.0f), radians(-90.0f), vec3(1.0f, 0.0f, 0.0f)) *
                           glm::scale(mat4(1.0f), vec3(0.1f));
-        setWorldMatrix(colorShaderProgram, CentreCube);
-        glDrawElements(GL_TRIANGLES, activeVAOVertices, GL_UNSIGNED_INT, 0);
+        setWorldMatrix(texturedShaderProgram, CentreCube);
+        float centreCubeSize = projectedScreenSize(CentreCube, activeCubeModel->boundsCenter, activeCubeModel->boundsRadius, cameraPosition, projectionMatrix);
+        int centreCubeLevel = selectLOD(cubeLOD[0], centreCubeSize, LOD_MAX_LEVELS);
+        touchModelTextures(textureResidency, *activeCubeModel, centreCubeSize);
+        drawModelMeshes(texturedShaderProgram, *activeCubeModel, centreCubeLevel, vec3(1.0f, 0.0f, 0.0f), materialTextures, makeMeshletFrustum(viewProjection, CentreCube, cameraPosition), meshletStats, lodStats, bindStats);
+        if (!activeCubeModel->loaded)
+        {
+            drawPlaceholderBounds(colorShaderProgram, lightVAO, CentreCube, *activeCubeModel);
+        }
 
         // Draw OrbitingCube1 (Green)
-        glUniform3f(objectColorLocation, 0.0f, 1.0f, 0.0f);
         mat4 OrbitingCube1 = glm::translate(mat4(1.0f), orbitingCube1Position) *
                              glm::rotate(mat4(1.0f), radians(spinningCubeAngle), vec3(0.0f, 1.0f, 0.0f)) *
                              glm::rotate(mat4(1.0f), radians(-90.0f), vec3(1.0f, 0.0f, 0.0f)) *
                              glm::scale(mat4(1.0f), vec3(0.07f));
-        setWorldMatrix(colorShaderProgram, OrbitingCube1);
-        glDrawElements(GL_TRIANGLES, activeVAOVertices, GL_UNSIGNED_INT, 0);
+        setWorldMatrix(texturedShaderProgram, OrbitingCube1);
+        float orbitingCube1Size = projectedScreenSize(OrbitingCube1, activeCubeModel->boundsCenter, activeCubeModel->boundsRadius, cameraPosition, projectionMatrix);
+        int orbitingCube1Level = selectLOD(cubeLOD[1], orbitingCube1Size, LOD_MAX_LEVELS);
+        touchModelTextures(textureResidency, *activeCubeModel, orbitingCube1Size);
+        drawModelMeshes(texturedShaderProgram, *activeCubeModel, orbitingCube1Level, vec3(0.0f, 1.0f, 0.0f), materialTextures, makeMeshletFrustum(viewProjection, OrbitingCube1, cameraPosition), meshletStats, lodStats, bindStats);
+        if (!activeCubeModel->loaded)
+        {
+            drawPlaceholderBounds(colorShaderProgram, lightVAO, OrbitingCube1, *activeCubeModel);
+        }
 
         // Draw OrbitingCube2 (Blue)
-        glUniform3f(objectColorLocation, 0.0f, 0.0f, 1.0f);
         mat4 OrbitingCube2 = glm::translate(mat4(1.0f), orbitingCube2Position) *
                              glm::rotate(mat4(1.0f), radians(spinningCubeAngle), vec3(0.0f, 1.0f, 0.0f)) *
                              glm::rotate(mat4(1.0f), radians(-90.0f), vec3(1.0f, 0.0f, 0.0f)) *
                              glm::scale(mat4(1.0f), vec3(0.04f));
-        setWorldMatrix(colorShaderProgram, OrbitingCube2);
-        glDrawElements(GL_TRIANGLES, activeVAOVertices, GL_UNSIGNED_INT, 0);
+        setWorldMatrix(texturedShaderProgram, OrbitingCube2);
+        float orbitingCube2Size = projectedScreenSize(OrbitingCube2, activeCubeModel->boundsCenter, activeCubeModel->boundsRadius, cameraPosition, projectionMatrix);
+        int orbitingCube2Level = selectLOD(cubeLOD[2], orbitingCube2Size, LOD_MAX_LEVELS);
+        touchModelTextures(textureResidency, *activeCubeModel, orbitingCube2Size);
+        drawModelMeshes(texturedShaderProgram, *activeCubeModel, orbitingCube2Level, vec3(0.0f, 0.0f, 1.0f), materialTextures, makeMeshletFrustum(viewProjection, OrbitingCube2, cameraPosition), meshletStats, lodStats, bindStats);
+        if (!activeCubeModel->loaded)
+        {
+            drawPlaceholderBounds(colorShaderProgram, lightVAO, OrbitingCube2, *activeCubeModel);
+        }
 
         glBindVertexArray(0);
 
@@ -1298,9 +4804,36 @@ int main(int argc, char *argv[])
          glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &spinningCube3WorldMatrix[0][0]);
          glDrawArrays(GL_TRIANGLES, 0, 36);*/
 
+        // Report triangles saved by LOD selection every 5 seconds
+        if (glfwGetTime() - lastLODReportTime > 5.0f)
+        {
+            printLODStats(lodStats);
+            printBindStats(bindStats);
+            if (textureResidency.budget > 0)
+            {
+                printTextureResidency(textureResidency);
+            }
+            lodStats = LODStats();
+            bindStats = BindStats();
+            lastLODReportTime = glfwGetTime();
+        }
+
+        // Shrink and grow textures for the draws of this frame
+        updateTextureResidency(textureResidency);
+
+        if (benchmark.running && !endTextureBenchmarkFrame(benchmark, textureCache, textureCache.options, dt))
+        {
+            glfwSetWindowShouldClose(window, true);
+        }
+
         // End Frame
         glfwSwapBuffers(window);
         glfwPollEvents();
+        if (!firstFrameShown)
+        {
+            std::cout << "First frame shown " << glfwGetTime() * 1000.0 << " ms after startup" << std::endl;
+            firstFrameShown = true;
+        }
 
         // Handle inputs
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -1407,6 +4940,23 @@ int main(int argc, char *argv[])
         glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
     }
 
+    if (useMeshlets)
+    {
+        printMeshletCullStats(meshletStats);
+    }
+
+    // Wait for a model still loading, its data is dropped
+    stopAsyncLoader(modelLoader);
+    if (textureCache.streamer)
+    {
+        stopTextureStreamer(textureStreamer);
+    }
+    if (textureResidency.budget > 0)
+    {
+        stopAsyncLoader(textureResidency.loader);
+        printTextureResidency(textureResidency);
+    }
+
     // Shutdown GLFW
     glfwTerminate();
 
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// A few worker threads running load jobs in the background. Each job returns
+// its result by value; finished results wait in a queue until the owning
+// thread (the GL thread for models) polls them with popFinishedLoad, so the
+// caller never shares anything with a job while it runs.
+
+template <typename Result>
+struct AsyncLoadQueue {
+	std::vector<std::thread> workers;
+	std::deque<std::pair<int, std::function<Result()> > > pending; // (id, job)
+	std::deque<std::pair<int, Result> > finished;                  // (id, result)
+	std::mutex mutex;
+	std::condition_variable wake;
+	size_t running = 0;
+	bool stopping = false;
+};
+
+template <typename Result>
+void runAsyncLoads(AsyncLoadQueue<Result> * queue) {
+	std::unique_lock<std::mutex> lock(queue->mutex);
+	while (true) {
+		queue->wake.wait(lock, [queue] { return queue->stopping || !queue->pending.empty(); });
+		if (queue->pending.empty())
+			return; // stopping and nothing left to run
+		std::pair<int, std::function<Result()> > job = std::move(queue->pending.front());
+		queue->pending.pop_front();
+		queue->running++;
+		lock.unlock();
+		Result result = job.second();
+		lock.lock();
+		queue->running--;
+		queue->finished.push_back(std::make_pair(job.first, std::move(result)));
+	}
+}
+
+// threadCount 0 uses every core
+template <typename Result>
+void startAsyncLoader(AsyncLoadQueue<Result> & queue, int threadCount) {
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 0; i < threadCount; i++)
+		queue.workers.push_back(std::thread(runAsyncLoads<Result>, &queue));
+}
+
+// Queues job to run on a worker, its result comes back from popFinishedLoad with the same id
+template <typename Result>
+void submitAsyncLoad(AsyncLoadQueue<Result> & queue, int id, std::function<Result()> job) {
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.pending.push_back(std::make_pair(id, std::move(job)));
+	}
+	queue.wake.notify_one();
+}
+
+// Takes the oldest finished result, never blocks
+template <typename Result>
+bool popFinishedLoad(AsyncLoadQueue<Result> & queue, int & id, Result & result) {
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.finished.empty())
+		return false;
+	id = queue.finished.front().first;
+	result = std::move(queue.finished.front().second);
+	queue.finished.pop_front();
+	return true;
+}
+
+// Jobs queued, running or finished but not popped yet
+template <typename Result>
+size_t asyncLoadsRemaining(AsyncLoadQueue<Result> & queue) {
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	return queue.pending.size() + queue.running + queue.finished.size();
+}
+
+// Drops the jobs that have not started and waits for the running ones
+template <typename Result>
+void stopAsyncLoader(AsyncLoadQueue<Result> & queue) {
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.pending.clear();
+		queue.stopping = true;
+	}
+	queue.wake.notify_all();
+	for (size_t i = 0; i < queue.workers.size(); i++)
+		queue.workers[i].join();
+	queue.workers.clear();
+}
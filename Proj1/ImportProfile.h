@@ -0,0 +1,117 @@
+#pragma once
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/config.h>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <stdio.h>
+
+// Named sets of Assimp post-processing steps, picked per model or for a whole
+// run (--import-profile). The mesh optimizer, meshlets and LODs still run on
+// whatever Assimp returns, so a profile only changes the import itself.
+
+enum ImportProfile {
+	IMPORT_PROFILE_FAST_LOAD,        // triangulate and flip UVs, nothing else
+	IMPORT_PROFILE_OPTIMIZED_RENDER, // welded, cache ordered, meshes merged per node and split to 16-bit indices
+	IMPORT_PROFILE_MINIMAL_MEMORY,   // welded, unused vertex components dropped, split to 16-bit indices
+	IMPORT_PROFILE_COUNT
+};
+
+// SplitLargeMeshes keeps every mesh at or under this many vertices, so all of them get 16-bit indices
+const int IMPORT_MAX_MESH_VERTICES = 65536;
+
+struct ImportStats {
+	double seconds = 0.0; // ReadFile, post-processing included
+	size_t vertices = 0;
+	size_t indices = 0;
+	size_t draws = 0;     // one per mesh
+};
+
+const char * importProfileName(ImportProfile profile) {
+	switch (profile) {
+	case IMPORT_PROFILE_OPTIMIZED_RENDER:
+		return "optimized-render";
+	case IMPORT_PROFILE_MINIMAL_MEMORY:
+		return "minimal-memory";
+	default:
+		return "fast-load";
+	}
+}
+
+bool parseImportProfile(const char * name, ImportProfile & profile) {
+	for (int i = 0; i < IMPORT_PROFILE_COUNT; i++) {
+		if (strcmp(name, importProfileName((ImportProfile)i)) == 0) {
+			profile = (ImportProfile)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned int importProfileFlags(ImportProfile profile) {
+	unsigned int flags = aiProcess_Triangulate | aiProcess_FlipUVs;
+	switch (profile) {
+	case IMPORT_PROFILE_OPTIMIZED_RENDER:
+		return flags | aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality | aiProcess_SortByPType
+			| aiProcess_FindDegenerates | aiProcess_RemoveRedundantMaterials | aiProcess_OptimizeMeshes | aiProcess_SplitLargeMeshes;
+	case IMPORT_PROFILE_MINIMAL_MEMORY:
+		return flags | aiProcess_JoinIdenticalVertices | aiProcess_RemoveComponent | aiProcess_SortByPType
+			| aiProcess_FindDegenerates | aiProcess_FindInvalidData | aiProcess_OptimizeMeshes | aiProcess_SplitLargeMeshes;
+	default:
+		return flags;
+	}
+}
+
+// Importer properties the profile's steps read
+void configureImporter(Assimp::Importer & importer, ImportProfile profile) {
+	if (profile == IMPORT_PROFILE_FAST_LOAD)
+		return;
+	importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, IMPORT_MAX_MESH_VERTICES);
+	// degenerate triangles are removed rather than turned into points and lines,
+	// which SortByPType then drops so only triangles reach the loader
+	importer.SetPropertyInteger(AI_CONFIG_PP_FD_REMOVE, 1);
+	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+	if (profile == IMPORT_PROFILE_MINIMAL_MEMORY)
+		importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, aiComponent_COLORS | aiComponent_TANGENTS_AND_BITANGENTS | aiComponent_CAMERAS | aiComponent_LIGHTS);
+}
+
+// Reads path with the profile's post-processing and measures it. The scene
+// belongs to importer, NULL when the import failed.
+const aiScene * importScene(Assimp::Importer & importer, const std::string & path, ImportProfile profile, ImportStats & stats) {
+	configureImporter(importer, profile);
+	auto start = std::chrono::steady_clock::now();
+	const aiScene * scene = importer.ReadFile(path, importProfileFlags(profile));
+	stats = ImportStats();
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!scene)
+		return NULL;
+	stats.draws = scene->mNumMeshes;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		const aiMesh * mesh = scene->mMeshes[i];
+		stats.vertices += mesh->mNumVertices;
+		for (unsigned int j = 0; j < mesh->mNumFaces; j++)
+			stats.indices += mesh->mFaces[j].mNumIndices;
+	}
+	return scene;
+}
+
+void printImportStats(const char * path, ImportProfile profile, const ImportStats & stats) {
+	printf("%s [%s]: imported in %.2f ms, %zu vertices, %zu indices, %zu draws\n",
+		path, importProfileName(profile), stats.seconds * 1000.0, stats.vertices, stats.indices, stats.draws);
+}
+
+// Imports path once with every profile and prints each one's cost, to pick a profile per asset
+void compareImportProfiles(const char * path) {
+	for (int i = 0; i < IMPORT_PROFILE_COUNT; i++) {
+		Assimp::Importer importer;
+		ImportStats stats;
+		if (!importScene(importer, path, (ImportProfile)i, stats)) {
+			printf("%s [%s]: import failed: %s\n", path, importProfileName((ImportProfile)i), importer.GetErrorString());
+			continue;
+		}
+		printImportStats(path, (ImportProfile)i, stats);
+	}
+}
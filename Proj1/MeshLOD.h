@@ -0,0 +1,402 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+#include <stdint.h>
+#include "MeshOptimize.h"
+
+// Level of detail for indexed meshes:
+//  - simplifyMesh collapses edges in order of quadric error (Garland & Heckbert
+//    1997). Every level only references vertices of the full mesh, so a LOD is
+//    just another range of indices over the same vertex buffer.
+//  - selectLOD picks a level per object from its projected screen size, with a
+//    hysteresis band so objects near a threshold don't flicker between levels.
+// Vertex types need glm::vec3 'position' and 'normal' and glm::vec2 'uv' members.
+
+const int LOD_MAX_LEVELS = 5;          // including the full mesh
+const float LOD_HYSTERESIS = 0.15f;    // fraction of a threshold to go past before switching
+const float LOD_BORDER_WEIGHT = 10.0f; // keeps open borders in place
+
+// Level k + 1 is used below LOD_SCREEN_SIZES[k] of the viewport height. Each
+// level may move the surface by about twice the previous one (see buildLODChain),
+// so halving the threshold keeps the error near one pixel.
+const float LOD_SCREEN_SIZES[LOD_MAX_LEVELS - 1] = {0.2f, 0.1f, 0.05f, 0.025f};
+
+// One level as a range of the mesh's index buffer
+struct LODLevel {
+	size_t firstIndex;
+	size_t indexCount;
+	float error; // how far the level may be from the full mesh, in model units
+};
+
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+	double a11 = 0, a12 = 0, a13 = 0;
+	double a22 = 0, a23 = 0;
+	double a33 = 0;
+	double weight = 0;
+};
+
+void addPlaneQuadric(Quadric & q, glm::vec3 n, float d, double weight) {
+	q.a00 += weight * n.x * n.x; q.a01 += weight * n.x * n.y; q.a02 += weight * n.x * n.z; q.a03 += weight * n.x * d;
+	q.a11 += weight * n.y * n.y; q.a12 += weight * n.y * n.z; q.a13 += weight * n.y * d;
+	q.a22 += weight * n.z * n.z; q.a23 += weight * n.z * d;
+	q.a33 += weight * d * d;
+	q.weight += weight;
+}
+
+void addQuadric(Quadric & q, const Quadric & o) {
+	q.a00 += o.a00; q.a01 += o.a01; q.a02 += o.a02; q.a03 += o.a03;
+	q.a11 += o.a11; q.a12 += o.a12; q.a13 += o.a13;
+	q.a22 += o.a22; q.a23 += o.a23;
+	q.a33 += o.a33;
+	q.weight += o.weight;
+}
+
+// Weighted mean squared distance from p to the planes of the quadric
+double evaluateQuadric(const Quadric & q, glm::vec3 p) {
+	double x = p.x, y = p.y, z = p.z;
+	double e = q.a00 * x * x + 2 * q.a01 * x * y + 2 * q.a02 * x * z + 2 * q.a03 * x
+		+ q.a11 * y * y + 2 * q.a12 * y * z + 2 * q.a13 * y
+		+ q.a22 * z * z + 2 * q.a23 * z
+		+ q.a33;
+	return q.weight > 0 ? std::max(e, 0.0) / q.weight : 0.0;
+}
+
+struct PositionHash {
+	size_t operator()(const glm::vec3 & p) const {
+		uint32_t bits[3];
+		memcpy(bits, &p.x, sizeof(bits));
+		return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+	}
+};
+
+struct PositionEqual {
+	bool operator()(const glm::vec3 & a, const glm::vec3 & b) const {
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+};
+
+// Simplifies indices down to about targetIndexCount without moving the surface
+// further than maxError. Returns the largest error of an accepted collapse.
+template <typename Vertex>
+float simplifyMesh(
+	const std::vector<Vertex> & vertices,
+	const std::vector<unsigned int> & indices,
+	size_t targetIndexCount,
+	float maxError,
+	std::vector<unsigned int> & out_indices) {
+
+	// topology works on positions, so attribute seams don't look like borders
+	std::vector<unsigned int> positionOf(vertices.size());
+	std::vector<glm::vec3> positions;
+	std::vector<std::vector<unsigned int> > corners; // attribute vertices at each position
+	std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> positionIds;
+	for (size_t v = 0; v < vertices.size(); v++) {
+		std::pair<std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual>::iterator, bool> found =
+			positionIds.insert(std::make_pair(vertices[v].position, (unsigned int)positions.size()));
+		if (found.second) {
+			positions.push_back(vertices[v].position);
+			corners.push_back(std::vector<unsigned int>());
+		}
+		positionOf[v] = found.first->second;
+		corners[found.first->second].push_back((unsigned int)v);
+	}
+	size_t positionCount = positions.size();
+
+	out_indices = indices;
+	size_t triangleCount = out_indices.size() / 3;
+
+	// plane quadrics, weighted by triangle area
+	std::vector<Quadric> quadrics(positionCount);
+	std::unordered_map<uint64_t, int> edgeUses;
+	for (size_t t = 0; t < triangleCount; t++) {
+		unsigned int p[3] = {positionOf[out_indices[t * 3]], positionOf[out_indices[t * 3 + 1]], positionOf[out_indices[t * 3 + 2]]};
+		glm::vec3 n = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+		float length = glm::length(n);
+		if (length == 0.0f)
+			continue;
+		n /= length;
+		for (int k = 0; k < 3; k++) {
+			addPlaneQuadric(quadrics[p[k]], n, -glm::dot(n, positions[p[0]]), length * 0.5f);
+			unsigned int a = std::min(p[k], p[(k + 1) % 3]), b = std::max(p[k], p[(k + 1) % 3]);
+			edgeUses[((uint64_t)a << 32) | b]++;
+		}
+	}
+
+	// open borders get a perpendicular plane so collapses can't pull them inward
+	std::vector<bool> border(positionCount, false);
+	for (size_t t = 0; t < triangleCount; t++) {
+		unsigned int p[3] = {positionOf[out_indices[t * 3]], positionOf[out_indices[t * 3 + 1]], positionOf[out_indices[t * 3 + 2]]};
+		glm::vec3 n = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+		if (glm::length(n) == 0.0f)
+			continue;
+		n = glm::normalize(n);
+		for (int k = 0; k < 3; k++) {
+			unsigned int a = p[k], b = p[(k + 1) % 3];
+			if (edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)] != 1)
+				continue;
+			glm::vec3 edge = positions[b] - positions[a];
+			float edgeLength = glm::length(edge);
+			if (edgeLength == 0.0f)
+				continue;
+			glm::vec3 side = glm::normalize(glm::cross(edge, n));
+			double weight = LOD_BORDER_WEIGHT * edgeLength * edgeLength;
+			addPlaneQuadric(quadrics[a], side, -glm::dot(side, positions[a]), weight);
+			addPlaneQuadric(quadrics[b], side, -glm::dot(side, positions[a]), weight);
+			border[a] = border[b] = true;
+		}
+	}
+
+	double maxCost = (double)maxError * maxError;
+	float resultError = 0.0f;
+	std::vector<unsigned int> collapseTo(positionCount);
+	for (size_t i = 0; i < positionCount; i++)
+		collapseTo[i] = (unsigned int)i;
+
+	// Each pass collapses the cheapest edges whose neighbourhoods don't overlap,
+	// then rebuilds the index buffer, until the target or the error bound is hit.
+	while (out_indices.size() > targetIndexCount) {
+		triangleCount = out_indices.size() / 3;
+
+		std::vector<std::vector<unsigned int> > around(positionCount); // position -> triangles
+		std::unordered_map<uint64_t, int> uses;
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = positionOf[out_indices[t * 3 + k]], b = positionOf[out_indices[t * 3 + (k + 1) % 3]];
+				around[a].push_back((unsigned int)t);
+				uses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+			}
+		}
+
+		struct Collapse {
+			double cost;
+			unsigned int from, to;
+			bool operator<(const Collapse & o) const { return cost < o.cost; }
+		};
+		std::vector<Collapse> candidates;
+		for (std::unordered_map<uint64_t, int>::iterator it = uses.begin(); it != uses.end(); ++it) {
+			unsigned int a = (unsigned int)(it->first >> 32), b = (unsigned int)(it->first & 0xffffffffu);
+			bool borderEdge = it->second == 1;
+			Collapse best = {0.0, 0, 0};
+			bool found = false;
+			for (int direction = 0; direction < 2; direction++) {
+				unsigned int from = direction ? b : a, to = direction ? a : b;
+				if (border[from] && !borderEdge)
+					continue; // a border vertex may only slide along its border
+				Quadric q = quadrics[from];
+				addQuadric(q, quadrics[to]);
+				double cost = evaluateQuadric(q, positions[to]);
+				if (!found || cost < best.cost) {
+					best.cost = cost;
+					best.from = from;
+					best.to = to;
+					found = true;
+				}
+			}
+			if (found && best.cost <= maxCost)
+				candidates.push_back(best);
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		std::vector<bool> touched(positionCount, false);
+		size_t remaining = triangleCount;
+		size_t collapses = 0;
+		for (size_t c = 0; c < candidates.size() && remaining * 3 > targetIndexCount; c++) {
+			unsigned int from = candidates[c].from, to = candidates[c].to;
+			if (touched[from] || touched[to])
+				continue;
+
+			// reject collapses that flip a triangle around 'from'
+			bool flips = false;
+			size_t removed = 0;
+			for (size_t i = 0; i < around[from].size() && !flips; i++) {
+				unsigned int t = around[from][i];
+				unsigned int p[3] = {positionOf[out_indices[t * 3]], positionOf[out_indices[t * 3 + 1]], positionOf[out_indices[t * 3 + 2]]};
+				if (p[0] == to || p[1] == to || p[2] == to) {
+					removed++;
+					continue;
+				}
+				glm::vec3 before = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+				for (int k = 0; k < 3; k++)
+					if (p[k] == from)
+						p[k] = to;
+				glm::vec3 after = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+				flips = glm::dot(before, after) <= 0.0f;
+			}
+			if (flips)
+				continue;
+
+			collapseTo[from] = to;
+			addQuadric(quadrics[to], quadrics[from]);
+			for (size_t i = 0; i < around[from].size(); i++) {
+				unsigned int t = around[from][i];
+				for (int k = 0; k < 3; k++)
+					touched[positionOf[out_indices[t * 3 + k]]] = true;
+			}
+			remaining -= std::min(removed, remaining);
+			resultError = std::max(resultError, (float)std::sqrt(candidates[c].cost));
+			collapses++;
+		}
+		if (collapses == 0)
+			break;
+
+		// move corners of collapsed positions to the closest attribute vertex at the new position
+		std::vector<unsigned int> rebuilt;
+		rebuilt.reserve(out_indices.size());
+		for (size_t t = 0; t < triangleCount; t++) {
+			unsigned int v[3];
+			for (int k = 0; k < 3; k++) {
+				v[k] = out_indices[t * 3 + k];
+				unsigned int p = positionOf[v[k]];
+				if (collapseTo[p] == p)
+					continue;
+				const Vertex & a = vertices[out_indices[t * 3 + k]];
+				const std::vector<unsigned int> & targets = corners[collapseTo[p]];
+				float bestDistance = 0.0f;
+				for (size_t i = 0; i < targets.size(); i++) {
+					const Vertex & b = vertices[targets[i]];
+					glm::vec3 dn = a.normal - b.normal;
+					glm::vec2 duv = a.uv - b.uv;
+					float distance = glm::dot(dn, dn) + glm::dot(duv, duv);
+					if (i == 0 || distance < bestDistance) {
+						bestDistance = distance;
+						v[k] = targets[i];
+					}
+				}
+			}
+			unsigned int p0 = positionOf[v[0]], p1 = positionOf[v[1]], p2 = positionOf[v[2]];
+			if (p0 == p1 || p1 == p2 || p0 == p2)
+				continue; // collapsed away
+			rebuilt.push_back(v[0]);
+			rebuilt.push_back(v[1]);
+			rebuilt.push_back(v[2]);
+		}
+		out_indices.swap(rebuilt);
+	}
+	return resultError;
+}
+
+// Fills levels with up to LOD_MAX_LEVELS index buffers, levels[0] being indices.
+// Each level aims for half the triangles of the previous one and may move the
+// surface by at most 1%, 2%, 4%, ... of the mesh size; the chain stops early
+// when a level can't remove at least 10% more triangles.
+template <typename Vertex>
+void buildLODChain(
+	const std::vector<Vertex> & vertices,
+	const std::vector<unsigned int> & indices,
+	std::vector<std::vector<unsigned int> > & levels,
+	std::vector<float> & errors) {
+
+	levels.assign(1, indices);
+	errors.assign(1, 0.0f);
+	if (vertices.empty())
+		return;
+
+	glm::vec3 lo = vertices[0].position, hi = lo;
+	for (size_t i = 1; i < vertices.size(); i++) {
+		lo = glm::min(lo, vertices[i].position);
+		hi = glm::max(hi, vertices[i].position);
+	}
+	float size = glm::length(hi - lo);
+
+	float maxError = size * 0.01f;
+	while ((int)levels.size() < LOD_MAX_LEVELS) {
+		const std::vector<unsigned int> & previous = levels.back();
+		size_t target = (previous.size() / 6) * 3;
+		std::vector<unsigned int> simplified;
+		float error = simplifyMesh(vertices, previous, target, maxError, simplified);
+		if (simplified.empty() || simplified.size() * 10 > previous.size() * 9)
+			break;
+		levels.push_back(simplified);
+		errors.push_back(std::max(error, errors.back()));
+		maxError *= 2.0f;
+	}
+}
+
+// Appends levels 1.. to indices (levels[0] must already be indices) and fills out_lods
+// with the range of every level. Simplified levels are reordered for the vertex cache.
+void appendLODLevels(
+	const std::vector<std::vector<unsigned int> > & levels,
+	const std::vector<float> & errors,
+	size_t vertexCount,
+	std::vector<unsigned int> & indices,
+	std::vector<LODLevel> & out_lods) {
+
+	out_lods.clear();
+	LODLevel full = {0, indices.size(), 0.0f};
+	out_lods.push_back(full);
+	for (size_t i = 1; i < levels.size(); i++) {
+		std::vector<unsigned int> ordered;
+		std::vector<size_t> clusterStarts;
+		tipsifyTriangles(levels[i], vertexCount, ordered, clusterStarts);
+		LODLevel level = {indices.size(), ordered.size(), errors[i]};
+		out_lods.push_back(level);
+		indices.insert(indices.end(), ordered.begin(), ordered.end());
+	}
+}
+
+// Sphere around the AABB of the vertices, in model space
+template <typename Vertex>
+void computeBoundingSphere(const std::vector<Vertex> & vertices, glm::vec3 & center, float & radius) {
+	center = glm::vec3(0.0f);
+	radius = 0.0f;
+	if (vertices.empty())
+		return;
+	glm::vec3 lo = vertices[0].position, hi = lo;
+	for (size_t i = 1; i < vertices.size(); i++) {
+		lo = glm::min(lo, vertices[i].position);
+		hi = glm::max(hi, vertices[i].position);
+	}
+	center = (lo + hi) * 0.5f;
+	radius = glm::length(hi - lo) * 0.5f;
+}
+
+// Keeps the level of one drawn object between frames
+struct LODSelection {
+	int level = 0;
+};
+
+// Triangles drawn against triangles at full detail, reset after every report
+struct LODStats {
+	size_t trianglesFull = 0;
+	size_t trianglesDrawn = 0;
+	size_t frames = 0;
+};
+
+// Height of a model space bounding sphere on screen, as a fraction of the viewport height
+float projectedScreenSize(const glm::mat4 & world, glm::vec3 center, float radius, glm::vec3 cameraPosition, const glm::mat4 & projection) {
+	glm::vec3 worldCenter = glm::vec3(world * glm::vec4(center, 1.0f));
+	float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+	float worldRadius = radius * scale;
+	float distance = glm::length(worldCenter - cameraPosition);
+	if (distance <= worldRadius)
+		return 1.0f;
+	return worldRadius * projection[1][1] / distance;
+}
+
+// Moves selection towards the level for screenSize, only switching once the size is
+// LOD_HYSTERESIS past the threshold between two levels. levelCount includes level 0.
+int selectLOD(LODSelection & selection, float screenSize, int levelCount) {
+	int target = 0;
+	while (target < levelCount - 1 && screenSize < LOD_SCREEN_SIZES[target])
+		target++;
+	while (selection.level < target && screenSize < LOD_SCREEN_SIZES[selection.level] * (1.0f - LOD_HYSTERESIS))
+		selection.level++;
+	while (selection.level > target && screenSize > LOD_SCREEN_SIZES[selection.level - 1] * (1.0f + LOD_HYSTERESIS))
+		selection.level--;
+	selection.level = std::min(selection.level, std::max(levelCount - 1, 0));
+	return selection.level;
+}
+
+void printLODStats(const LODStats & stats) {
+	size_t frames = stats.frames ? stats.frames : 1;
+	printf("LOD: %zu of %zu triangles per frame (%.1f%% saved)\n",
+		stats.trianglesDrawn / frames, stats.trianglesFull / frames,
+		stats.trianglesFull ? 100.0 * (double)(stats.trianglesFull - stats.trianglesDrawn) / (double)stats.trianglesFull : 0.0);
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+// Mesh optimization for indexed triangle lists, run before glBufferData:
+//  1. triangles are reordered for the post-transform vertex cache (Tipsify,
+//     Sander et al. 2007), which also splits the mesh into clusters,
+//  2. clusters are sorted outside-in to reduce overdraw, unless that gives
+//     back more than 5% of the cache gain (the misses step 1 saved),
+//  3. vertices are renumbered in first-use order for vertex fetch locality.
+// Vertex types only need a glm::vec3 'position' member.
+
+// Post-transform cache size assumed by the optimizer and the statistics
+const int MESH_CACHE_SIZE = 16;
+
+struct MeshOptimizeStats {
+	float acmrBefore = 0, acmrAfter = 0; // transformed vertices per triangle (0.5 best, 3 worst)
+	float atvrBefore = 0, atvrAfter = 0; // transformed vertices per vertex (1.0 best)
+};
+
+// Counts vertex shader invocations with a FIFO cache of cacheSize entries
+size_t countTransformedVertices(const std::vector<unsigned int> & indices, size_t vertexCount, int cacheSize = MESH_CACHE_SIZE) {
+	std::vector<size_t> cachedAt(vertexCount, 0); // miss counter value when the vertex entered the cache
+	size_t misses = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		unsigned int v = indices[i];
+		if (cachedAt[v] == 0 || misses - cachedAt[v] >= (size_t)cacheSize) {
+			misses++;
+			cachedAt[v] = misses;
+		}
+	}
+	return misses;
+}
+
+float computeACMR(const std::vector<unsigned int> & indices, size_t vertexCount, int cacheSize = MESH_CACHE_SIZE) {
+	size_t triangles = indices.size() / 3;
+	return triangles ? (float)countTransformedVertices(indices, vertexCount, cacheSize) / triangles : 0.0f;
+}
+
+float computeATVR(const std::vector<unsigned int> & indices, size_t vertexCount, int cacheSize = MESH_CACHE_SIZE) {
+	return vertexCount ? (float)countTransformedVertices(indices, vertexCount, cacheSize) / vertexCount : 0.0f;
+}
+
+// Tipsify: fans out around the vertex that is most likely to still be in the
+// cache. Returns the new index order; clusterStarts receives the first
+// triangle of every cluster (a point where the cache had to restart).
+void tipsifyTriangles(
+	const std::vector<unsigned int> & indices,
+	size_t vertexCount,
+	std::vector<unsigned int> & out_indices,
+	std::vector<size_t> & clusterStarts,
+	int cacheSize = MESH_CACHE_SIZE) {
+
+	size_t triangleCount = indices.size() / 3;
+
+	// vertex -> triangles adjacency, as offsets into one array
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		liveTriangles[indices[i]]++;
+	std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+	std::vector<unsigned int> adjacency(adjacencyOffset[vertexCount]);
+	std::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	size_t timeStamp = cacheSize + 1;
+	size_t cursor = 0;
+
+	out_indices.clear();
+	out_indices.reserve(triangleCount * 3);
+	clusterStarts.clear();
+
+	long fan = vertexCount > 0 ? 0 : -1;
+	while (fan >= 0) {
+		if (timeStamp - cacheTime[fan] > (size_t)cacheSize)
+			clusterStarts.push_back(out_indices.size() / 3);
+
+		candidates.clear();
+		for (size_t a = adjacencyOffset[fan]; a < adjacencyOffset[fan + 1]; a++) {
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = true;
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[t * 3 + k];
+				out_indices.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (timeStamp - cacheTime[v] > (size_t)cacheSize)
+					cacheTime[v] = timeStamp++;
+			}
+		}
+
+		// next fan: the candidate that stays in cache after its remaining triangles
+		long best = -1;
+		size_t bestPriority = 0;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			unsigned int v = candidates[c];
+			if (liveTriangles[v] == 0)
+				continue;
+			size_t priority = 0;
+			if (timeStamp - cacheTime[v] + 2 * liveTriangles[v] <= (size_t)cacheSize)
+				priority = timeStamp - cacheTime[v];
+			if (best < 0 || priority > bestPriority) {
+				best = v;
+				bestPriority = priority;
+			}
+		}
+
+		// otherwise go back to a recent vertex, then to the next unused one
+		while (best < 0 && !deadEnd.empty()) {
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0)
+				best = v;
+		}
+		while (best < 0 && cursor < vertexCount) {
+			if (liveTriangles[cursor] > 0)
+				best = (long)cursor;
+			cursor++;
+		}
+		fan = best;
+	}
+}
+
+// Sorts clusters so outward-facing ones, likely to occlude the rest, draw first
+template <typename Vertex>
+void sortClustersForOverdraw(
+	const std::vector<Vertex> & vertices,
+	const std::vector<unsigned int> & indices,
+	const std::vector<size_t> & clusterStarts,
+	std::vector<unsigned int> & out_indices) {
+
+	size_t triangleCount = indices.size() / 3;
+	glm::vec3 meshCentroid(0.0f);
+	for (size_t i = 0; i < vertices.size(); i++)
+		meshCentroid += vertices[i].position;
+	if (!vertices.empty())
+		meshCentroid /= (float)vertices.size();
+
+	std::vector<std::pair<float, size_t> > order; // (sort key, cluster)
+	for (size_t c = 0; c < clusterStarts.size(); c++) {
+		size_t first = clusterStarts[c];
+		size_t last = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = first; t < last; t++) {
+			const glm::vec3 & a = vertices[indices[t * 3]].position;
+			const glm::vec3 & b = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3 & d = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 n = glm::cross(b - a, d - a); // length = 2 * area
+			float weight = glm::length(n);
+			normal += n;
+			centroid += (a + b + d) * (weight / 3.0f);
+			area += weight;
+		}
+		if (area > 0.0f)
+			centroid /= area;
+		float normalLength = glm::length(normal);
+		float key = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+		order.push_back(std::make_pair(-key, c));
+	}
+	std::stable_sort(order.begin(), order.end());
+
+	out_indices.clear();
+	out_indices.reserve(indices.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		size_t c = order[i].second;
+		size_t first = clusterStarts[c];
+		size_t last = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+		out_indices.insert(out_indices.end(), indices.begin() + first * 3, indices.begin() + last * 3);
+	}
+}
+
+// Renumbers vertices in the order the index buffer first uses them
+template <typename Vertex>
+void optimizeVertexFetch(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices) {
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		unsigned int & r = remap[indices[i]];
+		if (r == unused) {
+			r = (unsigned int)reordered.size();
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = r;
+	}
+	vertices.swap(reordered); // vertices no triangle uses are dropped
+}
+
+// Steps 1 and 2: reorders the triangles of indices, vertices are left untouched
+template <typename Vertex>
+void optimizeTriangleOrder(const std::vector<Vertex> & vertices, std::vector<unsigned int> & indices) {
+	std::vector<unsigned int> cacheOrder, overdrawOrder;
+	std::vector<size_t> clusterStarts;
+	tipsifyTriangles(indices, vertices.size(), cacheOrder, clusterStarts);
+	sortClustersForOverdraw(vertices, cacheOrder, clusterStarts, overdrawOrder);
+
+	size_t originalMisses = countTransformedVertices(indices, vertices.size());
+	size_t cacheMisses = countTransformedVertices(cacheOrder, vertices.size());
+	size_t overdrawMisses = countTransformedVertices(overdrawOrder, vertices.size());
+	size_t cacheGain = originalMisses > cacheMisses ? originalMisses - cacheMisses : 0;
+	if (overdrawMisses * 20 <= cacheMisses * 20 + cacheGain)
+		indices.swap(overdrawOrder);
+	else
+		indices.swap(cacheOrder);
+}
+
+// Runs the whole pass on one mesh and fills in the before/after statistics
+template <typename Vertex>
+void optimizeMesh(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, MeshOptimizeStats * stats = NULL) {
+	if (stats) {
+		stats->acmrBefore = computeACMR(indices, vertices.size());
+		stats->atvrBefore = computeATVR(indices, vertices.size());
+	}
+
+	optimizeTriangleOrder(vertices, indices);
+	optimizeVertexFetch(vertices, indices);
+
+	if (stats) {
+		stats->acmrAfter = computeACMR(indices, vertices.size());
+		stats->atvrAfter = computeATVR(indices, vertices.size());
+	}
+}
+
+// optimizeMesh for an index buffer made of ranges that must stay separate (one
+// per material): triangles only move inside their range, which starts at
+// rangeStarts[i] and ends at the next start. Vertex fetch covers the whole buffer.
+template <typename Vertex>
+void optimizeMeshRanges(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, const std::vector<size_t> & rangeStarts, MeshOptimizeStats * stats = NULL) {
+	if (stats) {
+		stats->acmrBefore = computeACMR(indices, vertices.size());
+		stats->atvrBefore = computeATVR(indices, vertices.size());
+	}
+
+	for (size_t r = 0; r < rangeStarts.size(); r++) {
+		size_t first = rangeStarts[r];
+		size_t last = r + 1 < rangeStarts.size() ? rangeStarts[r + 1] : indices.size();
+		std::vector<unsigned int> range(indices.begin() + first, indices.begin() + last);
+		optimizeTriangleOrder(vertices, range);
+		std::copy(range.begin(), range.end(), indices.begin() + first);
+	}
+	optimizeVertexFetch(vertices, indices);
+
+	if (stats) {
+		stats->acmrAfter = computeACMR(indices, vertices.size());
+		stats->atvrAfter = computeATVR(indices, vertices.size());
+	}
+}
+
+void printMeshOptimizeStats(const char * name, const MeshOptimizeStats & stats) {
+	printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name, stats.acmrBefore, stats.acmrAfter, stats.atvrBefore, stats.atvrAfter);
+}
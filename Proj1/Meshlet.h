@@ -0,0 +1,163 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+// Meshlets: an optimized index buffer is cut into consecutive clusters of up to
+// MESHLET_MAX_TRIANGLES triangles. Each cluster keeps a bounding sphere and a
+// normal cone so the CPU can skip clusters that are outside the view frustum or
+// facing away from the camera, and draw the rest as index buffer ranges.
+// Vertex types only need a glm::vec3 'position' member.
+
+const size_t MESHLET_MAX_TRIANGLES = 128;
+const size_t MESHLET_MAX_VERTICES = 96;
+
+struct Meshlet {
+	size_t firstIndex;    // into the mesh's index buffer
+	size_t indexCount;
+	glm::vec3 center;     // bounding sphere, in model space
+	float radius;
+	glm::vec3 coneAxis;   // average triangle normal
+	float coneCutoff;     // sin of the cone half angle, 1 when the cone is too wide to cull
+};
+
+struct MeshletFrustum {
+	glm::vec4 planes[6];      // model space, normalized, inside is positive
+	glm::vec3 cameraPosition; // model space
+};
+
+struct MeshletCullStats {
+	size_t trianglesSubmitted = 0; // triangles of every mesh drawn through drawMeshlets
+	size_t trianglesDrawn = 0;     // triangles left after culling
+	size_t meshletsFrustumCulled = 0;
+	size_t meshletsConeCulled = 0;
+	size_t frames = 0;
+};
+
+template <typename Vertex>
+void computeMeshletBounds(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices, Meshlet & meshlet) {
+	glm::vec3 lo = vertices[indices[meshlet.firstIndex]].position, hi = lo;
+	for (size_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+		lo = glm::min(lo, vertices[indices[i]].position);
+		hi = glm::max(hi, vertices[indices[i]].position);
+	}
+	meshlet.center = (lo + hi) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (size_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++)
+		meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].position - meshlet.center));
+
+	std::vector<glm::vec3> normals;
+	glm::vec3 axis(0.0f);
+	for (size_t i = meshlet.firstIndex; i + 2 < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+		const glm::vec3 & a = vertices[indices[i]].position;
+		const glm::vec3 & b = vertices[indices[i + 1]].position;
+		const glm::vec3 & c = vertices[indices[i + 2]].position;
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float length = glm::length(n);
+		if (length == 0.0f)
+			continue; // degenerate triangles are never visible
+		normals.push_back(n / length);
+		axis += n / length;
+	}
+
+	meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.coneCutoff = 1.0f;
+	float axisLength = glm::length(axis);
+	if (axisLength == 0.0f)
+		return;
+	meshlet.coneAxis = axis / axisLength;
+	float minDot = 1.0f;
+	for (size_t i = 0; i < normals.size(); i++)
+		minDot = std::min(minDot, glm::dot(meshlet.coneAxis, normals[i]));
+	// cones wider than ~85 degrees almost never pass the test, don't bother
+	if (minDot > 0.1f)
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+// Greedily cuts the index buffer into meshlets, in its current triangle order
+// (run optimizeMesh first so consecutive triangles are also close together)
+template <typename Vertex>
+void buildMeshlets(
+	const std::vector<Vertex> & vertices,
+	const std::vector<unsigned int> & indices,
+	std::vector<Meshlet> & out_meshlets,
+	size_t maxTriangles = MESHLET_MAX_TRIANGLES,
+	size_t maxVertices = MESHLET_MAX_VERTICES) {
+
+	out_meshlets.clear();
+	std::vector<size_t> usedBy(vertices.size(), ~(size_t)0); // last meshlet that used the vertex
+	Meshlet current = Meshlet();
+	size_t uniqueVertices = 0;
+
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		size_t newVertices = 0;
+		for (int k = 0; k < 3; k++)
+			if (usedBy[indices[t + k]] != out_meshlets.size())
+				newVertices++;
+		if (current.indexCount > 0 && (current.indexCount / 3 >= maxTriangles || uniqueVertices + newVertices > maxVertices)) {
+			computeMeshletBounds(vertices, indices, current);
+			out_meshlets.push_back(current);
+			current = Meshlet();
+			current.firstIndex = t;
+			uniqueVertices = 0;
+		}
+		for (int k = 0; k < 3; k++) {
+			size_t & owner = usedBy[indices[t + k]];
+			if (owner != out_meshlets.size()) {
+				owner = out_meshlets.size();
+				uniqueVertices++;
+			}
+		}
+		current.indexCount += 3;
+	}
+	if (current.indexCount > 0) {
+		computeMeshletBounds(vertices, indices, current);
+		out_meshlets.push_back(current);
+	}
+}
+
+// Frustum planes and camera position in the model space of one draw, so the
+// meshlet bounds never need to be transformed (Gribb & Hartmann plane extraction)
+MeshletFrustum makeMeshletFrustum(const glm::mat4 & viewProjection, const glm::mat4 & world, glm::vec3 cameraPosition) {
+	MeshletFrustum frustum;
+	glm::mat4 m = viewProjection * world;
+	for (int i = 0; i < 3; i++) {
+		for (int side = 0; side < 2; side++) {
+			glm::vec4 plane;
+			for (int c = 0; c < 4; c++)
+				plane[c] = m[c][3] + (side == 0 ? m[c][i] : -m[c][i]);
+			float length = glm::length(glm::vec3(plane));
+			frustum.planes[i * 2 + side] = length > 0.0f ? plane / length : plane;
+		}
+	}
+	frustum.cameraPosition = glm::vec3(glm::inverse(world) * glm::vec4(cameraPosition, 1.0f));
+	return frustum;
+}
+
+bool isMeshletInFrustum(const Meshlet & meshlet, const MeshletFrustum & frustum) {
+	for (int i = 0; i < 6; i++)
+		if (glm::dot(glm::vec3(frustum.planes[i]), meshlet.center) + frustum.planes[i].w < -meshlet.radius)
+			return false;
+	return true;
+}
+
+// True when every triangle of the meshlet faces away from the camera. Facing is
+// preserved by affine transforms that don't mirror, so testing in model space
+// stays correct with non-uniform scale.
+bool isMeshletBackFacing(const Meshlet & meshlet, const MeshletFrustum & frustum) {
+	if (meshlet.coneCutoff >= 1.0f)
+		return false;
+	glm::vec3 toCenter = meshlet.center - frustum.cameraPosition;
+	return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
+
+void printMeshletCullStats(const MeshletCullStats & stats) {
+	size_t frames = stats.frames ? stats.frames : 1;
+	printf("Meshlets: %zu triangles submitted, %zu drawn (%.1f%% culled) over %zu frames; %.1f meshlets/frame outside the frustum, %.1f back-facing\n",
+		stats.trianglesSubmitted, stats.trianglesDrawn,
+		stats.trianglesSubmitted ? 100.0 * (double)(stats.trianglesSubmitted - stats.trianglesDrawn) / (double)stats.trianglesSubmitted : 0.0,
+		stats.frames, (double)stats.meshletsFrustumCulled / frames, (double)stats.meshletsConeCulled / frames);
+}
@@ -0,0 +1,313 @@
+// Throughput benchmark for the OBJ loaders.
+// Compares loadOBJ / loadOBJ2 against loadOBJFast / loadOBJ2Fast and checks
+// that they produce identical output, then measures how the chunked parser
+// scales from 1 to N threads, what vertex welding saves and how interleaved
+// vertices compare to separate attribute arrays for indexed fetch, and the
+// ACMR/ATVR of welded meshes before and after optimizeMesh.
+//
+// To compile: g++ -O2 OBJbenchmark.cpp -o OBJbenchmark -pthread
+// Usage: ./OBJbenchmark [file.obj]   (without a file, a large grid mesh is generated)
+//        ./OBJbenchmark file.obj --stream <ceiling MB>
+//        streams the file into a spill file under a memory ceiling and reports peak RSS
+//        (run on its own so the loaders above do not inflate the peak)
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <glm/glm.hpp>
+
+#include "OBJloader.h"
+#include "OBJloaderV2.h"
+#include "OBJloaderFast.h"
+#include "OBJloaderStream.h"
+#include "MeshOptimize.h"
+
+using namespace std;
+
+// Same layout as TexturedColoredVertex in Assignment1_deploy.cpp
+struct BenchVertex
+{
+    BenchVertex(glm::vec3 _position, glm::vec3 _normal, glm::vec2 _uv)
+        : position(_position), normal(_normal), uv(_uv)
+    {
+    }
+
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+};
+
+// Writes a triangulated grid with positions, UVs and normals (v/vt/vn faces)
+bool writeGridOBJ(const char *path, int gridSize)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "# generated %dx%d grid\n", gridSize, gridSize);
+    for (int z = 0; z <= gridSize; z++)
+    {
+        for (int x = 0; x <= gridSize; x++)
+        {
+            float fx = (float)x / gridSize;
+            float fz = (float)z / gridSize;
+            fprintf(file, "v %f %f %f\n", fx * 20.0f - 10.0f, 0.5f * fx * fz, fz * 20.0f - 10.0f);
+        }
+    }
+    for (int z = 0; z <= gridSize; z++)
+    {
+        for (int x = 0; x <= gridSize; x++)
+        {
+            fprintf(file, "vt %f %f\n", (float)x / gridSize, (float)z / gridSize);
+        }
+    }
+    // one normal per position: loadOBJ2 sizes its per-position UVs by the normal count
+    for (int z = 0; z <= gridSize; z++)
+    {
+        for (int x = 0; x <= gridSize; x++)
+        {
+            float fx = (float)x / gridSize;
+            float fz = (float)z / gridSize;
+            glm::vec3 normal = glm::normalize(glm::vec3(-0.5f * fz / 20.0f, 1.0f, -0.5f * fx / 20.0f));
+            fprintf(file, "vn %f %f %f\n", normal.x, normal.y, normal.z);
+        }
+    }
+
+    int row = gridSize + 1;
+    for (int z = 0; z < gridSize; z++)
+    {
+        for (int x = 0; x < gridSize; x++)
+        {
+            int a = z * row + x + 1;
+            int b = a + 1;
+            int c = a + row;
+            int d = c + 1;
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+long fileSize(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+template <typename T>
+bool sameData(const vector<T> &a, const vector<T> &b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(T)) == 0);
+}
+
+template <typename Fn>
+double timeSeconds(Fn fn, int runs)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        fn();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+void report(const char *name, double seconds, double megabytes)
+{
+    printf("%-14s %9.2f ms %9.1f MB/s\n", name, seconds * 1000.0, megabytes / seconds);
+}
+
+// Walks the index buffer like the vertex fetch stage does and reads every attribute,
+// once from three separate arrays and once from a single interleaved array
+double fetchSeparate(const vector<unsigned int> &indices, const vector<glm::vec3> &positions,
+                     const vector<glm::vec3> &normals, const vector<glm::vec2> &uvs, int runs)
+{
+    volatile float sink = 0.0f;
+    return timeSeconds([&]() {
+        float sum = 0.0f;
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            unsigned int v = indices[i];
+            sum += positions[v].x + normals[v].y + uvs[v].x;
+        }
+        sink = sum; }, runs);
+}
+
+double fetchInterleaved(const vector<unsigned int> &indices, const vector<BenchVertex> &interleaved, int runs)
+{
+    volatile float sink = 0.0f;
+    return timeSeconds([&]() {
+        float sum = 0.0f;
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            const BenchVertex &vertex = interleaved[indices[i]];
+            sum += vertex.position.x + vertex.normal.y + vertex.uv.x;
+        }
+        sink = sum; }, runs);
+}
+
+void fetchBenchmark(const vector<unsigned int> &indices, const vector<glm::vec3> &positions,
+                    const vector<glm::vec3> &normals, const vector<glm::vec2> &uvs,
+                    const vector<BenchVertex> &interleaved, int runs)
+{
+    if (indices.empty() || normals.empty() || uvs.empty())
+        return;
+
+    // same mesh with its vertex ids scattered, as in meshes that were never reordered for locality
+    vector<unsigned int> scattered(indices.size());
+    unsigned int count = positions.size();
+    for (size_t i = 0; i < indices.size(); i++)
+        scattered[i] = (unsigned int)(((unsigned long long)indices[i] * 2654435761ull) % count);
+
+    double separate = fetchSeparate(indices, positions, normals, uvs, runs);
+    double packed = fetchInterleaved(indices, interleaved, runs);
+    double separateScattered = fetchSeparate(scattered, positions, normals, uvs, runs);
+    double packedScattered = fetchInterleaved(scattered, interleaved, runs);
+    printf("vertex fetch (CPU gather, 3 VBOs vs 1 interleaved):\n");
+    printf("  file order     %8.2f ms %8.2f ms (%.2fx)\n", separate * 1000.0, packed * 1000.0, separate / packed);
+    printf("  scattered ids  %8.2f ms %8.2f ms (%.2fx)\n", separateScattered * 1000.0, packedScattered * 1000.0, separateScattered / packedScattered);
+}
+
+int streamBenchmark(const char *path, size_t ceilingMB)
+{
+    OBJStreamOptions options;
+    options.memoryCeiling = ceilingMB << 20;
+    OBJStreamStats stats;
+    string spillPath = string(path) + ".spill";
+    auto start = chrono::steady_clock::now();
+    bool ok = streamOBJToFile(path, spillPath.c_str(), options, &stats);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double megabytes = fileSize(path) / (1024.0 * 1024.0);
+    printf("window %zu KB, batch %zu corners, %.1f MB/s\n", stats.windowSize >> 10, stats.batchCorners, megabytes / seconds);
+    printf("peak RSS over the process's %s the ceiling\n", stats.peakRSS <= stats.baseRSS + stats.memoryCeiling ? "within" : "ABOVE");
+    remove(spillPath.c_str());
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 3 && string(argv[2]) == "--stream")
+        return streamBenchmark(argv[1], atoi(argv[3]));
+
+    string path = "benchmark_grid.obj";
+    bool generated = false;
+    if (argc > 1)
+    {
+        path = argv[1];
+    }
+    else
+    {
+        if (!writeGridOBJ(path.c_str(), 700))
+        {
+            cerr << "Could not write " << path << endl;
+            return 1;
+        }
+        generated = true;
+    }
+
+    double megabytes = fileSize(path.c_str()) / (1024.0 * 1024.0);
+    printf("%s: %.1f MB\n", path.c_str(), megabytes);
+    const int runs = 3;
+    bool identical = true;
+
+    // loadOBJ vs loadOBJFast
+    vector<glm::vec3> vertices, normals, fastVertices, fastNormals;
+    vector<glm::vec2> uvs, fastUVs;
+    double slow = timeSeconds([&]() {
+        vertices.clear(); normals.clear(); uvs.clear();
+        loadOBJ(path.c_str(), vertices, normals, uvs); }, runs);
+    double fast = timeSeconds([&]() {
+        fastVertices.clear(); fastNormals.clear(); fastUVs.clear();
+        loadOBJFast(path.c_str(), fastVertices, fastNormals, fastUVs); }, runs);
+    report("loadOBJ", slow, megabytes);
+    report("loadOBJFast", fast, megabytes);
+    printf("speedup %.1fx, %zu triangles\n", slow / fast, vertices.size() / 3);
+    identical = identical && sameData(vertices, fastVertices) && sameData(normals, fastNormals) && sameData(uvs, fastUVs);
+
+    // loadOBJ2 vs loadOBJ2Fast
+    vector<int> indices, fastIndices;
+    vector<glm::vec3> vertices2, normals2, fastVertices2, fastNormals2;
+    vector<glm::vec2> uvs2, fastUVs2;
+    slow = timeSeconds([&]() {
+        indices.clear(); vertices2.clear(); normals2.clear(); uvs2.clear();
+        loadOBJ2(path.c_str(), indices, vertices2, normals2, uvs2); }, runs);
+    fast = timeSeconds([&]() {
+        fastIndices.clear(); fastVertices2.clear(); fastNormals2.clear(); fastUVs2.clear();
+        loadOBJ2Fast(path.c_str(), fastIndices, fastVertices2, fastNormals2, fastUVs2); }, runs);
+    report("loadOBJ2", slow, megabytes);
+    report("loadOBJ2Fast", fast, megabytes);
+    printf("speedup %.1fx\n", slow / fast);
+    identical = identical && sameData(indices, fastIndices) && sameData(vertices2, fastVertices2) &&
+                sameData(normals2, fastNormals2) && sameData(uvs2, fastUVs2);
+
+    // Thread scaling of the chunked parser, checked against the serial parse
+    OBJData serial;
+    double serialTime = timeSeconds([&]() { serial = OBJData(); parseOBJFast(path.c_str(), serial, 1); }, runs);
+    int maxThreads = max(1u, thread::hardware_concurrency());
+    printf("threads %9s %12s %8s\n", "ms", "MB/s", "scaling");
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        OBJData parallel;
+        double seconds = timeSeconds([&]() { parallel = OBJData(); parseOBJFast(path.c_str(), parallel, threads); }, runs);
+        printf("%7d %9.2f %12.1f %7.2fx\n", threads, seconds * 1000.0, megabytes / seconds, serialTime / seconds);
+        identical = identical && sameData(serial.vertices, parallel.vertices) && sameData(serial.uvs, parallel.uvs) &&
+                    sameData(serial.normals, parallel.normals) && sameData(serial.vertexIndices, parallel.vertexIndices) &&
+                    sameData(serial.uvIndices, parallel.uvIndices) && sameData(serial.normalIndices, parallel.normalIndices);
+    }
+
+    // Welding: unique (v, vt, vn) triples against the unindexed corner count
+    vector<unsigned int> weldedIndices;
+    vector<glm::vec3> weldedVertices, weldedNormals;
+    vector<glm::vec2> weldedUVs;
+    WeldStats weldStats;
+    double weldTime = timeSeconds([&]() {
+        weldedIndices.clear(); weldedVertices.clear(); weldedNormals.clear(); weldedUVs.clear();
+        weldOBJData(serial, weldedIndices, weldedVertices, weldedNormals, weldedUVs, &weldStats); }, runs);
+    size_t unindexedBytes = weldStats.corners * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2));
+    size_t weldedBytes = weldStats.vertices * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2)) +
+                         weldedIndices.size() * (weldStats.vertices <= 65536 ? 2 : 4);
+    printf("weld %.2f ms: %zu corners -> %zu vertices, dedup ratio %.2f, %.1f MB -> %.1f MB\n",
+           weldTime * 1000.0, weldStats.corners, weldStats.vertices, weldStats.ratio(),
+           unindexedBytes / (1024.0 * 1024.0), weldedBytes / (1024.0 * 1024.0));
+
+    // Interleaved output must hold the same vertices as the separate arrays
+    vector<unsigned int> interleavedIndices;
+    vector<BenchVertex> interleaved;
+    weldOBJInterleaved(serial, interleavedIndices, interleaved);
+    identical = identical && sameData(interleavedIndices, weldedIndices) && interleaved.size() == weldedVertices.size();
+    for (size_t i = 0; identical && i < interleaved.size(); i++)
+    {
+        identical = interleaved[i].position == weldedVertices[i] &&
+                    (weldedNormals.empty() || interleaved[i].normal == weldedNormals[i]) &&
+                    (weldedUVs.empty() || interleaved[i].uv == weldedUVs[i]);
+    }
+    fetchBenchmark(weldedIndices, weldedVertices, weldedNormals, weldedUVs, interleaved, runs);
+
+    // Vertex cache / overdraw / fetch optimization of the welded mesh
+    auto optimizeStart = chrono::steady_clock::now();
+    MeshOptimizeStats optimizeStats;
+    optimizeMesh(interleaved, interleavedIndices, &optimizeStats);
+    printf("optimizeMesh %.2f ms: ", chrono::duration<double>(chrono::steady_clock::now() - optimizeStart).count() * 1000.0);
+    printMeshOptimizeStats(path.c_str(), optimizeStats);
+
+    printf("output %s\n", identical ? "identical" : "DIFFERS");
+
+    if (generated)
+        remove(path.c_str());
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,911 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#define OBJ_NO_MMAP 1
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define OBJ_USE_SSE2 1
+#endif
+
+// Fast OBJ loading path.
+// The file is memory mapped, newlines are located 16 bytes at a time with SSE2,
+// and a counting pre-pass sizes every vector before any record is parsed.
+// loadOBJFast / loadOBJ2Fast produce the same output as loadOBJ / loadOBJ2,
+// and can split large files across threads (threadCount, 0 = all cores).
+
+// A 'usemtl' line: triangles from firstTriangle on use the named material
+struct OBJMaterialRun {
+	std::string material;
+	size_t firstTriangle;
+};
+
+// Raw records of an OBJ file. Indices are already 0-based, with negative
+// (relative) indices resolved against the records read so far.
+struct OBJData {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs; // V is inverted, like loadOBJ does
+	std::vector<glm::vec3> normals;
+	std::vector<int> vertexIndices, uvIndices, normalIndices;
+	std::vector<std::string> materialLibraries; // 'mtllib' file names, relative to the OBJ file
+	std::vector<OBJMaterialRun> materialRuns;   // 'usemtl' lines, in file order
+};
+
+// Read-only view of a whole file, mmapped when the platform allows it
+struct MappedFile {
+	const char * data = NULL;
+	size_t size = 0;
+	bool mapped = false;
+	std::vector<char> buffer;
+};
+
+bool openMappedFile(const char * path, MappedFile & file) {
+#ifndef OBJ_NO_MMAP
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	file.size = (size_t)st.st_size;
+	if (file.size == 0) {
+		close(fd);
+		file.data = "";
+		return true;
+	}
+	void * addr = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+	madvise(addr, file.size, MADV_SEQUENTIAL);
+	file.data = (const char *)addr;
+	file.mapped = true;
+	return true;
+#else
+	FILE * f = fopen(path, "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	file.buffer.resize(size > 0 ? size : 1);
+	file.size = fread(&file.buffer[0], 1, size, f);
+	fclose(f);
+	file.data = &file.buffer[0];
+	return true;
+#endif
+}
+
+void closeMappedFile(MappedFile & file) {
+#ifndef OBJ_NO_MMAP
+	if (file.mapped)
+		munmap((void *)file.data, file.size);
+#endif
+	file.data = NULL;
+	file.size = 0;
+	file.mapped = false;
+	file.buffer.clear();
+}
+
+// Returns a pointer to the next '\n' in [p, end), or end if there is none
+const char * findNewline(const char * p, const char * end) {
+#ifdef OBJ_USE_SSE2
+	const __m128i nl = _mm_set1_epi8('\n');
+	while (end - p >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)p);
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '\n')
+		p++;
+	return p;
+}
+
+bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char * skipBlanks(const char * p, const char * end) {
+	while (p < end && isBlank(*p))
+		p++;
+	return p;
+}
+
+// Locale-free float parser. Values whose mantissa fits in 24 bits and whose
+// decimal exponent is within 10 are computed exactly (one correctly rounded
+// float operation), which covers the "%f"-style numbers OBJ exporters write.
+// Anything longer falls back to strtof so results always match fscanf("%f").
+bool parseFloat(const char *& p, const char * end, float & out) {
+	static const float pow10f[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+	const char * start = p;
+	const char * s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = *s == '-';
+		s++;
+	}
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool anyDigit = false;
+	while (s < end && *s >= '0' && *s <= '9') {
+		if (mantissa != 0 || *s != '0')
+			digits++;
+		if (digits <= 19)
+			mantissa = mantissa * 10 + (*s - '0');
+		else
+			exponent++;
+		anyDigit = true;
+		s++;
+	}
+	if (s < end && *s == '.') {
+		s++;
+		while (s < end && *s >= '0' && *s <= '9') {
+			if (mantissa != 0 || *s != '0')
+				digits++;
+			if (digits <= 19) {
+				mantissa = mantissa * 10 + (*s - '0');
+				exponent--;
+			}
+			anyDigit = true;
+			s++;
+		}
+	}
+	if (!anyDigit)
+		goto fallback;
+	if (s < end && (*s == 'e' || *s == 'E')) {
+		const char * e = s + 1;
+		bool expNegative = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			expNegative = *e == '-';
+			e++;
+		}
+		if (e >= end || *e < '0' || *e > '9')
+			goto fallback;
+		int value = 0;
+		while (e < end && *e >= '0' && *e <= '9') {
+			if (value < 10000)
+				value = value * 10 + (*e - '0');
+			e++;
+		}
+		exponent += expNegative ? -value : value;
+		s = e;
+	}
+	if (s < end && !isBlank(*s) && *s != '\n')
+		goto fallback;
+	if (mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+		float value = (float)mantissa;
+		if (exponent < 0)
+			value /= pow10f[-exponent];
+		else
+			value *= pow10f[exponent];
+		out = negative ? -value : value;
+		p = s;
+		return true;
+	}
+
+fallback:
+	{
+		char token[128];
+		size_t length = 0;
+		while (start + length < end && length < sizeof(token) - 1 && !isBlank(start[length]) && start[length] != '\n')
+			length++;
+		if (length == 0)
+			return false;
+		memcpy(token, start, length);
+		token[length] = '\0';
+		char * stop;
+		out = strtof(token, &stop);
+		if (stop == token)
+			return false;
+		p = start + (stop - token);
+		return true;
+	}
+}
+
+bool parseInt(const char *& p, const char * end, int & out) {
+	const char * s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = *s == '-';
+		s++;
+	}
+	if (s >= end || *s < '0' || *s > '9')
+		return false;
+	int value = 0;
+	while (s < end && *s >= '0' && *s <= '9') {
+		value = value * 10 + (*s - '0');
+		s++;
+	}
+	out = negative ? -value : value;
+	p = s;
+	return true;
+}
+
+// Converts a 1-based (or negative, relative) OBJ index into a 0-based one
+int resolveIndex(int index, size_t count) {
+	return index < 0 ? (int)count + index : index - 1;
+}
+
+const int OBJ_NO_INDEX = -1 - 0x7fffffff; // a corner without vt or vn, where indices are padded per corner
+
+// Checks that every resolved index names one of the count records; the face
+// parser does not, since in a parallel parse the record counts are only
+// known after the merge. OBJ_NO_INDEX entries are skipped.
+bool checkOBJIndices(const char * path, const std::vector<int> & indices, size_t count, const char * record) {
+	for (size_t i = 0; i < indices.size(); i++) {
+		if (indices[i] != OBJ_NO_INDEX && (indices[i] < 0 || (size_t)indices[i] >= count)) {
+			printf("%s: face corner %zu references a %s record out of range, only %zu were read\n", path, i, record, count);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool checkOBJData(const char * path, const OBJData & data) {
+	return checkOBJIndices(path, data.vertexIndices, data.vertices.size(), "v") &&
+	       checkOBJIndices(path, data.uvIndices, data.uvs.size(), "vt") &&
+	       checkOBJIndices(path, data.normalIndices, data.normals.size(), "vn");
+}
+
+enum OBJLineType { OBJ_LINE_OTHER, OBJ_LINE_V, OBJ_LINE_VT, OBJ_LINE_VN, OBJ_LINE_F, OBJ_LINE_USEMTL, OBJ_LINE_MTLLIB };
+
+OBJLineType classifyLine(const char *& p, const char * end) {
+	p = skipBlanks(p, end);
+	if (end - p < 2)
+		return OBJ_LINE_OTHER;
+	if (p[0] == 'f' && isBlank(p[1])) {
+		p += 2;
+		return OBJ_LINE_F;
+	}
+	if (end - p > 6 && isBlank(p[6])) {
+		if (memcmp(p, "usemtl", 6) == 0) {
+			p += 7;
+			return OBJ_LINE_USEMTL;
+		}
+		if (memcmp(p, "mtllib", 6) == 0) {
+			p += 7;
+			return OBJ_LINE_MTLLIB;
+		}
+	}
+	if (p[0] != 'v')
+		return OBJ_LINE_OTHER;
+	if (isBlank(p[1])) {
+		p += 2;
+		return OBJ_LINE_V;
+	}
+	if (end - p < 3 || !isBlank(p[2]))
+		return OBJ_LINE_OTHER;
+	if (p[1] == 't') {
+		p += 3;
+		return OBJ_LINE_VT;
+	}
+	if (p[1] == 'n') {
+		p += 3;
+		return OBJ_LINE_VN;
+	}
+	return OBJ_LINE_OTHER;
+}
+
+// Counts the corners of an 'f' line so index vectors can be sized up front
+int countFaceCorners(const char * p, const char * end) {
+	int corners = 0;
+	while (true) {
+		p = skipBlanks(p, end);
+		if (p >= end)
+			break;
+		corners++;
+		while (p < end && !isBlank(*p))
+			p++;
+	}
+	return corners;
+}
+
+struct OBJCounts {
+	size_t vertices = 0, uvs = 0, normals = 0, triangles = 0;
+};
+
+void countOBJRecords(const char * begin, const char * end, OBJCounts & counts) {
+	const char * line = begin;
+	while (line < end) {
+		const char * lineEnd = findNewline(line, end);
+		const char * p = line;
+		switch (classifyLine(p, lineEnd)) {
+		case OBJ_LINE_V: counts.vertices++; break;
+		case OBJ_LINE_VT: counts.uvs++; break;
+		case OBJ_LINE_VN: counts.normals++; break;
+		case OBJ_LINE_F: {
+			int corners = countFaceCorners(p, lineEnd);
+			if (corners >= 3)
+				counts.triangles += corners - 2;
+			break;
+		}
+		default: break;
+		}
+		line = lineEnd + 1;
+	}
+}
+
+// Positions in the index vectors that hold a relative (negative) OBJ index.
+// A chunk parsed on its own resolves those against its local record counts;
+// the merge step adds the number of records in the preceding chunks.
+struct OBJFixups {
+	std::vector<size_t> vertex, uv, normal;
+};
+
+// Parses one 'f' line. Polygons are triangulated as a fan around the first corner.
+bool parseFaceLine(const char * p, const char * end, OBJData & data, OBJFixups * fixups) {
+	int vi[3], ui[3], ni[3];
+	bool vr[3], ur[3], nr[3]; // corner index was relative
+	bool hasUV = false, hasNormal = false;
+	int corner = 0;
+	while (true) {
+		p = skipBlanks(p, end);
+		if (p >= end)
+			break;
+		int v, t = 0, n = 0;
+		bool cornerUV = false, cornerNormal = false;
+		if (!parseInt(p, end, v))
+			return false;
+		if (p < end && *p == '/') {
+			p++;
+			if (p < end && *p != '/') {
+				if (!parseInt(p, end, t))
+					return false;
+				cornerUV = true;
+			}
+			if (p < end && *p == '/') {
+				p++;
+				if (!parseInt(p, end, n))
+					return false;
+				cornerNormal = true;
+			}
+		}
+		if (corner == 0) {
+			hasUV = cornerUV;
+			hasNormal = cornerNormal;
+		}
+		else if (cornerUV != hasUV || cornerNormal != hasNormal) {
+			return false;
+		}
+
+		int slot = corner < 3 ? corner : 2;
+		if (corner >= 3) {
+			// next fan triangle: (first, previous, current)
+			vi[1] = vi[2]; ui[1] = ui[2]; ni[1] = ni[2];
+			vr[1] = vr[2]; ur[1] = ur[2]; nr[1] = nr[2];
+		}
+		vi[slot] = resolveIndex(v, data.vertices.size());
+		ui[slot] = cornerUV ? resolveIndex(t, data.uvs.size()) : 0;
+		ni[slot] = cornerNormal ? resolveIndex(n, data.normals.size()) : 0;
+		vr[slot] = v < 0;
+		ur[slot] = cornerUV && t < 0;
+		nr[slot] = cornerNormal && n < 0;
+		corner++;
+
+		if (corner >= 3) {
+			if (fixups) {
+				for (int k = 0; k < 3; k++) {
+					if (vr[k])
+						fixups->vertex.push_back(data.vertexIndices.size() + k);
+					if (ur[k])
+						fixups->uv.push_back(data.uvIndices.size() + k);
+					if (nr[k])
+						fixups->normal.push_back(data.normalIndices.size() + k);
+				}
+			}
+			data.vertexIndices.insert(data.vertexIndices.end(), vi, vi + 3);
+			if (hasUV)
+				data.uvIndices.insert(data.uvIndices.end(), ui, ui + 3);
+			if (hasNormal)
+				data.normalIndices.insert(data.normalIndices.end(), ni, ni + 3);
+		}
+	}
+	return corner >= 3;
+}
+
+// Rest of the line without surrounding blanks (material names may contain spaces)
+std::string readLineName(const char * p, const char * end) {
+	p = skipBlanks(p, end);
+	while (end > p && (isBlank(end[-1]) || end[-1] == '\r'))
+		end--;
+	return std::string(p, end);
+}
+
+// Parses every line in [begin, end). fileBegin is only used to report error offsets.
+bool parseOBJLines(const char * fileBegin, const char * begin, const char * end, OBJData & data, OBJFixups * fixups) {
+	const char * line = begin;
+	while (line < end) {
+		const char * lineEnd = findNewline(line, end);
+		const char * p = line;
+		switch (classifyLine(p, lineEnd)) {
+		case OBJ_LINE_V: {
+			glm::vec3 vertex;
+			p = skipBlanks(p, lineEnd);
+			parseFloat(p, lineEnd, vertex.x);
+			p = skipBlanks(p, lineEnd);
+			parseFloat(p, lineEnd, vertex.y);
+			p = skipBlanks(p, lineEnd);
+			parseFloat(p, lineEnd, vertex.z);
+			data.vertices.push_back(vertex);
+			break;
+		}
+		case OBJ_LINE_VT: {
+			glm::vec2 uv;
+			p = skipBlanks(p, lineEnd);
+			parseFloat(p, lineEnd, uv.x);
+			p = skipBlanks(p, lineEnd);
+			if (!parseFloat(p, lineEnd, uv.y))
+				printf("Missing uv information!\n");
+			uv.y = -uv.y; // Invert V coordinate, same as loadOBJ
+			data.uvs.push_back(uv);
+			break;
+		}
+		case OBJ_LINE_VN: {
+			glm::vec3 normal;
+			p = skipBlanks(p, lineEnd);
+			parseFloat(p, lineEnd, normal.x);
+			p = skipBlanks(p, lineEnd);
+			parseFloat(p, lineEnd, normal.y);
+			p = skipBlanks(p, lineEnd);
+			if (!parseFloat(p, lineEnd, normal.z))
+				printf("Missing normal information!\n");
+			data.normals.push_back(normal);
+			break;
+		}
+		case OBJ_LINE_F:
+			if (!parseFaceLine(p, lineEnd, data, fixups)) {
+				printf("File can't be read by our simple parser. 'f' format expected: d/d/d d/d/d d/d/d || d/d d/d d/d || d//d d//d d//d || d d d\n");
+				printf("Character at %ld\n", (long)(line - fileBegin));
+				return false;
+			}
+			break;
+		case OBJ_LINE_USEMTL: {
+			OBJMaterialRun run = {readLineName(p, lineEnd), data.vertexIndices.size() / 3};
+			data.materialRuns.push_back(run);
+			break;
+		}
+		case OBJ_LINE_MTLLIB:
+			while (true) {
+				p = skipBlanks(p, lineEnd);
+				const char * nameEnd = p;
+				while (nameEnd < lineEnd && !isBlank(*nameEnd) && *nameEnd != '\r')
+					nameEnd++;
+				if (nameEnd == p)
+					break;
+				data.materialLibraries.push_back(std::string(p, nameEnd));
+				p = nameEnd;
+			}
+			break;
+		default:
+			break;
+		}
+		line = lineEnd + 1;
+	}
+	return true;
+}
+
+void reserveOBJData(const OBJCounts & counts, OBJData & data) {
+	data.vertices.reserve(counts.vertices);
+	data.uvs.reserve(counts.uvs);
+	data.normals.reserve(counts.normals);
+	data.vertexIndices.reserve(counts.triangles * 3);
+	if (counts.uvs != 0)
+		data.uvIndices.reserve(counts.triangles * 3);
+	if (counts.normals != 0)
+		data.normalIndices.reserve(counts.triangles * 3);
+}
+
+// Chunks smaller than this are not worth a thread of their own
+const size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;
+
+struct OBJChunk {
+	const char * begin;
+	const char * end;
+	OBJData data;
+	OBJFixups fixups;
+	bool ok;
+	// prefix sums of the record and index counts of all preceding chunks
+	size_t vertexOffset, uvOffset, normalOffset;
+	size_t vertexIndexOffset, uvIndexOffset, normalIndexOffset;
+};
+
+// Splits [begin, end) into at most threadCount newline-aligned chunks
+void splitOBJChunks(const char * begin, const char * end, int threadCount, std::vector<OBJChunk> & chunks) {
+	size_t size = end - begin;
+	size_t count = std::max<size_t>(1, std::min<size_t>(threadCount, size / OBJ_MIN_CHUNK_SIZE));
+	chunks.resize(count);
+	const char * chunkBegin = begin;
+	for (size_t i = 0; i < count; i++) {
+		const char * chunkEnd = end;
+		if (i + 1 < count) {
+			chunkEnd = begin + size * (i + 1) / count;
+			if (chunkEnd < chunkBegin)
+				chunkEnd = chunkBegin;
+			chunkEnd = findNewline(chunkEnd, end);
+			if (chunkEnd < end)
+				chunkEnd++;
+		}
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+}
+
+void parseOBJChunk(const char * fileBegin, OBJChunk & chunk) {
+	OBJCounts counts;
+	countOBJRecords(chunk.begin, chunk.end, counts);
+	reserveOBJData(counts, chunk.data);
+	chunk.ok = parseOBJLines(fileBegin, chunk.begin, chunk.end, chunk.data, &chunk.fixups);
+}
+
+template <typename T>
+void copyChunkRange(const std::vector<T> & source, std::vector<T> & destination, size_t offset) {
+	if (!source.empty())
+		memcpy(&destination[offset], &source[0], source.size() * sizeof(T));
+}
+
+void fixupChunkIndices(std::vector<int> & indices, size_t indexOffset, const std::vector<size_t> & positions, size_t recordOffset) {
+	for (size_t i = 0; i < positions.size(); i++)
+		indices[indexOffset + positions[i]] += (int)recordOffset;
+}
+
+// Copies one parsed chunk into the merged arrays at its prefix-sum offsets
+void mergeOBJChunk(const OBJChunk & chunk, OBJData & data) {
+	copyChunkRange(chunk.data.vertices, data.vertices, chunk.vertexOffset);
+	copyChunkRange(chunk.data.uvs, data.uvs, chunk.uvOffset);
+	copyChunkRange(chunk.data.normals, data.normals, chunk.normalOffset);
+	copyChunkRange(chunk.data.vertexIndices, data.vertexIndices, chunk.vertexIndexOffset);
+	copyChunkRange(chunk.data.uvIndices, data.uvIndices, chunk.uvIndexOffset);
+	copyChunkRange(chunk.data.normalIndices, data.normalIndices, chunk.normalIndexOffset);
+	fixupChunkIndices(data.vertexIndices, chunk.vertexIndexOffset, chunk.fixups.vertex, chunk.vertexOffset);
+	fixupChunkIndices(data.uvIndices, chunk.uvIndexOffset, chunk.fixups.uv, chunk.uvOffset);
+	fixupChunkIndices(data.normalIndices, chunk.normalIndexOffset, chunk.fixups.normal, chunk.normalOffset);
+}
+
+// Runs fn(i) for i in [0, count), one thread per item (the last one on the calling thread)
+template <typename Fn>
+void runOnThreads(size_t count, Fn fn) {
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i + 1 < count; i++)
+		threads.push_back(std::thread(fn, i));
+	if (count > 0)
+		fn(count - 1);
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+// Maps the file, sizes every vector in a counting pass, then parses all records.
+// threadCount > 1 parses newline-aligned chunks in parallel and merges them;
+// 0 uses every core. The result is identical to the single-threaded parse.
+bool parseOBJFast(const char * path, OBJData & data, int threadCount = 1) {
+	MappedFile file;
+	if (!openMappedFile(path, file)) {
+		printf("Impossible to open the file ! Are you in the right path ?\n");
+		printf("Path: %s\n", path);
+		return false;
+	}
+	const char * begin = file.data;
+	const char * end = file.data + file.size;
+
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<OBJChunk> chunks;
+	splitOBJChunks(begin, end, threadCount, chunks);
+	if (chunks.size() == 1) {
+		OBJCounts counts;
+		countOBJRecords(begin, end, counts);
+		reserveOBJData(counts, data);
+		bool ok = parseOBJLines(begin, begin, end, data, NULL) && checkOBJData(path, data);
+		closeMappedFile(file);
+		return ok;
+	}
+
+	runOnThreads(chunks.size(), [&](size_t i) { parseOBJChunk(begin, chunks[i]); });
+
+	bool ok = true;
+	OBJChunk total = {};
+	for (size_t i = 0; i < chunks.size(); i++) {
+		OBJChunk & chunk = chunks[i];
+		ok = ok && chunk.ok;
+		chunk.vertexOffset = total.vertexOffset;
+		chunk.uvOffset = total.uvOffset;
+		chunk.normalOffset = total.normalOffset;
+		chunk.vertexIndexOffset = total.vertexIndexOffset;
+		chunk.uvIndexOffset = total.uvIndexOffset;
+		chunk.normalIndexOffset = total.normalIndexOffset;
+		total.vertexOffset += chunk.data.vertices.size();
+		total.uvOffset += chunk.data.uvs.size();
+		total.normalOffset += chunk.data.normals.size();
+		total.vertexIndexOffset += chunk.data.vertexIndices.size();
+		total.uvIndexOffset += chunk.data.uvIndices.size();
+		total.normalIndexOffset += chunk.data.normalIndices.size();
+	}
+	if (ok) {
+		data.vertices.resize(total.vertexOffset);
+		data.uvs.resize(total.uvOffset);
+		data.normals.resize(total.normalOffset);
+		data.vertexIndices.resize(total.vertexIndexOffset);
+		data.uvIndices.resize(total.uvIndexOffset);
+		data.normalIndices.resize(total.normalIndexOffset);
+		runOnThreads(chunks.size(), [&](size_t i) { mergeOBJChunk(chunks[i], data); });
+
+		// material records are few, append them in chunk order
+		for (size_t i = 0; i < chunks.size(); i++) {
+			const OBJData & chunkData = chunks[i].data;
+			data.materialLibraries.insert(data.materialLibraries.end(), chunkData.materialLibraries.begin(), chunkData.materialLibraries.end());
+			for (size_t r = 0; r < chunkData.materialRuns.size(); r++) {
+				OBJMaterialRun run = chunkData.materialRuns[r];
+				run.firstTriangle += chunks[i].vertexIndexOffset / 3;
+				data.materialRuns.push_back(run);
+			}
+		}
+		ok = checkOBJData(path, data);
+	}
+	closeMappedFile(file);
+	return ok;
+}
+
+// Same output as loadOBJ: one position/normal/uv per triangle corner
+bool loadOBJFast(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec2> & out_uvs,
+	int threadCount = 1) {
+
+	OBJData data;
+	if (!parseOBJFast(path, data, threadCount))
+		return false;
+
+	out_vertices.reserve(out_vertices.size() + data.vertexIndices.size());
+	out_normals.reserve(out_normals.size() + data.normalIndices.size());
+	out_uvs.reserve(out_uvs.size() + data.uvIndices.size());
+	for (size_t i = 0; i < data.vertexIndices.size(); i++) {
+		if (i < data.uvIndices.size())
+			out_uvs.push_back(data.uvs[data.uvIndices[i]]);
+		if (i < data.normalIndices.size())
+			out_normals.push_back(data.normals[data.normalIndices[i]]);
+		out_vertices.push_back(data.vertices[data.vertexIndices[i]]);
+	}
+	return true;
+}
+
+// Same output as loadOBJ2: shared positions plus an index list, with
+// normals and UVs stored per position
+bool loadOBJ2Fast(
+	const char * path,
+	std::vector<int> & vertexIndices,
+	std::vector<glm::vec3> & temp_vertices,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec2> & out_uvs,
+	int threadCount = 1) {
+
+	OBJData data;
+	if (!parseOBJFast(path, data, threadCount))
+		return false;
+
+	vertexIndices.insert(vertexIndices.end(), data.vertexIndices.begin(), data.vertexIndices.end());
+	temp_vertices.insert(temp_vertices.end(), data.vertices.begin(), data.vertices.end());
+	if (data.normalIndices.size() != 0)
+		out_normals.resize(data.vertices.size());
+	if (data.uvIndices.size() != 0)
+		out_uvs.resize(data.vertices.size());
+	for (size_t i = 0; i < data.vertexIndices.size(); i++) {
+		int vi = data.vertexIndices[i];
+		if (i < data.normalIndices.size())
+			out_normals[vi] = data.normals[data.normalIndices[i]];
+		if (i < data.uvIndices.size())
+			out_uvs[vi] = data.uvs[data.uvIndices[i]];
+	}
+	return true;
+}
+
+struct WeldStats {
+	size_t corners = 0;  // triangle corners in the file
+	size_t vertices = 0; // unique (v, vt, vn) triples after welding
+	double ratio() const { return vertices ? (double)corners / vertices : 0.0; }
+};
+
+uint32_t hashCorner(int v, int t, int n) {
+	uint32_t h = (uint32_t)v * 73856093u;
+	h ^= (uint32_t)t * 19349663u;
+	h ^= (uint32_t)n * 83492791u;
+	h ^= h >> 15;
+	return h * 2246822519u;
+}
+
+// Deduplicates the (v, vt, vn) triple of every triangle corner into one
+// compact vertex each, using an open-addressing hash table. Unlike loadOBJ2,
+// corners that share a position but not a normal or UV become separate
+// vertices, so hard edges and UV seams survive indexed drawing.
+// Appends one index per corner (starting at base) and, for every welded
+// vertex, the corner that first used it.
+void weldOBJCorners(
+	const OBJData & data,
+	size_t base,
+	std::vector<unsigned int> & indices,
+	std::vector<int> & firstCorners,
+	WeldStats * stats) {
+
+	size_t corners = data.vertexIndices.size();
+	bool hasUV = data.uvIndices.size() == corners;
+	bool hasNormal = data.normalIndices.size() == corners;
+
+	size_t tableSize = 16;
+	while (tableSize < corners * 2)
+		tableSize <<= 1;
+	std::vector<int> table(tableSize, -1); // slot -> welded vertex
+	firstCorners.reserve(corners / 2);
+	indices.reserve(indices.size() + corners);
+	for (size_t i = 0; i < corners; i++) {
+		int v = data.vertexIndices[i];
+		int t = hasUV ? data.uvIndices[i] : 0;
+		int n = hasNormal ? data.normalIndices[i] : 0;
+		size_t slot = hashCorner(v, t, n) & (tableSize - 1);
+		while (true) {
+			int id = table[slot];
+			if (id < 0) {
+				id = (int)firstCorners.size();
+				table[slot] = id;
+				firstCorners.push_back((int)i);
+				indices.push_back((unsigned int)(base + id));
+				break;
+			}
+			int c = firstCorners[id];
+			if (data.vertexIndices[c] == v && (!hasUV || data.uvIndices[c] == t) && (!hasNormal || data.normalIndices[c] == n)) {
+				indices.push_back((unsigned int)(base + id));
+				break;
+			}
+			slot = (slot + 1) & (tableSize - 1);
+		}
+	}
+
+	if (stats) {
+		stats->corners = corners;
+		stats->vertices = firstCorners.size();
+	}
+}
+
+// Welds into separate position / normal / uv arrays
+void weldOBJData(
+	const OBJData & data,
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec2> & out_uvs,
+	WeldStats * stats = NULL) {
+
+	std::vector<int> firstCorners;
+	weldOBJCorners(data, out_vertices.size(), indices, firstCorners, stats);
+	bool hasUV = data.uvIndices.size() == data.vertexIndices.size() && !data.uvIndices.empty();
+	bool hasNormal = data.normalIndices.size() == data.vertexIndices.size() && !data.normalIndices.empty();
+	for (size_t i = 0; i < firstCorners.size(); i++) {
+		int c = firstCorners[i];
+		out_vertices.push_back(data.vertices[data.vertexIndices[c]]);
+		if (hasNormal)
+			out_normals.push_back(data.normals[data.normalIndices[c]]);
+		if (hasUV)
+			out_uvs.push_back(data.uvs[data.uvIndices[c]]);
+	}
+}
+
+// Builds the interleaved vertex of one corner. Vertex only needs a
+// (position, normal, uv) constructor, like TexturedColoredVertex.
+template <typename Vertex>
+Vertex makeOBJVertex(const OBJData & data, size_t corner) {
+	glm::vec3 normal(0.0f, 0.0f, 0.0f);
+	glm::vec2 uv(0.0f, 0.0f);
+	if (corner < data.normalIndices.size())
+		normal = data.normals[data.normalIndices[corner]];
+	if (corner < data.uvIndices.size())
+		uv = data.uvs[data.uvIndices[corner]];
+	return Vertex(data.vertices[data.vertexIndices[corner]], normal, uv);
+}
+
+// Welds into one interleaved vertex array, ready for a single VBO
+template <typename Vertex>
+void weldOBJInterleaved(
+	const OBJData & data,
+	std::vector<unsigned int> & indices,
+	std::vector<Vertex> & out_vertices,
+	WeldStats * stats = NULL) {
+
+	std::vector<int> firstCorners;
+	weldOBJCorners(data, out_vertices.size(), indices, firstCorners, stats);
+	out_vertices.reserve(out_vertices.size() + firstCorners.size());
+	for (size_t i = 0; i < firstCorners.size(); i++)
+		out_vertices.push_back(makeOBJVertex<Vertex>(data, firstCorners[i]));
+}
+
+// Indexed loader for setupModelEBO: one vertex per unique (v, vt, vn) triple
+bool loadOBJWelded(
+	const char * path,
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec2> & out_uvs,
+	int threadCount = 1,
+	WeldStats * stats = NULL) {
+
+	OBJData data;
+	if (!parseOBJFast(path, data, threadCount))
+		return false;
+	weldOBJData(data, indices, out_vertices, out_normals, out_uvs, stats);
+	return true;
+}
+
+// Interleaved version of loadOBJWelded
+template <typename Vertex>
+bool loadOBJWeldedInterleaved(
+	const char * path,
+	std::vector<unsigned int> & indices,
+	std::vector<Vertex> & out_vertices,
+	int threadCount = 1,
+	WeldStats * stats = NULL) {
+
+	OBJData data;
+	if (!parseOBJFast(path, data, threadCount))
+		return false;
+	weldOBJInterleaved(data, indices, out_vertices, stats);
+	return true;
+}
+
+// loadOBJWeldedInterleaved that also returns the 'mtllib' and 'usemtl' records,
+// for grouping the triangles by material (see OBJmaterial.h)
+template <typename Vertex>
+bool loadOBJWeldedMaterials(
+	const char * path,
+	std::vector<unsigned int> & indices,
+	std::vector<Vertex> & out_vertices,
+	std::vector<std::string> & out_materialLibraries,
+	std::vector<OBJMaterialRun> & out_materialRuns,
+	int threadCount = 1,
+	WeldStats * stats = NULL) {
+
+	OBJData data;
+	if (!parseOBJFast(path, data, threadCount))
+		return false;
+	weldOBJInterleaved(data, indices, out_vertices, stats);
+	out_materialLibraries.insert(out_materialLibraries.end(), data.materialLibraries.begin(), data.materialLibraries.end());
+	out_materialRuns.insert(out_materialRuns.end(), data.materialRuns.begin(), data.materialRuns.end());
+	return true;
+}
+
+// Interleaved version of loadOBJFast: one vertex per triangle corner
+template <typename Vertex>
+bool loadOBJInterleaved(
+	const char * path,
+	std::vector<Vertex> & out_vertices,
+	int threadCount = 1) {
+
+	OBJData data;
+	if (!parseOBJFast(path, data, threadCount))
+		return false;
+	out_vertices.reserve(out_vertices.size() + data.vertexIndices.size());
+	for (size_t i = 0; i < data.vertexIndices.size(); i++)
+		out_vertices.push_back(makeOBJVertex<Vertex>(data, i));
+	return true;
+}
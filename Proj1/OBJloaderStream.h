@@ -0,0 +1,231 @@
+#pragma once
+
+#include "OBJloaderFast.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+// Streaming OBJ ingestion with a bounded memory footprint.
+// The file is read in fixed-size windows, and triangle corners are expanded
+// into small batches that are handed to a sink (a GPU buffer, a spill file...)
+// and then dropped. Only the v/vt/vn pools stay resident, because faces may
+// reference any earlier record. Index vectors and expanded outputs never
+// exist for the whole file at once.
+
+struct OBJStreamOptions {
+	size_t memoryCeiling = 64u << 20; // bytes for pools + window + batch
+	size_t maxWindowSize = 4u << 20;  // upper bound on the read window
+	size_t sinkCornerBytes = 0;       // what the sink keeps per corner of a batch, counted in the batch
+};
+
+const size_t OBJ_STREAM_MIN_BUFFERS = 256u << 10; // smallest window + batch worth streaming with
+
+// One batch of expanded triangle corners, same layout as loadOBJ's output.
+// When the file has any vn (vt), normals (uvs) hold one entry per corner, and
+// corners of faces that have none get (0, 1, 0) ((0, 0)); otherwise they are empty.
+struct OBJTriangleBatch {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	size_t firstCorner; // corner offset of this batch in the whole file
+};
+
+struct OBJStreamStats {
+	OBJCounts counts;
+	size_t poolBytes = 0;
+	size_t windowSize = 0;
+	size_t batchCorners = 0;
+	size_t batches = 0;
+	size_t memoryCeiling = 0;
+	size_t baseRSS = 0; // resident before streaming started
+	size_t peakRSS = 0; // whole process, from getrusage
+};
+
+// Current resident set size (Linux only, 0 elsewhere)
+size_t currentResidentBytes() {
+	size_t bytes = 0;
+#ifndef _WIN32
+	FILE * statm = fopen("/proc/self/statm", "r");
+	if (statm) {
+		unsigned long pages, resident;
+		if (fscanf(statm, "%lu %lu", &pages, &resident) == 2)
+			bytes = (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+		fclose(statm);
+	}
+#endif
+	return bytes;
+}
+
+size_t peakResidentBytes() {
+#ifndef _WIN32
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return (size_t)usage.ru_maxrss * 1024; // KB on Linux
+#endif
+	return 0;
+}
+
+// Calls lineFn(begin, end) for every complete line of the file, reading it
+// windowSize bytes at a time. A line cut by the end of a window is moved to the
+// front of the buffer and completed by the next read.
+template <typename LineFn>
+bool forEachOBJLine(const char * path, size_t windowSize, LineFn lineFn) {
+	FILE * file = fopen(path, "rb");
+	if (!file) {
+		printf("Impossible to open the file ! Are you in the right path ?\n");
+		printf("Path: %s\n", path);
+		return false;
+	}
+	std::vector<char> window(windowSize);
+	size_t carried = 0;
+	bool ok = true;
+	while (ok) {
+		if (carried == window.size())
+			window.resize(window.size() * 2); // a single line longer than the window
+		size_t read = fread(&window[carried], 1, window.size() - carried, file);
+		size_t filled = carried + read;
+		bool last = read == 0 || feof(file);
+		const char * begin = &window[0];
+		const char * end = begin + filled;
+		const char * line = begin;
+		while (line < end) {
+			const char * lineEnd = findNewline(line, end);
+			if (lineEnd == end && !last)
+				break;
+			if (!lineFn(line, lineEnd)) {
+				ok = false;
+				break;
+			}
+			line = lineEnd + 1;
+		}
+		if (last)
+			break;
+		carried = line < end ? end - line : 0;
+		memmove(&window[0], line, carried);
+	}
+	fclose(file);
+	return ok;
+}
+
+bool countOBJFile(const char * path, size_t windowSize, OBJCounts & counts) {
+	return forEachOBJLine(path, windowSize, [&](const char * line, const char * lineEnd) {
+		countOBJRecords(line, lineEnd, counts);
+		return true;
+	});
+}
+
+// Streams every triangle of the file through sink(const OBJTriangleBatch &),
+// which returns false to abort. Peak RSS is reported against the ceiling.
+template <typename Sink>
+bool streamOBJ(const char * path, const OBJStreamOptions & options, Sink sink, OBJStreamStats * stats = NULL) {
+	OBJStreamStats local;
+	OBJStreamStats & s = stats ? *stats : local;
+	s.memoryCeiling = options.memoryCeiling;
+	s.baseRSS = currentResidentBytes();
+
+	// counting pass: sizes the pools, and lets the sink preallocate its storage
+	if (!countOBJFile(path, 64u << 10, s.counts))
+		return false;
+	s.poolBytes = s.counts.vertices * sizeof(glm::vec3) + s.counts.uvs * sizeof(glm::vec2) +
+	              s.counts.normals * sizeof(glm::vec3);
+
+	// whatever the pools leave of the ceiling is split between window and batch; the rest of the
+	// process is not the streamer's to bound, it is only reported
+	const size_t cornerBytes = sizeof(glm::vec3) * 2 + sizeof(glm::vec2) + sizeof(int) * 3 + options.sinkCornerBytes;
+	if (options.memoryCeiling < s.poolBytes + OBJ_STREAM_MIN_BUFFERS) {
+		printf("OBJ stream %s: the v/vt/vn pools (%zu KB) leave no room under the %zu KB ceiling, not streamed\n",
+		       path, s.poolBytes >> 10, options.memoryCeiling >> 10);
+		return false;
+	}
+	size_t budget = options.memoryCeiling - s.poolBytes;
+	s.windowSize = std::min(options.maxWindowSize, budget / 4);
+	s.batchCorners = (budget - s.windowSize) / cornerBytes / 3 * 3;
+
+	OBJData pool;
+	pool.vertices.reserve(s.counts.vertices);
+	pool.uvs.reserve(s.counts.uvs);
+	pool.normals.reserve(s.counts.normals);
+	pool.vertexIndices.reserve(s.batchCorners + 3 * 64);
+	OBJTriangleBatch batch;
+	batch.firstCorner = 0;
+
+	auto flush = [&]() {
+		size_t corners = pool.vertexIndices.size();
+		if (corners == 0)
+			return true;
+		// faces only reference records already read, so the pools are complete for this batch
+		if (!checkOBJData(path, pool))
+			return false;
+		batch.vertices.resize(corners);
+		batch.normals.resize(pool.normalIndices.size());
+		batch.uvs.resize(pool.uvIndices.size());
+		for (size_t i = 0; i < corners; i++)
+			batch.vertices[i] = pool.vertices[pool.vertexIndices[i]];
+		for (size_t i = 0; i < pool.normalIndices.size(); i++) {
+			int n = pool.normalIndices[i];
+			batch.normals[i] = n == OBJ_NO_INDEX ? glm::vec3(0.0f, 1.0f, 0.0f) : pool.normals[n];
+		}
+		for (size_t i = 0; i < pool.uvIndices.size(); i++) {
+			int t = pool.uvIndices[i];
+			batch.uvs[i] = t == OBJ_NO_INDEX ? glm::vec2(0.0f) : pool.uvs[t];
+		}
+		bool accepted = sink((const OBJTriangleBatch &)batch);
+		batch.firstCorner += corners;
+		s.batches++;
+		pool.vertexIndices.clear();
+		pool.uvIndices.clear();
+		pool.normalIndices.clear();
+		pool.materialRuns.clear(); // materials are not streamed
+		return accepted;
+	};
+
+	bool ok = forEachOBJLine(path, s.windowSize, [&](const char * line, const char * lineEnd) {
+		if (!parseOBJLines(line, line, lineEnd, pool, NULL))
+			return false;
+		// a face without vt or vn adds no indices for them; pad so every corner keeps its own
+		if (s.counts.uvs)
+			pool.uvIndices.resize(pool.vertexIndices.size(), OBJ_NO_INDEX);
+		if (s.counts.normals)
+			pool.normalIndices.resize(pool.vertexIndices.size(), OBJ_NO_INDEX);
+		return pool.vertexIndices.size() < s.batchCorners || flush();
+	});
+	ok = ok && flush();
+
+	s.peakRSS = peakResidentBytes();
+	printf("OBJ stream %s: %zu triangles in %zu batches, peak RSS %.1f MB, %.1f MB over the process's %.1f MB / ceiling %.1f MB (pools %.1f MB)\n",
+	       path, s.counts.triangles, s.batches, s.peakRSS / (1024.0 * 1024.0), (s.peakRSS > s.baseRSS ? s.peakRSS - s.baseRSS : 0) / (1024.0 * 1024.0),
+	       s.baseRSS / (1024.0 * 1024.0), s.memoryCeiling / (1024.0 * 1024.0), s.poolBytes / (1024.0 * 1024.0));
+	return ok;
+}
+
+// Sink that appends every batch to a spill file as raw floats
+// (positions, then normals, then UVs of each batch)
+struct OBJSpillFile {
+	FILE * file;
+	size_t bytesWritten;
+
+	bool operator()(const OBJTriangleBatch & batch) {
+		if (!file)
+			return false;
+		size_t written = 0;
+		written += fwrite(batch.vertices.data(), sizeof(glm::vec3), batch.vertices.size(), file) * sizeof(glm::vec3);
+		written += fwrite(batch.normals.data(), sizeof(glm::vec3), batch.normals.size(), file) * sizeof(glm::vec3);
+		written += fwrite(batch.uvs.data(), sizeof(glm::vec2), batch.uvs.size(), file) * sizeof(glm::vec2);
+		bytesWritten += written;
+		return written == batch.vertices.size() * sizeof(glm::vec3) + batch.normals.size() * sizeof(glm::vec3) +
+		                   batch.uvs.size() * sizeof(glm::vec2);
+	}
+};
+
+bool streamOBJToFile(const char * path, const char * spillPath, const OBJStreamOptions & options, OBJStreamStats * stats = NULL) {
+	OBJSpillFile spill = {fopen(spillPath, "wb"), 0};
+	if (!spill.file) {
+		printf("Could not create spill file %s\n", spillPath);
+		return false;
+	}
+	bool ok = streamOBJ(path, options, [&](const OBJTriangleBatch & batch) { return spill(batch); }, stats);
+	fclose(spill.file);
+	return ok;
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include "OBJloaderFast.h"
+
+// .mtl material libraries, and grouping of an OBJ's triangles by material so
+// every material is one contiguous range of a single index buffer.
+
+struct OBJMaterial {
+	std::string name;
+	glm::vec3 ambient = glm::vec3(0.2f);  // Ka
+	glm::vec3 diffuse = glm::vec3(0.8f);  // Kd
+	glm::vec3 specular = glm::vec3(0.0f); // Ks
+	float shininess = 0.0f;               // Ns
+	float opacity = 1.0f;                 // d
+	std::string diffuseMap;               // map_Kd, relative to the working directory
+};
+
+// One material's triangles in the grouped index buffer
+struct MaterialRange {
+	int material; // into the materials vector, -1 for faces without a known material
+	size_t firstIndex;
+	size_t indexCount;
+};
+
+// Directory part of path, with its trailing slash ("" when there is none)
+std::string directoryOf(const std::string & path) {
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// File name of a map statement's arguments: whatever follows the options
+// (-s 1 1 1, -clamp on, -imfchan r, ...), spaces included
+const char * mapFileName(const char * arguments) {
+	const char * p = arguments;
+	while (true) {
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p != '-')
+			return p;
+		bool channel = strncmp(p, "-imfchan", 8) == 0;
+		while (*p && *p != ' ' && *p != '\t')
+			p++;
+		// the option's values: numbers, on/off, or the channel letter of -imfchan
+		while (true) {
+			const char * value = p;
+			while (*value == ' ' || *value == '\t')
+				value++;
+			const char * end = value;
+			while (*end && *end != ' ' && *end != '\t')
+				end++;
+			char * number;
+			strtod(value, &number);
+			bool isValue = end > value && (number == end || (end - value == 2 && strncmp(value, "on", 2) == 0) ||
+				(end - value == 3 && strncmp(value, "off", 3) == 0) || (channel && end - value == 1));
+			if (!isValue || !*end)
+				break; // the last word is the file name, even when it looks like a value
+			p = end;
+			channel = false;
+		}
+	}
+}
+
+// Appends every material of an .mtl file. Texture paths are made relative
+// to the working directory, like the paths passed to loadTexture.
+bool loadMTL(const char * path, std::vector<OBJMaterial> & materials) {
+	FILE * file = fopen(path, "r");
+	if (!file) {
+		printf("Impossible to open the material library ! Are you in the right path ?\n");
+		printf("Path: %s\n", path);
+		return false;
+	}
+	std::string directory = directoryOf(path);
+
+	char line[1024];
+	while (fgets(line, sizeof(line), file)) {
+		char * p = line;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		char * end = p + strlen(p);
+		while (end > p && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+			*--end = '\0';
+
+		if (strncmp(p, "newmtl ", 7) == 0) {
+			OBJMaterial material;
+			material.name = p + 7;
+			materials.push_back(material);
+			continue;
+		}
+		if (materials.empty())
+			continue; // statements before the first newmtl have nothing to apply to
+		OBJMaterial & material = materials.back();
+		glm::vec3 color;
+		if (sscanf(p, "Ka %f %f %f", &color.x, &color.y, &color.z) == 3)
+			material.ambient = color;
+		else if (sscanf(p, "Kd %f %f %f", &color.x, &color.y, &color.z) == 3)
+			material.diffuse = color;
+		else if (sscanf(p, "Ks %f %f %f", &color.x, &color.y, &color.z) == 3)
+			material.specular = color;
+		else if (sscanf(p, "Ns %f", &material.shininess) == 1)
+			;
+		else if (sscanf(p, "d %f", &material.opacity) == 1)
+			;
+		else if (strncmp(p, "map_Kd ", 7) == 0)
+			material.diffuseMap = directory + mapFileName(p + 7);
+	}
+	fclose(file);
+	return true;
+}
+
+// Loads every 'mtllib' of an OBJ file, relative to the OBJ's directory
+void loadOBJMaterials(const char * objPath, const std::vector<std::string> & libraries, std::vector<OBJMaterial> & materials) {
+	std::string directory = directoryOf(objPath);
+	for (size_t i = 0; i < libraries.size(); i++)
+		loadMTL((directory + libraries[i]).c_str(), materials);
+}
+
+int findMaterial(const std::vector<OBJMaterial> & materials, const std::string & name) {
+	for (size_t i = 0; i < materials.size(); i++)
+		if (materials[i].name == name)
+			return (int)i;
+	return -1;
+}
+
+// Reorders the triangles of indices so each material is contiguous, keeping
+// file order inside a material. Ranges come out in order of first use.
+void groupTrianglesByMaterial(
+	const std::vector<unsigned int> & indices,
+	const std::vector<OBJMaterialRun> & runs,
+	const std::vector<OBJMaterial> & materials,
+	std::vector<unsigned int> & out_indices,
+	std::vector<MaterialRange> & out_ranges) {
+
+	size_t triangleCount = indices.size() / 3;
+	std::vector<int> materialOf(triangleCount, -1);
+	std::vector<std::string> missing;
+	for (size_t r = 0; r < runs.size(); r++) {
+		int material = findMaterial(materials, runs[r].material);
+		if (material < 0 && std::find(missing.begin(), missing.end(), runs[r].material) == missing.end()) {
+			printf("Material %s not found, using the default material\n", runs[r].material.c_str());
+			missing.push_back(runs[r].material);
+		}
+		size_t last = r + 1 < runs.size() ? runs[r + 1].firstTriangle : triangleCount;
+		for (size_t t = runs[r].firstTriangle; t < last && t < triangleCount; t++)
+			materialOf[t] = material;
+	}
+
+	// counting sort on the material of each triangle
+	out_ranges.clear();
+	std::vector<int> rangeOf(materials.size() + 1, -1); // material + 1 -> range
+	for (size_t t = 0; t < triangleCount; t++) {
+		int & range = rangeOf[materialOf[t] + 1];
+		if (range < 0) {
+			range = (int)out_ranges.size();
+			MaterialRange added = {materialOf[t], 0, 0};
+			out_ranges.push_back(added);
+		}
+		out_ranges[range].indexCount += 3;
+	}
+	for (size_t r = 1; r < out_ranges.size(); r++)
+		out_ranges[r].firstIndex = out_ranges[r - 1].firstIndex + out_ranges[r - 1].indexCount;
+
+	out_indices.resize(triangleCount * 3);
+	std::vector<size_t> fill(out_ranges.size());
+	for (size_t r = 0; r < out_ranges.size(); r++)
+		fill[r] = out_ranges[r].firstIndex;
+	for (size_t t = 0; t < triangleCount; t++) {
+		size_t & at = fill[rangeOf[materialOf[t] + 1]];
+		out_indices[at] = indices[t * 3];
+		out_indices[at + 1] = indices[t * 3 + 1];
+		out_indices[at + 2] = indices[t * 3 + 2];
+		at += 3;
+	}
+}
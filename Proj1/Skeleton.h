@@ -0,0 +1,146 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <stdint.h>
+
+// Skinning data and keyframe animation. A skinned vertex follows up to
+// SKIN_BONES_PER_VERTEX bones of its model's palette; every frame the
+// animation is sampled into node transforms, and the palette (one matrix per
+// bone) is what the vertex shader blends with the vertex's weights.
+
+// size of the shader's bonePalette array: 768 of the 1024 vertex uniform components GL 3.2
+// guarantees, leaving room for the matrices and vertex decode uniforms every program shares
+const int SKIN_MAX_BONES = 48;
+const int SKIN_BONES_PER_VERTEX = 4;
+
+// Per-vertex skin as uploaded: bone indices and unorm8 weights summing to 255
+struct SkinWeights {
+	uint8_t bones[SKIN_BONES_PER_VERTEX];
+	uint8_t weights[SKIN_BONES_PER_VERTEX];
+};
+
+// Per-vertex skin while loading, keeps the heaviest influences
+struct SkinInfluences {
+	int bones[SKIN_BONES_PER_VERTEX] = {0, 0, 0, 0};
+	float weights[SKIN_BONES_PER_VERTEX] = {0.0f, 0.0f, 0.0f, 0.0f};
+};
+
+struct VectorKey {
+	double time; // in ticks
+	glm::vec3 value;
+};
+
+struct RotationKey {
+	double time;
+	glm::quat value;
+};
+
+// Keys of one node, any of the three lists may be empty
+struct AnimationChannel {
+	int node; // into the model's nodes
+	std::vector<VectorKey> positions;
+	std::vector<RotationKey> rotations;
+	std::vector<VectorKey> scales;
+};
+
+struct Animation {
+	std::string name;
+	double duration;       // in ticks
+	double ticksPerSecond;
+	std::vector<AnimationChannel> channels;
+};
+
+// Replaces the lightest influence when weight is heavier
+void addSkinInfluence(SkinInfluences & skin, int bone, float weight) {
+	int lightest = 0;
+	for (int i = 1; i < SKIN_BONES_PER_VERTEX; i++)
+		if (skin.weights[i] < skin.weights[lightest])
+			lightest = i;
+	if (weight > skin.weights[lightest]) {
+		skin.bones[lightest] = bone;
+		skin.weights[lightest] = weight;
+	}
+}
+
+// Normalizes the weights and quantizes them so they still sum to exactly 255.
+// A vertex without influences follows bone fallbackBone rigidly.
+SkinWeights packSkinWeights(const SkinInfluences & skin, int fallbackBone = 0) {
+	SkinWeights packed;
+	float total = 0.0f;
+	for (int i = 0; i < SKIN_BONES_PER_VERTEX; i++)
+		total += skin.weights[i];
+	int sum = 0, heaviest = 0;
+	for (int i = 0; i < SKIN_BONES_PER_VERTEX; i++) {
+		packed.bones[i] = (uint8_t)skin.bones[i];
+		packed.weights[i] = total > 0.0f ? (uint8_t)std::lround(skin.weights[i] / total * 255.0f) : 0;
+		sum += packed.weights[i];
+		if (skin.weights[i] > skin.weights[heaviest])
+			heaviest = i;
+	}
+	if (total <= 0.0f) {
+		packed.bones[0] = (uint8_t)fallbackBone;
+		packed.weights[0] = 255;
+		return packed;
+	}
+	packed.weights[heaviest] = (uint8_t)(packed.weights[heaviest] + 255 - sum); // rounding error goes to the heaviest bone
+	return packed;
+}
+
+// Index of the last key at or before time (0 when time is before every key)
+template <typename Key>
+size_t findKey(const std::vector<Key> & keys, double time) {
+	size_t lo = 0, hi = keys.size();
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (keys[mid].time <= time)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+glm::vec3 sampleVectorKeys(const std::vector<VectorKey> & keys, double time, glm::vec3 fallback) {
+	if (keys.empty())
+		return fallback;
+	size_t k = findKey(keys, time);
+	if (k + 1 >= keys.size() || time <= keys[k].time)
+		return keys[k].value;
+	float t = (float)((time - keys[k].time) / (keys[k + 1].time - keys[k].time));
+	return glm::mix(keys[k].value, keys[k + 1].value, t);
+}
+
+glm::quat sampleRotationKeys(const std::vector<RotationKey> & keys, double time, glm::quat fallback) {
+	if (keys.empty())
+		return fallback;
+	size_t k = findKey(keys, time);
+	if (k + 1 >= keys.size() || time <= keys[k].time)
+		return keys[k].value;
+	float t = (float)((time - keys[k].time) / (keys[k + 1].time - keys[k].time));
+	return glm::normalize(glm::slerp(keys[k].value, keys[k + 1].value, t));
+}
+
+// Overwrites the local transform of every animated node with the animation at
+// seconds, looping. Channels without a key list keep the identity for it, as
+// Assimp channels always carry at least one key of each kind.
+void sampleAnimation(const Animation & animation, double seconds, std::vector<glm::mat4> & localTransforms) {
+	double ticksPerSecond = animation.ticksPerSecond > 0.0 ? animation.ticksPerSecond : 25.0;
+	double ticks = seconds * ticksPerSecond;
+	if (animation.duration > 0.0) {
+		ticks = std::fmod(ticks, animation.duration);
+		if (ticks < 0.0)
+			ticks += animation.duration;
+	}
+	for (size_t i = 0; i < animation.channels.size(); i++) {
+		const AnimationChannel & channel = animation.channels[i];
+		glm::vec3 position = sampleVectorKeys(channel.positions, ticks, glm::vec3(0.0f));
+		glm::quat rotation = sampleRotationKeys(channel.rotations, ticks, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		glm::vec3 scale = sampleVectorKeys(channel.scales, ticks, glm::vec3(1.0f));
+		localTransforms[channel.node] = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+	}
+}
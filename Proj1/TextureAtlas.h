@@ -0,0 +1,131 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+// Layout of material textures in the layers of one texture array, so they can
+// all be sampled under a single bind. Textures of the most common size get a
+// layer each; every other texture is scaled down when it is bigger than a
+// layer and shelf packed, inside a border of clamped texels, into atlas
+// layers after them.
+
+const int ATLAS_BORDER = 4;           // texels around an atlas rectangle, so filtering and the first mips don't bleed in its neighbours
+const int ATLAS_MIN_LAYER_SIZE = 64; // layers are never smaller, so a bordered rectangle always fits
+
+// Where one texture ended up
+struct AtlasPlacement {
+	int layer;
+	int x, y;          // of the texture inside the layer, border excluded
+	int width, height; // as stored, smaller than the source when it had to be scaled
+};
+
+struct AtlasLayout {
+	glm::ivec2 layerSize = glm::ivec2(0);
+	int layerCount = 0;
+	int fullLayers = 0;                     // layers holding a single texture, the atlas layers follow them
+	std::vector<AtlasPlacement> placements; // one per texture, in the order given
+};
+
+// Lays out textures of the given sizes, layers are as big as the most common size (the larger one on a tie)
+AtlasLayout layoutTextureArray(const std::vector<glm::ivec2> & sizes) {
+	AtlasLayout layout;
+	if (sizes.empty())
+		return layout;
+	std::map<std::pair<int, int>, int> counts;
+	for (size_t i = 0; i < sizes.size(); i++)
+		counts[std::make_pair(sizes[i].x, sizes[i].y)]++;
+	int best = 0;
+	for (std::map<std::pair<int, int>, int>::iterator it = counts.begin(); it != counts.end(); ++it) {
+		long long area = (long long)it->first.first * it->first.second;
+		if (it->second > best || (it->second == best && area > (long long)layout.layerSize.x * layout.layerSize.y)) {
+			best = it->second;
+			layout.layerSize = glm::ivec2(it->first.first, it->first.second);
+		}
+	}
+	layout.layerSize = glm::max(layout.layerSize, glm::ivec2(ATLAS_MIN_LAYER_SIZE));
+
+	layout.placements.resize(sizes.size());
+	std::vector<size_t> odd;
+	for (size_t i = 0; i < sizes.size(); i++) {
+		if (sizes[i] == layout.layerSize) {
+			AtlasPlacement placement = {layout.layerCount++, 0, 0, sizes[i].x, sizes[i].y};
+			layout.placements[i] = placement;
+		} else {
+			odd.push_back(i);
+		}
+	}
+	layout.fullLayers = layout.layerCount;
+	if (odd.empty())
+		return layout;
+
+	// scaled to fit a layer with its border, then packed tallest first
+	glm::ivec2 room = glm::max(layout.layerSize - 2 * ATLAS_BORDER, glm::ivec2(1));
+	for (size_t k = 0; k < odd.size(); k++) {
+		glm::ivec2 size = sizes[odd[k]];
+		float scale = std::min(1.0f, std::min((float)room.x / size.x, (float)room.y / size.y));
+		AtlasPlacement & placement = layout.placements[odd[k]];
+		placement.width = std::max(1, std::min(room.x, (int)(size.x * scale)));
+		placement.height = std::max(1, std::min(room.y, (int)(size.y * scale)));
+	}
+	std::sort(odd.begin(), odd.end(), [&layout](size_t a, size_t b) { return layout.placements[a].height > layout.placements[b].height; });
+	int layer = layout.layerCount++, shelfY = 0, shelfHeight = 0, cursorX = 0;
+	for (size_t k = 0; k < odd.size(); k++) {
+		AtlasPlacement & placement = layout.placements[odd[k]];
+		int paddedWidth = placement.width + 2 * ATLAS_BORDER, paddedHeight = placement.height + 2 * ATLAS_BORDER;
+		if (cursorX + paddedWidth > layout.layerSize.x) {
+			shelfY += shelfHeight;
+			cursorX = shelfHeight = 0;
+		}
+		if (shelfY + paddedHeight > layout.layerSize.y) {
+			layer = layout.layerCount++;
+			shelfY = shelfHeight = cursorX = 0;
+		}
+		placement.layer = layer;
+		placement.x = cursorX + ATLAS_BORDER;
+		placement.y = shelfY + ATLAS_BORDER;
+		cursorX += paddedWidth;
+		shelfHeight = std::max(shelfHeight, paddedHeight);
+	}
+	return layout;
+}
+
+// Texture coordinates of a placement in its layer: offset in xy, scale in zw
+glm::vec4 atlasRect(const AtlasLayout & layout, const AtlasPlacement & placement) {
+	return glm::vec4((float)placement.x / layout.layerSize.x, (float)placement.y / layout.layerSize.y,
+		(float)placement.width / layout.layerSize.x, (float)placement.height / layout.layerSize.y);
+}
+
+// Box filters RGBA pixels down to width x height (the sizes of the source when it is not smaller)
+void resizeRGBA(const uint8_t * pixels, int sourceWidth, int sourceHeight, int width, int height, std::vector<uint8_t> & resized) {
+	resized.resize((size_t)width * height * 4);
+	for (int y = 0; y < height; y++) {
+		int y0 = (int)((long long)y * sourceHeight / height), y1 = std::max(y0 + 1, (int)((long long)(y + 1) * sourceHeight / height));
+		for (int x = 0; x < width; x++) {
+			int x0 = (int)((long long)x * sourceWidth / width), x1 = std::max(x0 + 1, (int)((long long)(x + 1) * sourceWidth / width));
+			uint32_t sum[4] = {0, 0, 0, 0};
+			for (int sy = y0; sy < y1; sy++)
+				for (int sx = x0; sx < x1; sx++)
+					for (int c = 0; c < 4; c++)
+						sum[c] += pixels[((size_t)sy * sourceWidth + sx) * 4 + c];
+			uint32_t count = (uint32_t)((y1 - y0) * (x1 - x0));
+			for (int c = 0; c < 4; c++)
+				resized[((size_t)y * width + x) * 4 + c] = (uint8_t)((sum[c] + count / 2) / count);
+		}
+	}
+}
+
+// Copies width x height RGBA pixels into a layer at placement, repeating the edge texels over the border
+void blitAtlasPlacement(const uint8_t * pixels, const AtlasPlacement & placement, glm::ivec2 layerSize, uint8_t * layer) {
+	int border = placement.x == 0 && placement.y == 0 && placement.width == layerSize.x && placement.height == layerSize.y ? 0 : ATLAS_BORDER;
+	for (int y = -border; y < placement.height + border; y++) {
+		int sy = std::min(std::max(y, 0), placement.height - 1);
+		for (int x = -border; x < placement.width + border; x++) {
+			int sx = std::min(std::max(x, 0), placement.width - 1);
+			memcpy(layer + ((size_t)(placement.y + y) * layerSize.x + placement.x + x) * 4, pixels + ((size_t)sy * placement.width + sx) * 4, 4);
+		}
+	}
+}
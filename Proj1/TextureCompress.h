@@ -0,0 +1,428 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Block compression of texture levels: every 4x4 texel block becomes 8 bytes
+// (BC1, opaque RGB) or 16 bytes (BC3 with an alpha block, BC7 mode 6).
+// Encoding runs when assets are cooked; the decoders are the runtime fallback
+// for drivers without the compressed format.
+
+enum TextureBlockFormat {
+	TEXTURE_BLOCK_NONE, // raw 8-bit pixels
+	TEXTURE_BLOCK_BC1,
+	TEXTURE_BLOCK_BC3,
+	TEXTURE_BLOCK_BC7
+};
+
+// What a bundle or cook run does with textures
+enum TextureCompression {
+	TEXTURE_COMPRESSION_NONE,
+	TEXTURE_COMPRESSION_BC,  // BC1 for opaque textures, BC3 for those with alpha
+	TEXTURE_COMPRESSION_BC7, // BC7 for every texture: twice the size of BC1, closer to the source
+	TEXTURE_COMPRESSION_COUNT
+};
+
+const char * textureCompressionName(TextureCompression compression) {
+	switch (compression) {
+	case TEXTURE_COMPRESSION_BC:
+		return "bc";
+	case TEXTURE_COMPRESSION_BC7:
+		return "bc7";
+	default:
+		return "none";
+	}
+}
+
+bool parseTextureCompression(const char * name, TextureCompression & compression) {
+	for (int i = 0; i < TEXTURE_COMPRESSION_COUNT; i++) {
+		if (strcmp(name, textureCompressionName((TextureCompression)i)) == 0) {
+			compression = (TextureCompression)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char * textureBlockFormatName(TextureBlockFormat format) {
+	switch (format) {
+	case TEXTURE_BLOCK_BC1:
+		return "BC1";
+	case TEXTURE_BLOCK_BC3:
+		return "BC3";
+	case TEXTURE_BLOCK_BC7:
+		return "BC7";
+	default:
+		return "uncompressed";
+	}
+}
+
+// Block format for a texture of channels channels, NONE for single-channel textures which stay raw
+TextureBlockFormat chooseTextureBlockFormat(TextureCompression compression, int channels) {
+	if (compression == TEXTURE_COMPRESSION_NONE || channels < 3)
+		return TEXTURE_BLOCK_NONE;
+	if (compression == TEXTURE_COMPRESSION_BC7)
+		return TEXTURE_BLOCK_BC7;
+	return channels == 4 ? TEXTURE_BLOCK_BC3 : TEXTURE_BLOCK_BC1;
+}
+
+// Bytes of one level in format, or as raw pixels of channels channels
+size_t textureLevelBytes(TextureBlockFormat format, int width, int height, int channels) {
+	if (format == TEXTURE_BLOCK_NONE)
+		return (size_t)width * height * channels;
+	size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == TEXTURE_BLOCK_BC1 ? 8 : 16);
+}
+
+// Texels are RGBA, 16 per block in row order
+
+// Principal axis of the block's colors (channels 3 or 4) by power iteration, and their mean
+void blockPrincipalAxis(const uint8_t block[64], int channels, float mean[4], float axis[4]) {
+	for (int c = 0; c < 4; c++)
+		mean[c] = 0.0f;
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < channels; c++)
+			mean[c] += block[i * 4 + c] / 16.0f;
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < channels; b++)
+				covariance[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+	for (int c = 0; c < 4; c++)
+		axis[c] = c < channels ? 1.0f : 0.0f;
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		float length = 0.0f;
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < channels; b++)
+				next[a] += covariance[a][b] * axis[b];
+			length += next[a] * next[a];
+		}
+		if (length < 1e-12f)
+			break; // flat block, any axis will do
+		length = sqrtf(length);
+		for (int c = 0; c < channels; c++)
+			axis[c] = next[c] / length;
+	}
+}
+
+// Ends of the block's colors along their principal axis
+void blockEndpoints(const uint8_t block[64], int channels, float low[4], float high[4]) {
+	float mean[4], axis[4];
+	blockPrincipalAxis(block, channels, mean, axis);
+	float minT = 0.0f, maxT = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int c = 0; c < channels; c++)
+			t += (block[i * 4 + c] - mean[c]) * axis[c];
+		minT = t < minT ? t : minT;
+		maxT = t > maxT ? t : maxT;
+	}
+	for (int c = 0; c < 4; c++) {
+		float l = mean[c] + axis[c] * minT, h = mean[c] + axis[c] * maxT;
+		low[c] = l < 0.0f ? 0.0f : l > 255.0f ? 255.0f : l;
+		high[c] = h < 0.0f ? 0.0f : h > 255.0f ? 255.0f : h;
+	}
+}
+
+uint16_t packRGB565(const float color[4]) {
+	int r = (int)(color[0] * 31.0f / 255.0f + 0.5f), g = (int)(color[1] * 63.0f / 255.0f + 0.5f), b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int color[3]) {
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// The four colors of a 4-color BC1 block
+void bc1Palette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+}
+
+void encodeBC1Block(const uint8_t block[64], uint8_t out[8]) {
+	float low[4], high[4];
+	blockEndpoints(block, 3, low, high);
+	uint16_t c0 = packRGB565(high), c1 = packRGB565(low);
+	if (c0 < c1) {
+		uint16_t swap = c0;
+		c0 = c1;
+		c1 = swap;
+	}
+	uint32_t indices = 0;
+	if (c0 != c1) { // equal ends would switch the block to 3-color mode, index 0 everywhere is exact then
+		int palette[4][3];
+		bc1Palette(c0, c1, palette);
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 4; p++) {
+				int error = 0;
+				for (int c = 0; c < 3; c++) {
+					int d = block[i * 4 + c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+	out[0] = (uint8_t)(c0 & 0xff);
+	out[1] = (uint8_t)(c0 >> 8);
+	out[2] = (uint8_t)(c1 & 0xff);
+	out[3] = (uint8_t)(c1 >> 8);
+	for (int b = 0; b < 4; b++)
+		out[4 + b] = (uint8_t)(indices >> (b * 8));
+}
+
+// BC3's alpha half: two 8-bit ends and a 3-bit index per texel
+void encodeBC3AlphaBlock(const uint8_t block[64], uint8_t out[8]) {
+	int a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; i++) {
+		a0 = block[i * 4 + 3] > a0 ? block[i * 4 + 3] : a0;
+		a1 = block[i * 4 + 3] < a1 ? block[i * 4 + 3] : a1;
+	}
+	out[0] = (uint8_t)a0;
+	out[1] = (uint8_t)a1;
+	uint64_t indices = 0;
+	if (a0 > a1) {
+		int palette[8] = {a0, a1};
+		for (int p = 1; p < 7; p++)
+			palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			for (int p = 1; p < 8; p++)
+				if (abs(block[i * 4 + 3] - palette[p]) < abs(block[i * 4 + 3] - palette[best]))
+					best = p;
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+	for (int b = 0; b < 6; b++)
+		out[2 + b] = (uint8_t)(indices >> (b * 8));
+}
+
+void encodeBC3Block(const uint8_t block[64], uint8_t out[16]) {
+	encodeBC3AlphaBlock(block, out);
+	encodeBC1Block(block, out + 8);
+}
+
+const int BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Writes count bits of value at bit position at of a 16-byte block
+void writeBlockBits(uint8_t out[16], int & at, uint32_t value, int count) {
+	for (int i = 0; i < count; i++, at++)
+		if (value >> i & 1)
+			out[at >> 3] |= (uint8_t)(1 << (at & 7));
+}
+
+uint32_t readBlockBits(const uint8_t block[16], int & at, int count) {
+	uint32_t value = 0;
+	for (int i = 0; i < count; i++, at++)
+		value |= (uint32_t)(block[at >> 3] >> (at & 7) & 1) << i;
+	return value;
+}
+
+// Nearest 7-bit RGBA endpoint plus shared p-bit to an 8-bit one
+void quantizeBC7Endpoint(const float color[4], uint8_t quantized[4], int & pbit) {
+	float bestError = 1e30f;
+	for (int p = 0; p < 2; p++) {
+		float error = 0.0f;
+		uint8_t candidate[4];
+		for (int c = 0; c < 4; c++) {
+			int q = (int)((color[c] - p) / 2.0f + 0.5f);
+			q = q < 0 ? 0 : q > 127 ? 127 : q;
+			candidate[c] = (uint8_t)q;
+			float d = color[c] - (float)((q << 1) | p);
+			error += d * d;
+		}
+		if (error < bestError) {
+			bestError = error;
+			pbit = p;
+			memcpy(quantized, candidate, 4);
+		}
+	}
+}
+
+// BC7 mode 6: one subset, 7-bit RGBA ends with a p-bit each, 4-bit indices
+void encodeBC7Block(const uint8_t block[64], uint8_t out[16]) {
+	float low[4], high[4];
+	blockEndpoints(block, 4, low, high);
+	uint8_t ends[2][4];
+	int pbits[2];
+	quantizeBC7Endpoint(low, ends[0], pbits[0]);
+	quantizeBC7Endpoint(high, ends[1], pbits[1]);
+
+	int endpoints[2][4];
+	for (int e = 0; e < 2; e++)
+		for (int c = 0; c < 4; c++)
+			endpoints[e][c] = (ends[e][c] << 1) | pbits[e];
+	int indices[16];
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestError = 1 << 30;
+		for (int w = 0; w < 16; w++) {
+			int error = 0;
+			for (int c = 0; c < 4; c++) {
+				int value = ((64 - BC7_WEIGHTS4[w]) * endpoints[0][c] + BC7_WEIGHTS4[w] * endpoints[1][c] + 32) >> 6;
+				error += (block[i * 4 + c] - value) * (block[i * 4 + c] - value);
+			}
+			if (error < bestError) {
+				bestError = error;
+				best = w;
+			}
+		}
+		indices[i] = best;
+	}
+	// the first index is stored without its top bit, so it has to be below 8
+	if (indices[0] >= 8) {
+		for (int c = 0; c < 4; c++) {
+			uint8_t swap = ends[0][c];
+			ends[0][c] = ends[1][c];
+			ends[1][c] = swap;
+		}
+		int swap = pbits[0];
+		pbits[0] = pbits[1];
+		pbits[1] = swap;
+		for (int i = 0; i < 16; i++)
+			indices[i] = 15 - indices[i];
+	}
+
+	memset(out, 0, 16);
+	int at = 0;
+	writeBlockBits(out, at, 1 << 6, 7); // mode 6
+	for (int c = 0; c < 4; c++) {
+		writeBlockBits(out, at, ends[0][c], 7);
+		writeBlockBits(out, at, ends[1][c], 7);
+	}
+	writeBlockBits(out, at, pbits[0], 1);
+	writeBlockBits(out, at, pbits[1], 1);
+	for (int i = 0; i < 16; i++)
+		writeBlockBits(out, at, indices[i], i == 0 ? 3 : 4);
+}
+
+// Copies the 4x4 block at (x, y) of RGBA or RGB pixels to RGBA, repeating the last row / column past the edges
+void readTexelBlock(const uint8_t * pixels, int width, int height, int channels, int x, int y, uint8_t block[64]) {
+	for (int by = 0; by < 4; by++) {
+		int sy = y + by < height ? y + by : height - 1;
+		for (int bx = 0; bx < 4; bx++) {
+			int sx = x + bx < width ? x + bx : width - 1;
+			const uint8_t * texel = pixels + ((size_t)sy * width + sx) * channels;
+			uint8_t * to = block + (by * 4 + bx) * 4;
+			for (int c = 0; c < 4; c++)
+				to[c] = c < channels ? texel[c] : 255;
+		}
+	}
+}
+
+// Appends the blocks of one level of 3 or 4 channel pixels, in row order
+void compressTextureLevel(const uint8_t * pixels, int width, int height, int channels, TextureBlockFormat format, std::vector<uint8_t> & out) {
+	size_t blockSize = format == TEXTURE_BLOCK_BC1 ? 8 : 16;
+	for (int y = 0; y < height; y += 4) {
+		for (int x = 0; x < width; x += 4) {
+			uint8_t block[64];
+			readTexelBlock(pixels, width, height, channels, x, y, block);
+			out.resize(out.size() + blockSize);
+			uint8_t * to = &out[out.size() - blockSize];
+			if (format == TEXTURE_BLOCK_BC1)
+				encodeBC1Block(block, to);
+			else if (format == TEXTURE_BLOCK_BC3)
+				encodeBC3Block(block, to);
+			else
+				encodeBC7Block(block, to);
+		}
+	}
+}
+
+void decodeBC1Block(const uint8_t in[8], uint8_t block[64]) {
+	uint16_t c0 = (uint16_t)(in[0] | in[1] << 8), c1 = (uint16_t)(in[2] | in[3] << 8);
+	int palette[4][3];
+	bc1Palette(c0, c1, palette);
+	if (c0 <= c1) { // 3-color mode, only written for flat blocks here
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	uint32_t indices = in[4] | in[5] << 8 | in[6] << 16 | (uint32_t)in[7] << 24;
+	for (int i = 0; i < 16; i++) {
+		int p = indices >> (i * 2) & 3;
+		for (int c = 0; c < 3; c++)
+			block[i * 4 + c] = (uint8_t)palette[p][c];
+		block[i * 4 + 3] = 255;
+	}
+}
+
+void decodeBC3Block(const uint8_t in[16], uint8_t block[64]) {
+	decodeBC1Block(in + 8, block);
+	int a0 = in[0], a1 = in[1];
+	int palette[8] = {a0, a1};
+	for (int p = 1; p < 7; p++)
+		palette[p + 1] = a0 > a1 ? ((7 - p) * a0 + p * a1) / 7 : p < 5 ? ((5 - p) * a0 + p * a1) / 5 : p == 5 ? 0 : 255;
+	uint64_t indices = 0;
+	for (int b = 0; b < 6; b++)
+		indices |= (uint64_t)in[2 + b] << (b * 8);
+	for (int i = 0; i < 16; i++)
+		block[i * 4 + 3] = (uint8_t)palette[indices >> (i * 3) & 7];
+}
+
+// Mode 6 only, what encodeBC7Block writes; false for any other mode
+bool decodeBC7Block(const uint8_t in[16], uint8_t block[64]) {
+	int at = 0;
+	if (readBlockBits(in, at, 7) != 1 << 6)
+		return false;
+	int endpoints[2][4];
+	for (int c = 0; c < 4; c++) {
+		endpoints[0][c] = readBlockBits(in, at, 7) << 1;
+		endpoints[1][c] = readBlockBits(in, at, 7) << 1;
+	}
+	int p0 = readBlockBits(in, at, 1), p1 = readBlockBits(in, at, 1);
+	for (int c = 0; c < 4; c++) {
+		endpoints[0][c] |= p0;
+		endpoints[1][c] |= p1;
+	}
+	for (int i = 0; i < 16; i++) {
+		int w = BC7_WEIGHTS4[readBlockBits(in, at, i == 0 ? 3 : 4)];
+		for (int c = 0; c < 4; c++)
+			block[i * 4 + c] = (uint8_t)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+	}
+	return true;
+}
+
+// Decodes one level back to RGBA pixels, false when a block cannot be decoded
+bool decompressTextureLevel(const uint8_t * blocks, int width, int height, TextureBlockFormat format, std::vector<uint8_t> & rgba) {
+	rgba.resize((size_t)width * height * 4);
+	size_t blockSize = format == TEXTURE_BLOCK_BC1 ? 8 : 16;
+	for (int y = 0; y < height; y += 4) {
+		for (int x = 0; x < width; x += 4, blocks += blockSize) {
+			uint8_t block[64];
+			if (format == TEXTURE_BLOCK_BC1)
+				decodeBC1Block(blocks, block);
+			else if (format == TEXTURE_BLOCK_BC3)
+				decodeBC3Block(blocks, block);
+			else if (!decodeBC7Block(blocks, block))
+				return false;
+			for (int by = 0; by < 4 && y + by < height; by++)
+				for (int bx = 0; bx < 4 && x + bx < width; bx++)
+					memcpy(&rgba[((size_t)(y + by) * width + x + bx) * 4], block + (by * 4 + bx) * 4, 4);
+		}
+	}
+	return true;
+}
+
+// RGBA pixels to 16-bit 5:6:5, the fallback for BC1 textures keeps their size
+void convertToRGB565(const std::vector<uint8_t> & rgba, std::vector<uint16_t> & packed) {
+	packed.resize(rgba.size() / 4);
+	for (size_t i = 0; i < packed.size(); i++)
+		packed[i] = (uint16_t)((rgba[i * 4] >> 3) << 11 | (rgba[i * 4 + 1] >> 2) << 5 | rgba[i * 4 + 2] >> 3);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stb/stb_image.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <stdint.h>
+
+// Shared texture handles, so each image is decoded and uploaded once however
+// often it is asked for. A request is looked up by path, then by a hash of the
+// file's bytes (the same image under another name), then by a hash of the
+// decoded pixels (the same image in another encoding); only when all three
+// miss is it uploaded. Files that cannot be read or decoded all share one
+// fallback texture, a magenta and black checker, instead of handle 0.
+// Uploading is left to the caller: upload(pixels, width, height, channels)
+// returns the new handle, so this file stays free of GL.
+
+const int TEXTURE_FALLBACK_SIZE = 8; // texels, 2x2 squares
+
+struct TextureRegistryStats {
+	size_t requests = 0;
+	size_t pathHits = 0;
+	size_t contentHits = 0; // same file bytes under another path
+	size_t pixelHits = 0;   // same pixels from different file bytes
+	size_t uploads = 0;
+	size_t missing = 0;     // given the fallback
+	double decodeSeconds = 0.0;
+};
+
+struct TextureRegistry {
+	std::map<std::string, unsigned int> byPath;
+	std::map<uint64_t, unsigned int> byContent;
+	std::map<uint64_t, unsigned int> byPixels;
+	unsigned int fallback = 0; // created on the first missing file
+	TextureRegistryStats stats;
+};
+
+// FNV-1a, continued from hash
+uint64_t hashTextureBytes(const unsigned char * bytes, size_t size, uint64_t hash = 14695981039346656037ull) {
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+bool readTextureFile(const std::string & path, std::vector<unsigned char> & bytes) {
+	FILE * file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bytes.resize(size > 0 ? (size_t)size : 0);
+	bool read = size > 0 && fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	fclose(file);
+	return read;
+}
+
+template <typename Upload>
+unsigned int textureFallback(TextureRegistry & registry, Upload upload) {
+	if (registry.fallback == 0) {
+		unsigned char pixels[TEXTURE_FALLBACK_SIZE * TEXTURE_FALLBACK_SIZE * 3];
+		for (int y = 0; y < TEXTURE_FALLBACK_SIZE; y++) {
+			for (int x = 0; x < TEXTURE_FALLBACK_SIZE; x++) {
+				bool magenta = ((x / 2) + (y / 2)) % 2 == 0;
+				unsigned char * texel = pixels + (y * TEXTURE_FALLBACK_SIZE + x) * 3;
+				texel[0] = magenta ? 255 : 0;
+				texel[1] = 0;
+				texel[2] = magenta ? 255 : 0;
+			}
+		}
+		registry.fallback = upload(pixels, TEXTURE_FALLBACK_SIZE, TEXTURE_FALLBACK_SIZE, 3);
+	}
+	return registry.fallback;
+}
+
+// Handle of the image at path, decoding and uploading it only when no earlier request had the same path, bytes or pixels
+template <typename Upload>
+unsigned int acquireTexture(TextureRegistry & registry, const std::string & path, Upload upload) {
+	registry.stats.requests++;
+	std::map<std::string, unsigned int>::iterator known = registry.byPath.find(path);
+	if (known != registry.byPath.end()) {
+		registry.stats.pathHits++;
+		return known->second;
+	}
+
+	std::vector<unsigned char> bytes;
+	unsigned int handle = 0;
+	if (!readTextureFile(path, bytes)) {
+		fprintf(stderr, "%s: texture file missing, using the fallback texture\n", path.c_str());
+		registry.stats.missing++;
+		handle = textureFallback(registry, upload);
+		registry.byPath[path] = handle;
+		return handle;
+	}
+	uint64_t contentHash = hashTextureBytes(bytes.data(), bytes.size());
+	std::map<uint64_t, unsigned int>::iterator sameFile = registry.byContent.find(contentHash);
+	if (sameFile != registry.byContent.end()) {
+		registry.stats.contentHits++;
+		registry.byPath[path] = sameFile->second;
+		return sameFile->second;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	int width, height, nrChannels;
+	unsigned char * pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &nrChannels, 0);
+	registry.stats.decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!pixels) {
+		fprintf(stderr, "%s: texture could not be decoded, using the fallback texture\n", path.c_str());
+		registry.stats.missing++;
+		handle = textureFallback(registry, upload);
+	} else {
+		// size and channels are part of the key, so equal bytes of differently shaped images never match
+		uint64_t pixelHash = hashTextureBytes(pixels, (size_t)width * height * nrChannels);
+		int shape[3] = {width, height, nrChannels};
+		pixelHash = hashTextureBytes((const unsigned char *)shape, sizeof(shape), pixelHash);
+		std::map<uint64_t, unsigned int>::iterator samePixels = registry.byPixels.find(pixelHash);
+		if (samePixels != registry.byPixels.end()) {
+			registry.stats.pixelHits++;
+			handle = samePixels->second;
+		} else {
+			registry.stats.uploads++;
+			handle = upload(pixels, width, height, nrChannels);
+			registry.byPixels[pixelHash] = handle;
+		}
+		stbi_image_free(pixels);
+		registry.byContent[contentHash] = handle;
+	}
+	registry.byPath[path] = handle;
+	return handle;
+}
+
+// Records a handle loaded some other way (a bundle, a background decode), so later requests share it
+void addRegisteredTexture(TextureRegistry & registry, const std::string & path, uint64_t contentHash, unsigned int handle) {
+	registry.byPath[path] = handle;
+	registry.byContent[contentHash] = handle;
+}
+
+void printTextureRegistryStats(const TextureRegistry & registry) {
+	const TextureRegistryStats & stats = registry.stats;
+	printf("Texture registry: %zu requests, %zu path hits, %zu content hits, %zu pixel hits, %zu uploads, %zu missing (fallback), %.2f ms decoding\n",
+		stats.requests, stats.pathHits, stats.contentHits, stats.pixelHits, stats.uploads, stats.missing, stats.decodeSeconds * 1000.0);
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+#include <stdio.h>
+
+// Vertex layouts the upload paths can pick from
+enum VertexFormat {
+	VERTEX_FORMAT_FLOAT,   // vec3 position, vec3 normal, vec2 uv as 32-bit floats
+	VERTEX_FORMAT_COMPACT  // CompactVertex below
+};
+
+// Size of one VERTEX_FORMAT_FLOAT vertex, the baseline savings are reported against
+const size_t FLOAT_VERTEX_SIZE = 8 * sizeof(float);
+
+// Compact vertex format: 16 bytes instead of the 32 of TexturedColoredVertex.
+//  position: unorm16 x3 relative to the mesh AABB (decoded with positionScale/positionOffset)
+//  normal:   octahedral encoding, snorm16 x2
+//  uv:       half float x2 (keeps repeating UVs such as the ground's 0..10)
+struct CompactVertex {
+	uint16_t position[4]; // xyz + padding, keeps normal 4-byte aligned
+	int16_t normal[2];
+	uint16_t uv[2];
+};
+
+// What the vertex shader needs to undo the quantization
+struct VertexDecode {
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+	bool octahedralNormals = false;
+};
+
+uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (((bits >> 23) & 0xff) == 0xff) // inf / nan
+		return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31) // overflow
+		return (uint16_t)(sign | 0x7c00);
+	if (exponent <= 0) { // subnormal or zero
+		if (exponent < -10)
+			return (uint16_t)sign;
+		mantissa |= 0x800000;
+		uint32_t shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return (uint16_t)(sign | half);
+	}
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++; // may carry into the exponent, which rounds up correctly
+	return (uint16_t)half;
+}
+
+int16_t toSnorm16(float value) {
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (int16_t)std::lround(value * 32767.0f);
+}
+
+uint16_t toUnorm16(float value) {
+	value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	return (uint16_t)std::lround(value * 65535.0f);
+}
+
+// Octahedral normal encoding (Cigolle et al. 2014), 2 components in [-1, 1]
+glm::vec2 encodeOctahedral(glm::vec3 n) {
+	float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	if (sum == 0.0f)
+		return glm::vec2(0.0f, 0.0f);
+	n /= sum;
+	if (n.z < 0.0f) {
+		float x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		float y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		return glm::vec2(x, y);
+	}
+	return glm::vec2(n.x, n.y);
+}
+
+// Quantizes any vertex with position/normal/uv members into CompactVertex
+template <typename Vertex>
+void quantizeVertices(const Vertex * vertices, size_t count, std::vector<CompactVertex> & out, VertexDecode & decode) {
+	glm::vec3 lo(0.0f), hi(0.0f);
+	if (count > 0)
+		lo = hi = vertices[0].position;
+	for (size_t i = 1; i < count; i++) {
+		lo = glm::min(lo, vertices[i].position);
+		hi = glm::max(hi, vertices[i].position);
+	}
+	glm::vec3 extent = hi - lo;
+	for (int k = 0; k < 3; k++)
+		if (extent[k] <= 0.0f)
+			extent[k] = 1.0f; // flat axis, every vertex quantizes to 0
+	decode.positionOffset = lo;
+	decode.positionScale = extent;
+	decode.octahedralNormals = true;
+
+	out.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		const Vertex & v = vertices[i];
+		CompactVertex & c = out[i];
+		glm::vec3 p = (v.position - lo) / extent;
+		c.position[0] = toUnorm16(p.x);
+		c.position[1] = toUnorm16(p.y);
+		c.position[2] = toUnorm16(p.z);
+		c.position[3] = 0;
+		glm::vec2 n = encodeOctahedral(v.normal);
+		c.normal[0] = toSnorm16(n.x);
+		c.normal[1] = toSnorm16(n.y);
+		c.uv[0] = floatToHalf(v.uv.x);
+		c.uv[1] = floatToHalf(v.uv.y);
+	}
+}
+
+size_t vertexFormatSize(VertexFormat format) {
+	return format == VERTEX_FORMAT_COMPACT ? sizeof(CompactVertex) : FLOAT_VERTEX_SIZE;
+}
+
+// Prints a mesh's buffer sizes against float vertices and 32-bit indices.
+// Every vertex and index is fetched at least once per draw, so the same ratio
+// is the minimum vertex fetch bandwidth saved on every frame.
+void printVertexFormatSavings(const char * name, size_t vertexCount, size_t indexCount, size_t vertexSize, size_t indexSize) {
+	size_t before = vertexCount * FLOAT_VERTEX_SIZE + indexCount * sizeof(uint32_t);
+	size_t after = vertexCount * vertexSize + indexCount * indexSize;
+	printf("%s: %zu vertices x %zu B + %zu indices x %zu B = %zu bytes (was %zu, %.1f%% saved)\n",
+		name, vertexCount, vertexSize, indexCount, indexSize, after, before,
+		before ? 100.0 * (double)(before - after) / (double)before : 0.0);
+}